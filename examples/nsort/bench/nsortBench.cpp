@@ -0,0 +1,423 @@
+/** \file
+ * Regression benchmark of the NSort (and PNSort) sort.  A matrix of
+ *    - number of items N (10^3 ... 10^8),
+ *    - number of buckets,
+ *    - item size (16 ... 256 bytes),
+ *    - key distribution (uniform, clustered, sorted), and
+ *    - number of threads (1 uses NSort, >1 uses PNSort)
+ * is swept and the best time of several repetitions of each case is written
+ * as JSON (one result per line).  Cases that would need more than --max-bytes
+ * of memory (input plus working copy) are skipped.
+ *
+ * If a baseline (the JSON output of an earlier run) is given, each case is
+ * compared to the case with the same id in the baseline and the program exits
+ * with a non-zero status if any case is slower than the baseline by more than
+ * the tolerance.  Only cases that took at least --min-time in the baseline are
+ * compared; shorter cases are dominated by timer and scheduling noise.
+ *
+ * The timings are absolute, so a baseline is only meaningful on the machine
+ * (and build) it was recorded on.  The stored baseline.json is from a --quick
+ * run on one development machine; regenerate it on each machine before
+ * comparing against it:
+ * <pre>
+ *    nsort_bench --quick --reps 5 --output baseline.json
+ * </pre>
+ *
+ * Usage:  nsort_bench [options]
+ * <pre>
+ *    --n LIST          Numbers of items.  [1e3,1e4,1e5,1e6,1e7,1e8]
+ *    --buckets LIST    Numbers of buckets.  [16,1024,65536]
+ *    --sizes LIST      Item sizes in bytes (16,32,64,128,256).  [16,64,256]
+ *    --dists LIST      Key distributions.  [uniform,clustered,sorted]
+ *    --threads LIST    Numbers of threads.  [1,2,4,... up to the #cpus]
+ *    --reps R          Repetitions of each case.  [5]
+ *    --max-bytes B     Memory limit of each case.  [2^30]
+ *    --quick           Small matrix (for smoke tests):  n=1e3,1e4,1e5,
+ *                      buckets=64,4096, sizes=16,64, threads=1,2, and
+ *                      reps=3 unless --reps is also given.
+ *    --output FILE     Write JSON to FILE instead of stdout.
+ *    --baseline FILE   Compare against the results in FILE.
+ *    --tolerance T     Allowed relative slowdown.  [0.25]
+ *    --min-time S      Cases faster than S seconds in the baseline are not
+ *                      compared (timer noise).  [1e-3]
+ * </pre>
+ * LISTs are comma separated.
+ */
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/nsort/PNSort.h>
+#include <xylose/random/Kiss.hpp>
+#include <xylose/Timer.h>
+
+#include <boost/cstdint.hpp>
+
+#include <unistd.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+
+  /** Item of the given size in bytes; the bucket is precomputed such that
+   * the benchmark measures the sort itself. */
+  template < unsigned int bytes >
+  struct Item {
+    boost::uint32_t key;
+    char pad[ bytes - sizeof(boost::uint32_t) ];
+  };
+
+  struct KeyMap {
+    template < typename T >
+    inline int operator()( const T & t ) const { return t.key; }
+  };
+
+  struct Config {
+    std::vector<double> ns;
+    std::vector<int> buckets;
+    std::vector<int> sizes;
+    std::vector<std::string> dists;
+    std::vector<int> threads;
+    int reps;
+    /** Whether reps was given explicitly (--quick then leaves it alone). */
+    bool reps_given;
+    double max_bytes;
+    std::string output;
+    std::string baseline;
+    double tolerance;
+    double min_time;
+
+    Config() : reps(5), reps_given(false),
+               max_bytes( 1024.0 * 1024.0 * 1024.0 ),
+               tolerance(0.25), min_time(1e-3) {
+      for ( int e = 3; e <= 8; ++e )
+        ns.push_back( std::pow( 10.0, e ) );
+      buckets.push_back( 16 );
+      buckets.push_back( 1024 );
+      buckets.push_back( 65536 );
+      sizes.push_back( 16 );
+      sizes.push_back( 64 );
+      sizes.push_back( 256 );
+      dists.push_back( "uniform" );
+      dists.push_back( "clustered" );
+      dists.push_back( "sorted" );
+      const long n_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+      for ( int t = 1; t <= std::max( 1L, n_cpus ); t *= 2 )
+        threads.push_back( t );
+    }
+
+    void quick() {
+      ns.clear();
+      ns.push_back( 1e3 );
+      ns.push_back( 1e4 );
+      ns.push_back( 1e5 );
+      buckets.clear();
+      buckets.push_back( 64 );
+      buckets.push_back( 4096 );
+      sizes.clear();
+      sizes.push_back( 16 );
+      sizes.push_back( 64 );
+      threads.clear();
+      threads.push_back( 1 );
+      threads.push_back( 2 );
+      if ( !reps_given )
+        reps = 3;
+    }
+
+    void setReps( const int & r ) {
+      reps = std::max( 1, r );
+      reps_given = true;
+    }
+  };
+
+  struct Result {
+    std::string id;
+    int n;
+    int buckets;
+    int bytes;
+    std::string dist;
+    int threads;
+    double seconds;
+    bool sorted;
+
+    double ns_per_item() const { return 1e9 * seconds / n; }
+  };
+
+  template < typename T >
+  std::vector<T> parseList( const std::string & s ) {
+    std::vector<T> v;
+    std::istringstream in( s );
+    std::string tok;
+    while ( std::getline( in, tok, ',' ) ) {
+      std::istringstream t( tok );
+      double d = 0;
+      t >> d;
+      v.push_back( static_cast<T>( d ) );
+    }
+    return v;
+  }
+
+  std::vector<std::string> parseNames( const std::string & s ) {
+    std::vector<std::string> v;
+    std::istringstream in( s );
+    std::string tok;
+    while ( std::getline( in, tok, ',' ) )
+      v.push_back( tok );
+    return v;
+  }
+
+  /** Fill the keys of the items according to the distribution. */
+  template < typename I >
+  bool makeKeys( std::vector<I> & v, const int & n_buckets,
+                 const std::string & dist ) {
+    xylose::random::Kiss rng;
+    const int n = static_cast<int>( v.size() );
+    if ( dist == "uniform" ) {
+      for ( int i = 0; i < n; ++i )
+        v[i].key = static_cast<int>( rng.randExc() * n_buckets );
+    } else if ( dist == "clustered" ) {
+      /* 90% of the items in 8 narrow clusters, the rest uniform */
+      const int n_clusters = 8;
+      const int width = std::max( 1, n_buckets / 256 );
+      int center[n_clusters];
+      for ( int c = 0; c < n_clusters; ++c )
+        center[c] = static_cast<int>( rng.randExc() * n_buckets );
+      for ( int i = 0; i < n; ++i ) {
+        if ( rng.randExc() < 0.9 ) {
+          const int c = static_cast<int>( rng.randExc() * n_clusters );
+          const int k = center[c] + static_cast<int>( rng.randExc() * width );
+          v[i].key = std::min( k, n_buckets - 1 );
+        } else
+          v[i].key = static_cast<int>( rng.randExc() * n_buckets );
+      }
+    } else if ( dist == "sorted" ) {
+      for ( int i = 0; i < n; ++i )
+        v[i].key = static_cast<int>(
+          ( static_cast<long long>(i) * n_buckets ) / n
+        );
+    } else
+      return false;
+    return true;
+  }
+
+  template < unsigned int bytes >
+  bool run( const Config & cfg, const int & n, const int & n_buckets,
+            const std::string & dist, const int & n_threads, Result & r ) {
+    typedef Item<bytes> I;
+
+    std::vector<I> input( n );
+    if ( !makeKeys( input, n_buckets, dist ) )
+      return false;
+    std::vector<I> work( n );
+
+    xylose::nsort::NSort< KeyMap > ns( n_buckets );
+    xylose::nsort::PNSort< KeyMap > ps( n_buckets, n_threads );
+    if ( n_threads > 1 )
+      xylose::pthreadCache.set_max_threads( n_threads );
+
+    xylose::Timer timer;
+    r.seconds = -1;
+    for ( int rep = 0; rep < cfg.reps; ++rep ) {
+      std::copy( input.begin(), input.end(), work.begin() );
+      timer.start();
+      if ( n_threads > 1 )
+        ps.sort( work.begin(), work.end() );
+      else
+        ns.sort( work.begin(), work.end() );
+      timer.stop();
+      if ( r.seconds < 0 || timer.dt < r.seconds )
+        r.seconds = timer.dt;
+    }
+
+    r.sorted = true;
+    for ( int i = 1; i < n; ++i )
+      r.sorted = r.sorted && work[i-1].key <= work[i].key;
+
+    std::ostringstream id;
+    id << "n=" << n << "/buckets=" << n_buckets << "/bytes=" << bytes
+       << "/dist=" << dist << "/threads=" << n_threads;
+    r.id = id.str();
+    r.n = n;
+    r.buckets = n_buckets;
+    r.bytes = bytes;
+    r.dist = dist;
+    r.threads = n_threads;
+    return true;
+  }
+
+  bool runSize( const Config & cfg, const int & n, const int & n_buckets,
+                const int & bytes, const std::string & dist,
+                const int & n_threads, Result & r ) {
+    switch ( bytes ) {
+      case  16: return run< 16>( cfg, n, n_buckets, dist, n_threads, r );
+      case  32: return run< 32>( cfg, n, n_buckets, dist, n_threads, r );
+      case  64: return run< 64>( cfg, n, n_buckets, dist, n_threads, r );
+      case 128: return run<128>( cfg, n, n_buckets, dist, n_threads, r );
+      case 256: return run<256>( cfg, n, n_buckets, dist, n_threads, r );
+      default:  return false;
+    }
+  }
+
+  void writeJSON( std::ostream & out, const Config & cfg,
+                  const std::vector<Result> & results ) {
+    out << "{\n"
+           "  \"benchmark\": \"nsort_bench\",\n"
+           "  \"reps\": " << cfg.reps << ",\n"
+           "  \"results\": [\n";
+    for ( unsigned int i = 0u; i < results.size(); ++i ) {
+      const Result & r = results[i];
+      out << "    { \"id\": \"" << r.id << "\", "
+             "\"n\": " << r.n << ", "
+             "\"buckets\": " << r.buckets << ", "
+             "\"bytes\": " << r.bytes << ", "
+             "\"dist\": \"" << r.dist << "\", "
+             "\"threads\": " << r.threads << ", "
+             "\"seconds\": " << r.seconds << ", "
+             "\"ns_per_item\": " << r.ns_per_item() << ", "
+             "\"sorted\": " << ( r.sorted ? "true" : "false" ) << " }"
+          << ( i + 1u < results.size() ? ",\n" : "\n" );
+    }
+    out << "  ]\n}\n";
+  }
+
+  /** Value of "key": in line (the output of writeJSON has one result per
+   * line). */
+  bool findField( const std::string & line, const std::string & key,
+                  std::string & value ) {
+    const std::string k = "\"" + key + "\": ";
+    std::string::size_type b = line.find( k );
+    if ( b == std::string::npos )
+      return false;
+    b += k.size();
+    if ( line[b] == '"' ) {
+      const std::string::size_type e = line.find( '"', b + 1 );
+      value = line.substr( b + 1, e - b - 1 );
+    } else {
+      const std::string::size_type e = line.find_first_of( ", }", b );
+      value = line.substr( b, e - b );
+    }
+    return true;
+  }
+
+  /** Read the seconds of each case of a baseline file by id. */
+  bool readBaseline( const std::string & file,
+                     std::map<std::string,double> & base ) {
+    std::ifstream in( file.c_str() );
+    if ( !in )
+      return false;
+    std::string line, id, sec;
+    while ( std::getline( in, line ) )
+      if ( findField( line, "id", id ) && findField( line, "seconds", sec ) )
+        base[id] = std::atof( sec.c_str() );
+    return true;
+  }
+
+  /** Compare results to the baseline.
+   * @return the number of regressions. */
+  int compare( const Config & cfg, const std::vector<Result> & results ) {
+    std::map<std::string,double> base;
+    if ( !readBaseline( cfg.baseline, base ) ) {
+      std::cerr << "nsort_bench: cannot read baseline " << cfg.baseline
+                << std::endl;
+      return 1;
+    }
+
+    int n_compared = 0, n_regressions = 0;
+    for ( unsigned int i = 0u; i < results.size(); ++i ) {
+      const Result & r = results[i];
+      std::map<std::string,double>::const_iterator b = base.find( r.id );
+      if ( b == base.end() || b->second < cfg.min_time )
+        continue;
+
+      ++n_compared;
+      const double ratio = r.seconds / b->second;
+      if ( ratio > 1.0 + cfg.tolerance ) {
+        ++n_regressions;
+        std::cerr << "REGRESSION " << r.id << ": " << r.seconds << "s vs "
+                  << b->second << "s (x" << ratio << ")\n";
+      }
+    }
+
+    std::cerr << "nsort_bench: " << n_compared << " cases compared to "
+              << cfg.baseline << ", " << n_regressions << " regressions"
+              << std::endl;
+    return n_regressions;
+  }
+
+}
+
+int main( int argc, char ** argv ) {
+  Config cfg;
+
+  for ( int i = 1; i < argc; ++i ) {
+    const std::string a = argv[i];
+    const bool has_value = i + 1 < argc;
+    if      ( a == "--quick" )                 cfg.quick();
+    else if ( a == "--n"         && has_value ) cfg.ns = parseList<double>( argv[++i] );
+    else if ( a == "--buckets"   && has_value ) cfg.buckets = parseList<int>( argv[++i] );
+    else if ( a == "--sizes"     && has_value ) cfg.sizes = parseList<int>( argv[++i] );
+    else if ( a == "--dists"     && has_value ) cfg.dists = parseNames( argv[++i] );
+    else if ( a == "--threads"   && has_value ) cfg.threads = parseList<int>( argv[++i] );
+    else if ( a == "--reps"      && has_value ) cfg.setReps( std::atoi( argv[++i] ) );
+    else if ( a == "--max-bytes" && has_value ) cfg.max_bytes = std::atof( argv[++i] );
+    else if ( a == "--output"    && has_value ) cfg.output = argv[++i];
+    else if ( a == "--baseline"  && has_value ) cfg.baseline = argv[++i];
+    else if ( a == "--tolerance" && has_value ) cfg.tolerance = std::atof( argv[++i] );
+    else if ( a == "--min-time"  && has_value ) cfg.min_time = std::atof( argv[++i] );
+    else {
+      std::cerr << "nsort_bench: unknown option " << a
+                << " (see the documentation in nsortBench.cpp)" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<Result> results;
+  bool all_sorted = true;
+  for ( unsigned int in = 0u; in < cfg.ns.size(); ++in )
+  for ( unsigned int ib = 0u; ib < cfg.buckets.size(); ++ib )
+  for ( unsigned int is = 0u; is < cfg.sizes.size(); ++is )
+  for ( unsigned int id = 0u; id < cfg.dists.size(); ++id )
+  for ( unsigned int it = 0u; it < cfg.threads.size(); ++it ) {
+    const int n = static_cast<int>( cfg.ns[in] );
+    if ( 2.0 * n * cfg.sizes[is] > cfg.max_bytes ) {
+      std::cerr << "skipping n=" << n << " bytes=" << cfg.sizes[is]
+                << " (--max-bytes)\n";
+      continue;
+    }
+
+    Result r;
+    if ( !runSize( cfg, n, cfg.buckets[ib], cfg.sizes[is], cfg.dists[id],
+                   cfg.threads[it], r ) ) {
+      std::cerr << "nsort_bench: unsupported size " << cfg.sizes[is]
+                << " or distribution " << cfg.dists[id] << std::endl;
+      return EXIT_FAILURE;
+    }
+    all_sorted = all_sorted && r.sorted;
+    results.push_back( r );
+    std::cerr << r.id << '\t' << r.ns_per_item() << " ns/item\n";
+  }
+
+  if ( cfg.output.empty() )
+    writeJSON( std::cout, cfg, results );
+  else {
+    std::ofstream out( cfg.output.c_str() );
+    writeJSON( out, cfg, results );
+  }
+
+  if ( !all_sorted ) {
+    std::cerr << "nsort_bench: some cases were not sorted correctly"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( !cfg.baseline.empty() && compare( cfg, results ) > 0 )
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/** \file
+ * Scaling benchmark of the multi-threaded xylose::nsort::PNSort class.  The
+ * same set of particles is sorted onto a uniform three dimensional grid using
+ * 1, 2, 4, ..., 64 threads.  The serial NSort::sort, NSort::cached_sort and
+ * NSort::stable_sort_copy are timed for reference.
+ *
+ * Usage:  timePNSort [N [max_threads]]
+ */
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/nsort/PNSort.h>
+#include <xylose/nsort/map/uniform_grid.h>
+#include <xylose/random/Kiss.hpp>
+#include <xylose/Dimensions.hpp>
+#include <xylose/Vector.h>
+#include <xylose/Timer.h>
+
+#include <iostream>
+#include <vector>
+
+#include <cstdlib>
+
+namespace {
+  using xylose::Vector;
+  using xylose::V3;
+
+  struct Particle {
+    Vector<double,3u> x;
+    Vector<double,3u> v;
+    int species;
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  struct Grid {
+    Vector<double,3u> m_x0, m_dx;
+    Vector<unsigned int,3u> N;
+
+    Grid() : m_x0(-50.0), m_dx(100.0/64.0), N(64u) { }
+
+    const Vector<double,3u> & x0() const { return m_x0; }
+    const Vector<double,3u> & dx() const { return m_dx; }
+    const Vector<unsigned int,3u> & size() const { return N; }
+  };
+
+  void initPVector( std::vector<Particle> & pv, const int & n ) {
+    xylose::random::Kiss rng;
+    pv.resize(n);
+    for ( int i = 0; i < n; ++i ) {
+      pv[i].x = V3( 100.0*rng.rand() - 50.0,
+                    100.0*rng.rand() - 50.0,
+                    100.0*rng.rand() - 50.0 );
+      pv[i].v = 0.0;
+      pv[i].species = 0;
+    }
+  }
+}
+
+int main( int argc, char ** argv ) {
+  using xylose::Dimensions;
+  using xylose::nsort::NSort;
+  using xylose::nsort::PNSort;
+  typedef xylose::nsort::map::uniform_grid< Grid, Dimensions<0,1,2> > map_t;
+
+  const int N           = argc > 1 ? std::atoi( argv[1] ) : 10000000;
+  const int max_threads = argc > 2 ? std::atoi( argv[2] ) : 64;
+  const int n_repeat    = 5;
+
+  Grid grid;
+  map_t map( grid );
+  std::vector<Particle> pv;
+  xylose::Timer timer( xylose::Timer::AVERAGED );
+
+  std::cout << "# N = " << N << ", n_values = " << map.getNumberValues()
+            << "\n# threads\twall(s)\tcpu(s)\tspeedup\n";
+
+  NSort< map_t > ns( map.getNumberValues() );
+  timer.zero();
+  for ( int r = 0; r < n_repeat; ++r ) {
+    initPVector( pv, N );
+    timer.start();
+    ns.sort( pv.begin(), pv.end(), map );
+    timer.stop();
+  }
+  const double serial = timer.dt;
+  std::cout << "serial\t" << timer.dt << '\t' << timer.dt_cpu_time
+            << "\t1" << std::endl;
+
+  timer.zero();
+  for ( int r = 0; r < n_repeat; ++r ) {
+    initPVector( pv, N );
+    timer.start();
+    ns.cached_sort( pv.begin(), pv.end(), map );
+    timer.stop();
+  }
+  std::cout << "cached\t" << timer.dt << '\t' << timer.dt_cpu_time
+            << '\t' << ( serial / timer.dt ) << std::endl;
+
+  {
+    std::vector<Particle> dest( N );
+    timer.zero();
+    for ( int r = 0; r < n_repeat; ++r ) {
+      initPVector( pv, N );
+      timer.start();
+      ns.stable_sort_copy( pv.begin(), pv.end(), dest.begin(), map );
+      timer.stop();
+    }
+    std::cout << "stable\t" << timer.dt << '\t' << timer.dt_cpu_time
+              << '\t' << ( serial / timer.dt ) << std::endl;
+  }
+
+  for ( int nt = 1; nt <= max_threads; nt *= 2 ) {
+    xylose::pthreadCache.set_max_threads( nt );
+    PNSort< map_t > ps( map.getNumberValues(), nt );
+
+    timer.zero();
+    for ( int r = 0; r < n_repeat; ++r ) {
+      initPVector( pv, N );
+      timer.start();
+      ps.sort( pv.begin(), pv.end(), map );
+      timer.stop();
+    }
+
+    std::cout << nt << '\t' << timer.dt << '\t' << timer.dt_cpu_time
+              << '\t' << ( serial / timer.dt ) << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
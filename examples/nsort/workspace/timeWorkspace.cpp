@@ -0,0 +1,104 @@
+/** \file
+ * Microbenchmark of the workspace reuse of xylose::nsort::NSort.  Several
+ * small groups of particles (e.g. one per species) are sorted onto a uniform
+ * grid once per "timestep".  The same sorts are timed with an NSort instance
+ * that is constructed for each group (as was needed before NSort owned a
+ * reusable workspace) and with a single instance that is reused for all
+ * groups, for which no heap allocation happens in steady state.
+ *
+ * Usage:  timeWorkspace [n_groups [n_steps]]
+ */
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/nsort/map/uniform_grid.h>
+#include <xylose/random/Kiss.hpp>
+#include <xylose/Dimensions.hpp>
+#include <xylose/Vector.h>
+#include <xylose/Timer.h>
+
+#include <iostream>
+#include <vector>
+
+#include <cstdlib>
+
+namespace {
+  using xylose::Vector;
+  using xylose::V3;
+
+  struct Particle {
+    Vector<double,3u> x;
+    Vector<double,3u> v;
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  struct Grid {
+    Vector<double,3u> m_x0, m_dx;
+    Vector<unsigned int,3u> N;
+
+    Grid() : m_x0(0.0), m_dx(1.0/16.0), N(16u) { }
+
+    const Vector<double,3u> & x0() const { return m_x0; }
+    const Vector<double,3u> & dx() const { return m_dx; }
+    const Vector<unsigned int,3u> & size() const { return N; }
+  };
+
+  void initGroups( std::vector< std::vector<Particle> > & groups,
+                   const int & n ) {
+    xylose::random::Kiss rng;
+    for ( unsigned int g = 0u; g < groups.size(); ++g ) {
+      groups[g].resize( n );
+      for ( int i = 0; i < n; ++i )
+        groups[g][i].x = V3( rng.rand(), rng.rand(), rng.rand() );
+    }
+  }
+}
+
+int main( int argc, char ** argv ) {
+  using xylose::Dimensions;
+  using xylose::nsort::NSort;
+  typedef xylose::nsort::map::uniform_grid< Grid, Dimensions<0,1,2> > map_t;
+
+  const int n_groups = argc > 1 ? std::atoi( argv[1] ) : 8;
+  const int n_steps  = argc > 2 ? std::atoi( argv[2] ) : 2000;
+
+  Grid grid;
+  map_t map( grid );
+  std::vector< std::vector<Particle> > groups( n_groups );
+  xylose::Timer timer;
+
+  std::cout << "# n_groups = " << n_groups
+            << ", n_values = " << map.getNumberValues()
+            << "\n# N/group\tfresh(ns/item)\treused(ns/item)\tspeedup\n";
+
+  for ( int n = 16; n <= 16384; n *= 4 ) {
+    initGroups( groups, n );
+    const double n_items = double(n) * n_groups * n_steps;
+
+    timer.start();
+    for ( int s = 0; s < n_steps; ++s )
+      for ( int g = 0; g < n_groups; ++g ) {
+        NSort< map_t > ns( map.getNumberValues() );
+        ns.cached_sort( groups[g].begin(), groups[g].end(), map );
+      }
+    timer.stop();
+    const double fresh = timer.dt;
+
+    NSort< map_t > ns( map.getNumberValues() );
+    ns.reserve( n );
+    timer.start();
+    for ( int s = 0; s < n_steps; ++s )
+      for ( int g = 0; g < n_groups; ++g )
+        ns.cached_sort( groups[g].begin(), groups[g].end(), map );
+    timer.stop();
+    const double reused = timer.dt;
+
+    std::cout << n << '\t' << ( fresh  / n_items * 1e9 )
+                   << '\t' << ( reused / n_items * 1e9 )
+                   << '\t' << ( fresh / reused ) << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -50,12 +50,18 @@
 
 #include <xylose/logger.h>
 #include <xylose/strutil.h>
+#include <xylose/detail/atomic.h>
+#include <xylose/detail/WorkStealingDeque.h>
+#include <xylose/detail/affinity.h>
+#include <xylose/PThreadCacheStats.h>
 
 #include <pthread.h>
 #include <sched.h>
 #include <set>
 #include <queue>
+#include <vector>
 #include <string>
+#include <iterator>
 #include <algorithm>
 #include <stdexcept>
 
@@ -63,55 +69,300 @@
 
 namespace xylose {
 
+  class PThreadTask;
+  class PThreadCache;
+  static PThreadCache & defaultPThreadCache();
+
+  /** A completion latch for a group of tasks.  Tasks added through a group
+   * notify only that group when they finish (in O(1), under the group's own
+   * mutex), so that each owner waits only for its own tasks and is only
+   * woken by them:
+   * <pre>
+   *    PThreadTaskGroup group;
+   *    for ( ... )
+   *      group.add( new MyTask(...) );
+   *
+   *    PThreadTask * t;
+   *    while ( ( t = group.waitAny() ) != NULL ) {
+   *      ... use the results of t ...
+   *      delete t;
+   *    }
+   * </pre>
+   * or simply group.wait() to wait for all of them.  The group does not own
+   * the tasks.  When called by a worker of the cache, wait() and waitAny()
+   * execute other queued tasks instead of blocking the worker.
+   */
+  class PThreadTaskGroup {
+    /* MEMBER STORAGE */
+  private:
+    PThreadCache & cache;
+    int n_outstanding;    /**< atomic number of added, unfinished tasks. */
+    int n_waiting;        /**< protected by mutex. */
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    std::vector<PThreadTask *> finished; /**< protected by mutex. */
+
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Constructor.
+     * @param cache
+     *    Specify the cache instance to use [default xylose::pthreadCache].
+     */
+    inline PThreadTaskGroup( PThreadCache & cache = defaultPThreadCache() );
+
+    /** Destructor waits for the outstanding tasks. */
+    ~PThreadTaskGroup() {
+      wait();
+      pthread_mutex_destroy(&mutex);
+      pthread_cond_destroy(&cond);
+    }
+
+    /** Queue a task on the cache as a member of this group.
+     * @param self_if_none_avail
+     *   Whether to perform the work by self if no threads are currently
+     *   available [Default false].
+     */
+    inline void add( PThreadTask * task, bool self_if_none_avail = false );
+
+    /** Queue a range of tasks at once as members of this group (see
+     * PThreadCache::addTasks).
+     * @param first
+     *   Beginning of a (forward iterator) range of PThreadTask pointers.
+     * @param last
+     *   End of the range.
+     */
+    template < typename Iter >
+    inline void addTasks( const Iter & first, const Iter & last );
+
+    /** Number of added tasks that have not finished yet. */
+    int outstanding() const {
+      return detail::atomic::load( &n_outstanding );
+    }
+
+    /** Wait for all added tasks to finish.  The finished tasks that were not
+     * yet returned by waitAny() are forgotten (the caller still owns
+     * them). */
+    inline void wait();
+
+    /** Wait for any added task to finish that was not returned yet.
+     * @return the finished task, or NULL if all tasks have been returned.
+     */
+    inline PThreadTask * waitAny();
+
+    /** Record the completion of a task (called by the cache). */
+    void finish( PThreadTask * task ) {
+      pthread_mutex_lock(&mutex);
+      finished.push_back( task );
+      detail::atomic::sub( &n_outstanding, 1 );
+      if ( n_waiting > 0 )
+        pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+    }
+
+  private:
+    /** Copying is not allowed. */
+    PThreadTaskGroup( const PThreadTaskGroup & );
+    PThreadTaskGroup & operator= ( const PThreadTaskGroup & );
+  };
+
   /** The basic pthread task structure.  Inheriting classes must implement the
    * exec() function. */
   class PThreadTask {
     public:
-      PThreadTask() {}
+      PThreadTask() : group(NULL), queued_ns(0) {}
       virtual ~PThreadTask() {}
       virtual void exec() = 0;
+
+      /** The group to notify when the task finishes (set by
+       * PThreadTaskGroup::add, cleared by PThreadCache::addTask).  Tasks
+       * without a group are reported through PThreadCache::waitForTasks. */
+      PThreadTaskGroup * group;
+
+      /** Time of the submission (only recorded with USE_PTHREAD_STATS). */
+      long long queued_ns;
   };
 
   /** A set of pointers to tasks. */
   typedef std::set<PThreadTask *> PThreadTaskSet;
 
-  /** A PThreads threads cache and associated tasks manager. */
+  /** A PThreads threads cache and associated tasks manager.
+   *
+   * Tasks are scheduled by work stealing:  each worker thread owns a
+   * Chase-Lev deque (detail::WorkStealingDeque).  A task that is added from
+   * within a task (i.e. by a worker of this cache) is pushed onto the
+   * worker's own deque without taking any lock, and the worker pops its own
+   * tasks in LIFO order.  Tasks added by any other thread go into a shared
+   * injection queue.  A worker that runs out of tasks looks in the
+   * injection queue and then tries to steal (FIFO) from randomly chosen
+   * victims.  After a number of unsuccessful rounds (yielding the cpu in
+   * between) it parks on a condition variable; a submission only touches
+   * the condition variable when some worker is parked.
+   *
+   * A worker that calls waitForTasks() executes other tasks while its own
+   * are not finished, so that tasks can safely wait for the tasks they add.
+   *
+   * If USE_PTHREAD_STATS is defined, the cache records per-worker busy and
+   * idle times, steals and parks, the queue depth and histograms of the
+   * task wait and execution times (see get_stats).  Without it, the
+   * recording is compiled out.
+   *
+   * Workers can be pinned to cpus (see set_affinity).  The initial policy is
+   * taken from the environment variable PTHREAD_AFFINITY, which may be
+   * "none" (the default), "compact", "scatter" or an explicit cpu list such
+   * as "0-7,16-23".
+   */
   class PThreadCache {
+    /* TYPEDEFS */
+  private:
+    /** Per-thread state of each worker. */
+    struct Worker {
+      PThreadCache * cache;
+      int index;
+      unsigned int seed; /**< state of the random victim selection. */
+      detail::WorkStealingDeque<PThreadTask *> deque;
+      detail::PThreadWorkerCounters stats;
+
+      Worker( PThreadCache * cache, const int & index )
+        : cache(cache), index(index), seed( 2654435761u * (index + 1) ) { }
+
+      /** Random number (xorshift) for the choice of victims. */
+      unsigned int random() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+      }
+    };
+
+
+  public:
+    /** Placement of the worker threads on the cpus. */
+    enum AffinityPolicy {
+      /** Leave the placement to the operating system. */
+      AFFINITY_NONE,
+      /** Consecutive workers on neighboring hardware threads, filling the
+       * cores, packages and NUMA nodes one after the other. */
+      AFFINITY_COMPACT,
+      /** Consecutive workers round-robin over the packages/NUMA nodes, using
+       * separate cores before sharing them. */
+      AFFINITY_SCATTER,
+      /** Worker k on the k-th cpu of an explicit list. */
+      AFFINITY_LIST
+    };
+
+
+    /* STATIC STORAGE */
+  public:
+    /** Number of unsuccessful rounds through all queues (yielding the cpu
+     * after each) before an idle worker parks. */
+    static const int spin_rounds = 16;
+
+
     /* MEMBER STORAGE */
   private:
     int max_threads;    /**< protected by max_threads_spinlock*/
-    int total_threads;  /**< protected by total_threads_spinlock*/
-    int active_threads; /**< protected by max_threads_spinlock (yes, same one)*/
+    int total_threads;  /**< atomic */
+    int active_threads; /**< atomic */
     const bool create_threads_on_demand; /**< whether to create threads on
                                               demand ( up to max_threads ). */
 
     pthread_attr_t  pthread_attr; /**< protected by max_threads_spinlock */
-    pthread_mutex_t task_queue_mutex; /* mutex to protect the queue items. */
-    pthread_cond_t  task_ready_cond;  /* condition for task queue additions. */
+    AffinityPolicy affinity_policy; /**< protected by max_threads_spinlock */
+    /** cpu of worker k is placement[k % size] (empty for AFFINITY_NONE);
+     * protected by max_threads_spinlock. */
+    std::vector<int> placement;
+    /** The usable cpus (only read once a policy is set). */
+    std::vector<detail::affinity::Cpu> cpus;
+    pthread_mutex_t task_queue_mutex; /* mutex to protect the injection queue
+                                         and the parking of workers. */
+    pthread_cond_t  task_ready_cond;  /* condition for parked workers. */
     pthread_cond_t  task_finished_cond;
     pthread_mutex_t task_finished_mutex;/* mutex to protect the finished set. */
     pthread_spinlock_t max_threads_spinlock;/* mutex to protect max_threads. */
-    pthread_spinlock_t total_threads_spinlock;/* mutex to protect total_threads. */
 
     pthread_t ** threads; /* thread id of each live thread */
+    Worker ** workers;    /* state of each thread (live or not) */
 
-
-    std::queue<PThreadTask *> task_queue; /* a linked list of tasks to do. */
+    std::queue<PThreadTask *> task_queue; /* tasks added by non-workers. */
+    int n_injected;       /**< atomic size of task_queue. */
+    int n_pending;        /**< atomic number of tasks queued, not started. */
+    int n_parked;         /**< atomic number of parked workers. */
+    int wake_tokens;      /**< protected by task_queue_mutex. */
     PThreadTaskSet finished_tasks; /* a linked list of finished tasks. */
 
-    bool slavesQuit;
+    bool slavesQuit;      /**< atomic */
+
+    /* statistics (only recorded with USE_PTHREAD_STATS). */
+    long long stats_start_ns;     /**< protected by stats_mutex */
+    long long next_sample_ns;     /**< atomic */
+    long long sample_interval_ns; /**< atomic */
+    int max_queue_depth;          /**< atomic */
+    std::vector< std::pair<double,int> > depth_samples; /**< stats_mutex */
+    detail::PThreadWorkerCounters retired; /**< max_threads_spinlock */
+    pthread_mutex_t stats_mutex;
 
 
 
     /* MEMBER FUNCTIONS */
   private:
+    /** The worker that the calling thread is (NULL for other threads). */
+    static Worker *& currentWorker() {
+      static __thread Worker * w = NULL;
+      return w;
+    }
+
+    /** The worker of this cache that the calling thread is (or NULL). */
+    Worker * thisWorker() const {
+      Worker * w = currentWorker();
+      return ( w != NULL && w->cache == this ) ? w : NULL;
+    }
+
+    /** Maximum number of queue depth samples; when they are full, every
+     * other sample is dropped and the sampling interval doubled. */
+    static const unsigned int max_depth_samples = 4096u;
+
+    /** Record the submission time of a task. */
+    void statsQueued( PThreadTask * task ) {
+#ifdef USE_PTHREAD_STATS
+      task->queued_ns = detail::nowNs();
+#endif
+    }
+
+    /** Sample the number of queued tasks after a submission. */
+    void statsDepth( const int & depth ) {
+#ifdef USE_PTHREAD_STATS
+      int mx = detail::atomic::load( &max_queue_depth, detail::atomic::relaxed );
+      while ( depth > mx && !detail::atomic::cas( &max_queue_depth, mx, depth ) );
+
+      const long long now = detail::nowNs();
+      long long next = detail::atomic::load( &next_sample_ns,
+                                             detail::atomic::relaxed );
+      if ( now < next ||
+           !detail::atomic::cas( &next_sample_ns, next,
+                                 now + detail::atomic::load(&sample_interval_ns) ) )
+        return;
+
+      pthread_mutex_lock(&stats_mutex);
+      if ( depth_samples.size() >= max_depth_samples ) {
+        for ( unsigned int i = 0; 2*i < depth_samples.size(); ++i )
+          depth_samples[i] = depth_samples[2*i];
+        depth_samples.resize( depth_samples.size() / 2 );
+        detail::atomic::store( &sample_interval_ns,
+                               2 * detail::atomic::load(&sample_interval_ns) );
+      }
+      depth_samples.push_back(
+        std::make_pair( (now - stats_start_ns) * 1e-9, depth ) );
+      pthread_mutex_unlock(&stats_mutex);
+#endif
+    }
+
     inline void signalSlavesQuit() {
-      /* We'll use the task_queue_mutex, just because each slave will exit the
-       * cond_wait() holding this mutex.  So, if we already hold it,
-       * they can't read the quit variable. */
+      /* We'll use the task_queue_mutex, just because each parked slave will
+       * exit the cond_wait() holding this mutex. */
       pthread_mutex_lock(&task_queue_mutex);
 
-      slavesQuit = true;
+      detail::atomic::store( &slavesQuit, true );
       /* now send the message to all slaves. */
       pthread_cond_broadcast(&task_ready_cond);
 
@@ -120,27 +371,144 @@ namespace xylose {
 
     inline void resetSlavesQuit() {
       pthread_mutex_lock(&task_queue_mutex);
-      slavesQuit = false;
+      detail::atomic::store( &slavesQuit, false );
       pthread_mutex_unlock(&task_queue_mutex);
     }
 
+    /** Look for a task once:  own deque, injection queue, then a few random
+     * victims (or all other workers if exhaustive). */
+    PThreadTask * findTask( Worker & w, const bool & exhaustive = false ) {
+      PThreadTask * task = w.deque.pop();
+      if ( task )
+        return task;
+
+      if ( detail::atomic::load( &n_injected ) > 0 ) {
+        pthread_mutex_lock(&task_queue_mutex);
+        if ( !task_queue.empty() ) {
+          task = task_queue.front();
+          task_queue.pop();
+          detail::atomic::sub( &n_injected, 1 );
+        }
+        pthread_mutex_unlock(&task_queue_mutex);
+        if ( task ) {
+#ifdef USE_PTHREAD_STATS
+          ++w.stats.n_injected;
+#endif
+          return task;
+        }
+      }
 
-    inline PThreadTask * getTask() {
-      PThreadTask * task = NULL;
-      pthread_mutex_lock(&task_queue_mutex);
+      const int n = max_threads;
+      if ( exhaustive ) {
+        for ( int v = 0; v < n; ++v )
+          if ( v != w.index && ( task = workers[v]->deque.steal() ) != NULL )
+            break;
+      } else {
+        for ( int k = 0; k < 2 * n; ++k ) {
+          const int v = static_cast<int>( w.random() % n );
+          if ( v != w.index && ( task = workers[v]->deque.steal() ) != NULL )
+            break;
+        }
+      }
 
-      while (!slavesQuit) {
-        task = task_queue.empty() ? NULL : task_queue.front();
-        if (task == NULL){
-          pthread_cond_wait(&task_ready_cond, &task_queue_mutex);
-        } else {
-          task_queue.pop();
-          break;
+#ifdef USE_PTHREAD_STATS
+      if ( task )
+        ++w.stats.n_steals;
+#endif
+      return task;
+    }
+
+    /** Get the next task for worker w:  search for a while and then park
+     * until a task is added.
+     * @return NULL if the workers should quit.
+     */
+    inline PThreadTask * getTask( Worker & w ) {
+      while ( !detail::atomic::load( &slavesQuit, detail::atomic::relaxed ) ) {
+        for ( int r = 0; r < spin_rounds; ++r ) {
+          PThreadTask * task = findTask( w );
+          if ( task )
+            return task;
+          sched_yield();
+        }
+
+        /* announce the parking before the last look such that a concurrent
+         * submission either is seen here or sees n_parked > 0. */
+        detail::atomic::add( &n_parked, 1 );
+        PThreadTask * task = findTask( w, true );
+        if ( task ) {
+          detail::atomic::sub( &n_parked, 1 );
+          return task;
         }
+
+#ifdef USE_PTHREAD_STATS
+        ++w.stats.n_parks;
+#endif
+        pthread_mutex_lock(&task_queue_mutex);
+        while ( !slavesQuit && task_queue.empty() && wake_tokens == 0 )
+          pthread_cond_wait(&task_ready_cond, &task_queue_mutex);
+        if ( wake_tokens > 0 )
+          --wake_tokens;
+        pthread_mutex_unlock(&task_queue_mutex);
+
+        detail::atomic::sub( &n_parked, 1 );
       }
 
+      return NULL;
+    }
+
+    /** Wake up to n parked workers (if any) for tasks pushed onto a deque. */
+    void wakeWorkers( const int & n = 1 ) {
+      detail::atomic::fence();
+      if ( detail::atomic::load( &n_parked ) == 0 )
+        return;
+
+      pthread_mutex_lock(&task_queue_mutex);
+      const int parked = detail::atomic::load( &n_parked );
+      const int wake = std::min( n, parked - wake_tokens );
+      if ( wake > 0 )
+        wake_tokens += wake;
+      signalParked( std::max( wake, 1 ) );
       pthread_mutex_unlock(&task_queue_mutex);
-      return task;
+    }
+
+    /** Signal n parked workers; called with task_queue_mutex held. */
+    void signalParked( const int & n ) {
+      if ( n >= detail::atomic::load( &n_parked ) )
+        pthread_cond_broadcast(&task_ready_cond);
+      else
+        for ( int i = 0; i < n; ++i )
+          pthread_cond_signal(&task_ready_cond);
+    }
+
+    /** Execute a task that worker w took from one of the queues. */
+    void runTask( Worker & w, PThreadTask * task ) {
+      detail::atomic::sub( &n_pending, 1 );
+#ifdef USE_PTHREAD_STATS
+      const long long start = detail::nowNs();
+      w.stats.wait_time.add( start - task->queued_ns );
+      ++w.stats.depth;
+#endif
+      detail::atomic::add( &active_threads, 1 );  /* inc active    */
+      task->exec();                               /* execute task. */
+      detail::atomic::sub( &active_threads, 1 );  /* dec active    */
+#ifdef USE_PTHREAD_STATS
+      const long long run = detail::nowNs() - start;
+      w.stats.run_time.add( run );
+      ++w.stats.n_tasks;
+      if ( --w.stats.depth == 0 )
+        w.stats.busy_ns += run;
+#endif
+      finishTask(task);                           /* signal finish */
+    }
+
+    /** Notify the group of the task (or the waitForTasks() callers) that the
+     * task has finished.  The task may be deleted by its owner as soon as
+     * this is done. */
+    void finishTask( PThreadTask * task ) {
+      if ( task->group )
+        task->group->finish( task );
+      else
+        signalTaskFinished( task );
     }
 
     /** Add this task to the finished tasks vector and signal the waiting
@@ -155,53 +523,30 @@ namespace xylose {
       pthread_mutex_unlock(&task_finished_mutex);
     }
 
-    /** Executes all tasks placed in the task queue. */
-    static void taskSlave(PThreadCache * cache) {
-      cache->incrementTotalThreads();    /* inc total     */
+    /** Executes the tasks of worker w (and those it can steal). */
+    static void taskSlave(Worker * w) {
+      PThreadCache * cache = w->cache;
+      detail::atomic::add( &cache->total_threads, 1 );  /* inc total     */
+      currentWorker() = w;
 
-      /* check queue, if we get NULL back, that means that we were
+      /* check queues, if we get NULL back, that means that we were
        * requested to terminate. */
       PThreadTask * task;
-      while ((task = cache->getTask()) != NULL) {
-        cache->incrementActiveThreads(); /* inc active    */
-        task->exec();                    /* execute task. */
-        cache->decrementActiveThreads(); /* dec active    */
-        cache->signalTaskFinished(task); /* signal finish */
+#ifdef USE_PTHREAD_STATS
+      long long t0 = detail::nowNs();
+      while ((task = cache->getTask(*w)) != NULL) {
+        w->stats.idle_ns += detail::nowNs() - t0;
+        cache->runTask(*w, task);
+        t0 = detail::nowNs();
       }
-
-      cache->decrementTotalThreads();    /* dec total     */
-    }
-
-    /** Increment the active threads counter--this should only ever be called by
-     * the taskSlave function. */
-    void incrementActiveThreads() {
-      pthread_spin_lock(&max_threads_spinlock);
-      ++active_threads;
-      pthread_spin_unlock(&max_threads_spinlock);
-    }
-
-    /** Decrement the active threads counter--this should only ever be called by
-     * the taskSlave function. */
-    void decrementActiveThreads() {
-      pthread_spin_lock(&max_threads_spinlock);
-      --active_threads;
-      pthread_spin_unlock(&max_threads_spinlock);
-    }
-
-    /** Decrement the active threads counter--this should only ever be called by
-     * the taskSlave function. */
-    void decrementTotalThreads() {
-      pthread_spin_lock(&total_threads_spinlock);
-      --total_threads;
-      pthread_spin_unlock(&total_threads_spinlock);
-    }
-
-    /** Increment the active threads counter--this should only ever be called by
-     * the taskSlave function. */
-    void incrementTotalThreads() {
-      pthread_spin_lock(&total_threads_spinlock);
-      ++total_threads;
-      pthread_spin_unlock(&total_threads_spinlock);
+      w->stats.idle_ns += detail::nowNs() - t0;
+#else
+      while ((task = cache->getTask(*w)) != NULL)
+        cache->runTask(*w, task);
+#endif
+
+      currentWorker() = NULL;
+      detail::atomic::sub( &cache->total_threads, 1 );  /* dec total     */
     }
 
     static bool getOnDemandOption() {
@@ -216,30 +561,111 @@ namespace xylose {
       return true;
     }
 
-    static void start_thread( pthread_t ** id,
-                              pthread_attr_t & attr,
-                              PThreadCache * c ) {
+    /** Parse the PTHREAD_AFFINITY environment variable.
+     * @return false if the variable is not set or not understood. */
+    static bool getAffinityOption( AffinityPolicy & policy,
+                                   std::vector<int> & list ) {
+      const char * affinity_cstr = getenv("PTHREAD_AFFINITY");
+      if ( !affinity_cstr )
+        return false;
+
+      const std::string s = tolower( affinity_cstr );
+      if ( s == "none" || s == "" )
+        policy = AFFINITY_NONE;
+      else if ( s == "compact" )
+        policy = AFFINITY_COMPACT;
+      else if ( s == "scatter" )
+        policy = AFFINITY_SCATTER;
+      else if ( !( list = detail::affinity::parseCpuList( s ) ).empty() )
+        policy = AFFINITY_LIST;
+      else {
+        logger::log_warning( "PThreadCache:  ignoring PTHREAD_AFFINITY=%s",
+                             affinity_cstr );
+        return false;
+      }
+
+      return true;
+    }
+
+    /** Cpu of worker k (-1 if not pinned); called with max_threads_spinlock
+     * held. */
+    int cpuOf( const int & k ) const {
+      return placement.empty() ? -1 : placement[ k % placement.size() ];
+    }
+
+    /** Apply the current placement to a live thread. */
+    void pinThread( const pthread_t & id, const int & k ) {
+      using detail::affinity::pin;
+      const int cpu = cpuOf( k );
+      if ( cpu >= 0 ) {
+        if ( !pin( id, cpu ) )
+          logger::log_warning( "PThreadCache:  could not pin thread %d to "
+                               "cpu %d", k, cpu );
+      } else if ( !cpus.empty() ) {
+        /* release a previous pinning. */
+        std::vector<int> all;
+        for ( unsigned int i = 0; i < cpus.size(); ++i )
+          all.push_back( cpus[i].id );
+        pin( id, all );
+      }
+    }
+
+    void start_thread( pthread_t ** id,
+                       pthread_attr_t & attr,
+                       Worker * w ) {
       logger::log_fine( "STARTING THREAD!!!!!" );
       if ( (*id) == NULL )
         (*id) = new pthread_t;
 
-      if ( pthread_create( *id, &attr, (void*(*)(void*))taskSlave, c ) != 0 )
+      if ( pthread_create( *id, &attr, (void*(*)(void*))taskSlave, w ) != 0 )
         throw std::runtime_error("PThreadCache:  could not start thread!");
+
+      if ( !placement.empty() )
+        pinThread( **id, w->index );
     }
 
     void waitForStartedThread( const int & tot ) {
-      bool again = true;
-      while ( again ) {
-        /* we want to make sure that the thread has at least started before we
-         * continue. */
-        pthread_spin_lock(&total_threads_spinlock);
-          if ( tot <= total_threads )
-            again = false;
-        pthread_spin_unlock(&total_threads_spinlock);
-
-        if ( again )
-          sched_yield();
-      }
+      /* we want to make sure that the thread has at least started before we
+       * continue. */
+      while ( detail::atomic::load( &total_threads ) < tot )
+        sched_yield();
+    }
+
+    /** Start another thread if threads are created on demand and all live
+     * threads are busy or have queued tasks. */
+    void startThreadOnDemand( const int & mx ) {
+      if ( !create_threads_on_demand ||
+           detail::atomic::load( &total_threads, detail::atomic::relaxed ) >= mx )
+        return;
+
+      int new_total = -1;
+      pthread_spin_lock(&max_threads_spinlock);
+        const int total = detail::atomic::load( &total_threads );
+        const int active = detail::atomic::load( &active_threads );
+        const int pending = detail::atomic::load( &n_pending );
+
+        int live = 0;
+        for ( int i = 0; i < max_threads; ++i )
+          if ( threads[i] != NULL )
+            ++live;
+
+        logger::log_finer(
+          "addTask:   max_threads:%d"
+                   ", active_threads:%d"
+                   ", total_threads:%d"
+                   ", pending tasks:%d",
+                  max_threads, active, total, pending );
+
+        /* only start a thread if the previously started ones are running. */
+        if ( live == total && total < max_threads &&
+             ( active == total || total <= pending ) ) {
+          new_total = total + 1;
+          start_thread( &threads[live], pthread_attr, workers[live] );
+        }
+      pthread_spin_unlock(&max_threads_spinlock);
+
+      if ( new_total > 0 )
+        waitForStartedThread(new_total);
     }
 
 
@@ -255,19 +681,34 @@ namespace xylose {
                      total_threads(0),
                      active_threads(0),
                      create_threads_on_demand( getOnDemandOption() ),
+                     affinity_policy( AFFINITY_NONE ),
                      threads(NULL),
+                     workers(NULL),
                      task_queue(),
-                     finished_tasks() {
+                     n_injected(0),
+                     n_pending(0),
+                     n_parked(0),
+                     wake_tokens(0),
+                     finished_tasks(),
+                     stats_start_ns( detail::nowNs() ),
+                     next_sample_ns(0),
+                     sample_interval_ns(1000000),
+                     max_queue_depth(0) {
       pthread_attr_init(&pthread_attr);
       pthread_mutex_init(&task_queue_mutex, NULL);
       pthread_mutex_init(&task_finished_mutex,NULL);
       pthread_spin_init(&max_threads_spinlock,0);
-      pthread_spin_init(&total_threads_spinlock,0);
       pthread_cond_init(&task_ready_cond, NULL);
       pthread_cond_init(&task_finished_cond, NULL);
+      pthread_mutex_init(&stats_mutex, NULL);
 
       slavesQuit = false;
 
+      AffinityPolicy policy;
+      std::vector<int> list;
+      if ( getAffinityOption( policy, list ) )
+        set_affinity( policy, list );
+
       char * max_thread_str = getenv("NUM_PTHREADS");
       int mxth = 1;
 
@@ -290,12 +731,14 @@ namespace xylose {
       pthread_mutex_destroy(&task_queue_mutex);
       pthread_mutex_destroy(&task_finished_mutex);
       pthread_spin_destroy(&max_threads_spinlock);
-      pthread_spin_destroy(&total_threads_spinlock);
       pthread_cond_destroy(&task_ready_cond);
       pthread_cond_destroy(&task_finished_cond);
+      pthread_mutex_destroy(&stats_mutex);
     }
 
-    /** Add a task to the thread cache task queue.
+    /** Add a task to the thread cache task queue.  From within a task of
+     * this cache, the task is pushed onto the calling worker's own deque;
+     * otherwise it is added to the shared injection queue.
      * @param task
      *   The task to add the the task queue.
      * @param self_if_none_avail
@@ -303,75 +746,129 @@ namespace xylose {
      *   available [Default false].
      */
     void addTask( PThreadTask * task, bool self_if_none_avail = false ) {
-      pthread_spin_lock(&total_threads_spinlock);
-      pthread_spin_lock(&max_threads_spinlock);
-        bool serial = max_threads <= 1 ||
-                      ( self_if_none_avail && 
-                        ( max_threads - active_threads ) == 0 );
-
-        logger::log_finer(
-          "addTask:   max_threads:%d"
-                   ", active_threads:%d"
-                   ", total_threads:%d"
-                   ", serial:%s"
-                   ", task_queue.size():%lu",
-                  max_threads,
-                  active_threads,
-                  total_threads,
-                  (serial ? "true":"false"),
-                  task_queue.size() );
-        bool thread_start = false;
-        int new_total = -1;
-
-        if ( !serial ) {
-          pthread_mutex_lock(&task_queue_mutex);      /* locked queue */
-
-          thread_start = create_threads_on_demand &&
-                         total_threads < max_threads &&
-                         (active_threads == total_threads ||
-                          total_threads <= static_cast<int>(task_queue.size()));
+      task->group = NULL; /* not a member of any group */
+      submitTask( task, self_if_none_avail );
+    }
 
-          if ( thread_start ) {
-            new_total = total_threads + 1;
+    /** Add a number of tasks at once.  Compared to calling addTask() for
+     * each task, the injection queue is locked only once and only as many
+     * parked workers are woken as there are new tasks.
+     * @param first
+     *   Beginning of a (forward iterator) range of PThreadTask pointers.
+     * @param last
+     *   End of the range.
+     */
+    template < typename Iter >
+    void addTasks( const Iter & first, const Iter & last ) {
+      for ( Iter i = first; i != last; ++i )
+        (*i)->group = NULL; /* not members of any group */
+      submitTasks( first, last );
+    }
 
-            /* no live thread is available for performing a task.
-             * Start by finding an empty thread id holder. */
-            int i = 0;
-            for ( ; i < max_threads; ++i ) {
-              if ( threads[i] == NULL )
-                break;
-            }
+  private:
+    friend class PThreadTaskGroup;
 
-            if ( i >= max_threads )
-              throw std::runtime_error(
-                "PThreadCache:  expected to find empty thread slot!"
-              );
+    /** Queue a task (with its group already set); see addTask(). */
+    void submitTask( PThreadTask * task, bool self_if_none_avail ) {
+      const int mx = detail::atomic::load( &max_threads, detail::atomic::relaxed );
+      const bool serial =
+        mx <= 1 ||
+        ( self_if_none_avail &&
+          ( mx - detail::atomic::load( &active_threads ) ) == 0 );
 
-            /* start the thread. */
-            start_thread( &threads[i], pthread_attr, this );
-          }
+      if ( serial ) {
+        task->exec();
+        finishTask(task);
+        return;
+      }
 
-          task_queue.push(task);
-          /* now we should probably signal some thread that there is a task
-           * ready for execution. */
+      statsQueued( task );
+      statsDepth( detail::atomic::add( &n_pending, 1 ) );
+
+      Worker * w = thisWorker();
+      if ( w ) {
+        w->deque.push( task );
+        wakeWorkers();
+      } else {
+        pthread_mutex_lock(&task_queue_mutex);      /* locked queue */
+        task_queue.push(task);
+        detail::atomic::add( &n_injected, 1 );
+        if ( detail::atomic::load( &n_parked ) > 0 )
           pthread_cond_signal(&task_ready_cond);
+        pthread_mutex_unlock(&task_queue_mutex);    /* unlocked queue */
+      }
 
-          pthread_mutex_unlock(&task_queue_mutex);    /* unlocked queue */
-        }
-      pthread_spin_unlock(&max_threads_spinlock);
-      pthread_spin_unlock(&total_threads_spinlock);
+      startThreadOnDemand( mx );
+    }
 
-      if ( thread_start )
-        waitForStartedThread(new_total);
+    /** Queue a range of tasks (with their groups already set); see
+     * addTasks(). */
+    template < typename Iter >
+    void submitTasks( Iter first, const Iter & last ) {
+      const int mx = detail::atomic::load( &max_threads, detail::atomic::relaxed );
+      if ( mx <= 1 ) {
+        for ( ; first != last; ++first ) {
+          (*first)->exec();
+          finishTask( *first );
+        }
+        return;
+      }
 
-      if ( serial ) {
-        task->exec();
-        signalTaskFinished(task);
+      const int n = static_cast<int>( std::distance( first, last ) );
+      if ( n == 0 )
+        return;
+
+#ifdef USE_PTHREAD_STATS
+      for ( Iter i = first; i != last; ++i )
+        statsQueued( *i );
+#endif
+      statsDepth( detail::atomic::add( &n_pending, n ) );
+      Worker * w = thisWorker();
+      if ( w ) {
+        for ( ; first != last; ++first )
+          w->deque.push( *first );
+        wakeWorkers( n );
+      } else {
+        pthread_mutex_lock(&task_queue_mutex);      /* locked queue */
+        for ( ; first != last; ++first )
+          task_queue.push( *first );
+        detail::atomic::add( &n_injected, n );
+        if ( detail::atomic::load( &n_parked ) > 0 )
+          signalParked( n );
+        pthread_mutex_unlock(&task_queue_mutex);    /* unlocked queue */
       }
+
+      for ( int i = 0; i < n && i < mx; ++i )
+        startThreadOnDemand( mx );
+    }
+
+  public:
+    /** Whether the calling thread is a worker of this cache. */
+    bool isWorker() const { return thisWorker() != NULL; }
+
+    /** If the calling thread is a worker of this cache, execute one queued
+     * task (if any).
+     * @return false if the calling thread is not a worker of this cache.
+     */
+    bool helpOnce() {
+      Worker * w = thisWorker();
+      if ( !w )
+        return false;
+
+      PThreadTask * task = findTask( *w );
+      if ( task )
+        runTask( *w, task );
+      else
+        sched_yield();
+      return true;
     }
 
     /** This function waits for some tasks to finish, if there are any
      * executing, and then returns the particular task(s) that finished.
+     * Tasks added through a PThreadTaskGroup are not reported here; the
+     * group is the cheaper way to wait (see PThreadTaskGroup).
+     * When called from within a task of this cache, the calling worker
+     * executes other queued tasks while it waits.
      *
      * NOTE:  If the tasks in callers_tasks are not actually executing or
      * queued to execute, then this function could cause indefinite deadlock.
@@ -379,6 +876,7 @@ namespace xylose {
     inline PThreadTaskSet waitForTasks(const PThreadTaskSet & callers_tasks) {
       /* Only return once one of the callers tasks have actually completed. */
       PThreadTaskSet retval;
+      Worker * w = thisWorker();
 
       pthread_mutex_lock(&task_finished_mutex);
 
@@ -392,7 +890,13 @@ namespace xylose {
 
         if (retval.size() != 0) break;
 
-        pthread_cond_wait(&task_finished_cond, &task_finished_mutex);
+        if ( w ) {
+          /* help with the other tasks instead of blocking this worker. */
+          pthread_mutex_unlock(&task_finished_mutex);
+          helpOnce();
+          pthread_mutex_lock(&task_finished_mutex);
+        } else
+          pthread_cond_wait(&task_finished_cond, &task_finished_mutex);
       } while (true);
 
       /* We have successfully finished one of the callers tasks.  
@@ -409,7 +913,9 @@ namespace xylose {
       return retval;
     }
 
-    /** Change/Set the number of threads used to execute tasks. */
+    /** Change/Set the number of threads used to execute tasks.  Tasks that
+     * are still queued on the deques of the old threads are moved to the
+     * injection queue. */
     inline int set_max_threads(int mx) {
       pthread_spin_lock(&max_threads_spinlock);
 
@@ -429,12 +935,31 @@ namespace xylose {
 
           resetSlavesQuit();
 
+          /* keep the tasks that were not yet started (other threads may be
+           * adding to the injection queue meanwhile). */
+          pthread_mutex_lock(&task_queue_mutex);      /* locked queue */
+          for ( int i = 0; i < max_threads; ++i ) {
+            PThreadTask * task;
+            while ( ( task = workers[i]->deque.steal() ) != NULL ) {
+              task_queue.push( task );
+              detail::atomic::add( &n_injected, 1 );
+            }
+          }
+          pthread_mutex_unlock(&task_queue_mutex);    /* unlocked queue */
+
+          for ( int i = 0; i < max_threads; ++i ) {
+            retired.add( workers[i]->stats );
+            delete workers[i];
+          }
+
           /* free up the old list of thread ids. */
           delete[]threads;
+          delete[]workers;
           threads = NULL;
+          workers = NULL;
         }/* if we have to join some threads */
 
-        max_threads = mx > 1 ? mx : 1;
+        detail::atomic::store( &max_threads, mx > 1 ? mx : 1 );
 
         /* only create new threads IF more than one are requested. 
          * If there is only one thread, the tasks will be executed serially at
@@ -442,12 +967,14 @@ namespace xylose {
         if(max_threads > 1) {
           /* we are instructed to prepare for threaded processing. */
           threads = new pthread_t * [max_threads];
+          workers = new Worker * [max_threads];
+          std::fill( threads, threads + max_threads, (pthread_t*)(NULL) );
+          for ( int i = 0; i < max_threads; ++i )
+            workers[i] = new Worker( this, i );
 
-          if ( create_threads_on_demand ) {
-            std::fill( threads, threads + max_threads, (pthread_t*)(NULL) );
-          } else {
+          if ( !create_threads_on_demand ) {
             for ( int i = 0; i < max_threads; ++i ) {
-              start_thread( &threads[i], pthread_attr, this );
+              start_thread( &threads[i], pthread_attr, workers[i] );
             }
           }
         }/* if more than one thread requested */
@@ -459,9 +986,144 @@ namespace xylose {
       if ( mx > 1 && !create_threads_on_demand )
         waitForStartedThread(mx);
 
+      /* queued tasks are picked up by the new threads. */
+      if ( mx > 1 && detail::atomic::load( &n_injected ) > 0 ) {
+        startThreadOnDemand( mx );
+        pthread_mutex_lock(&task_queue_mutex);
+        pthread_cond_broadcast(&task_ready_cond);
+        pthread_mutex_unlock(&task_queue_mutex);
+      }
+
       return mx;
     }
 
+    /** Set the placement of the worker threads on the cpus.  Live threads
+     * are moved immediately.  Worker k is placed on the k-th cpu of the
+     * policy's ordering of the usable cpus (wrapping around if there are
+     * more workers than cpus).
+     * @param policy
+     *    The placement policy.
+     * @param list
+     *    The cpus for AFFINITY_LIST (ignored for the other policies).
+     */
+    inline void set_affinity( const AffinityPolicy & policy,
+                              const std::vector<int> & list
+                                = std::vector<int>() ) {
+      namespace aff = detail::affinity;
+      /* read the topology outside of the spinlock. */
+      std::vector<aff::Cpu> all =
+        ( policy != AFFINITY_NONE && cpus.empty() ) ? aff::getCpus() : cpus;
+
+      std::vector<int> order;
+      switch ( policy ) {
+        case AFFINITY_COMPACT: order = aff::compactOrder( all ); break;
+        case AFFINITY_SCATTER: order = aff::scatterOrder( all ); break;
+        case AFFINITY_LIST:    order = list;                     break;
+        case AFFINITY_NONE:
+        default:                                                 break;
+      }
+
+      pthread_spin_lock(&max_threads_spinlock);
+      affinity_policy = ( policy != AFFINITY_NONE && order.empty() )
+                      ? AFFINITY_NONE : policy;
+      cpus.swap( all );
+      placement.swap( order );
+      if ( threads ) {
+        for ( int i = 0; i < max_threads; ++i )
+          if ( threads[i] )
+            pinThread( *threads[i], i );
+      }
+      pthread_spin_unlock(&max_threads_spinlock);
+    }
+
+    /** The current placement policy. */
+    inline AffinityPolicy get_affinity() {
+      pthread_spin_lock(&max_threads_spinlock);
+      AffinityPolicy p = affinity_policy;
+      pthread_spin_unlock(&max_threads_spinlock);
+      return p;
+    }
+
+    /** The cpu that worker k is pinned to (-1 if not pinned). */
+    inline int get_worker_cpu( const int & k ) {
+      pthread_spin_lock(&max_threads_spinlock);
+      int cpu = cpuOf( k );
+      pthread_spin_unlock(&max_threads_spinlock);
+      return cpu;
+    }
+
+    /** The NUMA node of worker k (-1 if the worker is not pinned).  Memory
+     * that worker k first touches is normally allocated on this node. */
+    inline int get_worker_node( const int & k ) {
+      pthread_spin_lock(&max_threads_spinlock);
+      int node = detail::affinity::nodeOf( cpus, cpuOf( k ) );
+      pthread_spin_unlock(&max_threads_spinlock);
+      return node;
+    }
+
+    /** The index (in [0, get_max_threads())) of the calling worker, or -1 if
+     * the calling thread is not a worker of this cache. */
+    int get_worker_index() const {
+      Worker * w = thisWorker();
+      return w ? w->index : -1;
+    }
+
+    /** A snapshot of the statistics since the last reset_stats() (all zero
+     * unless USE_PTHREAD_STATS is defined).  The counters of the workers are
+     * read without synchronization; the snapshot is exact when no tasks are
+     * executing.
+     */
+    inline PThreadCacheStats get_stats() {
+      PThreadCacheStats s;
+#ifdef USE_PTHREAD_STATS
+      s.enabled = true;
+#endif
+      pthread_spin_lock(&max_threads_spinlock);
+      s.retired = retired.get();
+      s.wait_time += retired.wait_time;
+      s.run_time += retired.run_time;
+      if ( workers ) {
+        for ( int i = 0; i < max_threads; ++i ) {
+          s.workers.push_back( workers[i]->stats.get() );
+          s.wait_time += workers[i]->stats.wait_time;
+          s.run_time += workers[i]->stats.run_time;
+        }
+      }
+      pthread_spin_unlock(&max_threads_spinlock);
+
+      pthread_mutex_lock(&stats_mutex);
+      s.elapsed = ( detail::nowNs() - stats_start_ns ) * 1e-9;
+      s.queue_depth = depth_samples;
+      s.sample_interval = detail::atomic::load( &sample_interval_ns ) * 1e-9;
+      pthread_mutex_unlock(&stats_mutex);
+      s.max_queue_depth = detail::atomic::load( &max_queue_depth );
+      return s;
+    }
+
+    /** Reset all statistics.  This should be called while no tasks are
+     * executing.
+     * @param sample_interval
+     *    Initial interval (in seconds) between samples of the queue depth
+     *    [Default 1ms].
+     */
+    inline void reset_stats( const double & sample_interval = 1e-3 ) {
+      pthread_spin_lock(&max_threads_spinlock);
+      retired.reset();
+      if ( workers )
+        for ( int i = 0; i < max_threads; ++i )
+          workers[i]->stats.reset();
+      pthread_spin_unlock(&max_threads_spinlock);
+
+      pthread_mutex_lock(&stats_mutex);
+      stats_start_ns = detail::nowNs();
+      depth_samples.clear();
+      detail::atomic::store( &sample_interval_ns,
+                             static_cast<long long>( sample_interval * 1e9 ) );
+      detail::atomic::store( &next_sample_ns, 0LL );
+      detail::atomic::store( &max_queue_depth, 0 );
+      pthread_mutex_unlock(&stats_mutex);
+    }
+
     /** Get the maximum number of threads that will be used to execute tasks.
      * */
     inline int get_max_threads() {
@@ -476,7 +1138,8 @@ namespace xylose {
      * */
     inline std::pair<int,int> get_active_threads() {
       pthread_spin_lock(&max_threads_spinlock);
-      std::pair<int,int> retval( max_threads, active_threads );
+      std::pair<int,int> retval( max_threads,
+                                 detail::atomic::load( &active_threads ) );
       pthread_spin_unlock(&max_threads_spinlock);
       return retval;
     }
@@ -485,16 +1148,78 @@ namespace xylose {
      * necessarily less than get_max_threads().
      * */
     inline int get_live_threads() {
-      pthread_spin_lock(&total_threads_spinlock);
-      int tot = total_threads;
-      pthread_spin_unlock(&total_threads_spinlock);
-      return tot;
+      return detail::atomic::load( &total_threads );
     }
   };
 
   /** The default thread cache. */
   static PThreadCache pthreadCache;
 
+  /** The default cache (for default arguments declared before
+   * pthreadCache). */
+  static inline PThreadCache & defaultPThreadCache() { return pthreadCache; }
+
+  inline PThreadTaskGroup::PThreadTaskGroup( PThreadCache & cache )
+    : cache(cache), n_outstanding(0), n_waiting(0) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  inline void PThreadTaskGroup::add( PThreadTask * task,
+                                     bool self_if_none_avail ) {
+    task->group = this;
+    detail::atomic::add( &n_outstanding, 1 );
+    cache.submitTask( task, self_if_none_avail );
+  }
+
+  template < typename Iter >
+  inline void PThreadTaskGroup::addTasks( const Iter & first,
+                                          const Iter & last ) {
+    int n = 0;
+    for ( Iter i = first; i != last; ++i, ++n )
+      (*i)->group = this;
+    detail::atomic::add( &n_outstanding, n );
+    cache.submitTasks( first, last );
+  }
+
+  inline void PThreadTaskGroup::wait() {
+    while ( detail::atomic::load( &n_outstanding ) > 0 &&
+            cache.helpOnce() );
+
+    pthread_mutex_lock(&mutex);
+    ++n_waiting;
+    while ( detail::atomic::load( &n_outstanding ) > 0 )
+      pthread_cond_wait(&cond, &mutex);
+    --n_waiting;
+    finished.clear();
+    pthread_mutex_unlock(&mutex);
+  }
+
+  inline PThreadTask * PThreadTaskGroup::waitAny() {
+    PThreadTask * task = NULL;
+    const bool worker = cache.isWorker();
+
+    pthread_mutex_lock(&mutex);
+    ++n_waiting;
+    while ( finished.empty() && detail::atomic::load( &n_outstanding ) > 0 ) {
+      if ( worker ) {
+        pthread_mutex_unlock(&mutex);
+        cache.helpOnce();
+        pthread_mutex_lock(&mutex);
+      } else
+        pthread_cond_wait(&cond, &mutex);
+    }
+    --n_waiting;
+
+    if ( !finished.empty() ) {
+      task = finished.back();
+      finished.pop_back();
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return task;
+  }
+
   /** A function to satisfy OpenMP/PThread mixed code. */
   static inline int get_max_threads() {
       return pthreadCache.get_max_threads();
@@ -0,0 +1,231 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \file
+ * Statistics of the xylose::PThreadCache facility.
+ */
+
+#ifndef xylose_PThreadCacheStats_h
+#define xylose_PThreadCacheStats_h
+
+#include <xylose/binning/SingleValued.h>
+
+#include <time.h>
+
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <string>
+#include <cmath>
+
+namespace xylose {
+
+  namespace detail {
+    /** Monotonic clock in nanoseconds. */
+    inline long long nowNs() {
+      struct timespec t;
+      clock_gettime( CLOCK_MONOTONIC, &t );
+      return static_cast<long long>(t.tv_sec) * 1000000000LL + t.tv_nsec;
+    }
+  }
+
+  /** Histogram of latencies, binned by log10(seconds) from 10ns to 10s with
+   * eight bins per decade (values outside are put in the first/last bin). */
+  struct PThreadLatencyHistogram : binning::SingleValued<double, 72, long> {
+    typedef binning::SingleValued<double, 72, long> super;
+
+    PThreadLatencyHistogram() : super( -8.0, 1.0 ) { }
+
+    /** Bin a latency given in nanoseconds. */
+    void add( const long long & ns ) {
+      super::bin( std::log10( ns > 0 ? ns * 1e-9 : 1e-10 ) );
+    }
+
+    /** Total number of binned latencies. */
+    long count() const {
+      long c = 0;
+      for ( unsigned int i = 0; i < nBins(); ++i )
+        c += bins[i];
+      return c;
+    }
+
+    /** Latency (in seconds) below which the fraction q of the binned
+     * latencies lie (resolved to the upper edge of the bin). */
+    double quantile( const double & q ) const {
+      const long c = count();
+      long s = 0;
+      for ( unsigned int i = 0; i < nBins(); ++i ) {
+        s += bins[i];
+        if ( c > 0 && s >= q * c )
+          return std::pow( 10.0, getMin() + (i + 1) / getScale() );
+      }
+      return 0.0;
+    }
+  };
+
+  /** Statistics of one worker of a PThreadCache. */
+  struct PThreadWorkerStats {
+    /** Seconds spent executing tasks (nested tasks executed while waiting
+     * are included in the time of the waiting task). */
+    double busy_time;
+    /** Seconds spent looking for tasks or parked. */
+    double idle_time;
+    /** Number of executed tasks. */
+    long n_tasks;
+    /** Number of tasks stolen from the deques of other workers. */
+    long n_steals;
+    /** Number of tasks taken from the injection queue. */
+    long n_injected;
+    /** Number of times that the worker parked (blocked) for lack of tasks. */
+    long n_parks;
+
+    PThreadWorkerStats()
+      : busy_time(0), idle_time(0),
+        n_tasks(0), n_steals(0), n_injected(0), n_parks(0) { }
+
+    PThreadWorkerStats & operator+= ( const PThreadWorkerStats & that ) {
+      busy_time  += that.busy_time;
+      idle_time  += that.idle_time;
+      n_tasks    += that.n_tasks;
+      n_steals   += that.n_steals;
+      n_injected += that.n_injected;
+      n_parks    += that.n_parks;
+      return *this;
+    }
+  };
+
+  /** A snapshot of the statistics of a PThreadCache (see
+   * PThreadCache::get_stats).  The statistics are only recorded if
+   * USE_PTHREAD_STATS is defined (in all translation units that include
+   * PThreadCache.h); otherwise all values stay zero. */
+  struct PThreadCacheStats {
+    /** Whether the statistics were compiled in. */
+    bool enabled;
+    /** Seconds since the statistics were (re)set. */
+    double elapsed;
+    /** Statistics of the current workers. */
+    std::vector<PThreadWorkerStats> workers;
+    /** Totals of the workers that were stopped by set_max_threads. */
+    PThreadWorkerStats retired;
+    /** Time from the submission of a task until it starts. */
+    PThreadLatencyHistogram wait_time;
+    /** Execution time of the tasks. */
+    PThreadLatencyHistogram run_time;
+    /** Samples of (seconds since reset, number of queued tasks not yet
+     * started), taken by the submitting threads at most every
+     * sample_interval. */
+    std::vector< std::pair<double,int> > queue_depth;
+    /** The largest number of queued tasks not yet started. */
+    int max_queue_depth;
+    /** The current interval between queue depth samples (seconds). */
+    double sample_interval;
+
+    PThreadCacheStats()
+      : enabled(false), elapsed(0), max_queue_depth(0), sample_interval(0) { }
+
+    /** Sum over all (current and retired) workers. */
+    PThreadWorkerStats total() const {
+      PThreadWorkerStats t = retired;
+      for ( unsigned int i = 0; i < workers.size(); ++i )
+        t += workers[i];
+      return t;
+    }
+
+    /** Print a human readable summary. */
+    std::ostream & print( std::ostream & out,
+                          const std::string & prefix = "" ) const {
+      if ( !enabled )
+        return out << prefix << "PThreadCache statistics not compiled in "
+                                "(define USE_PTHREAD_STATS)\n";
+
+      out << prefix << "elapsed: " << elapsed << " s"
+                    << ", max queue depth: " << max_queue_depth << '\n';
+      for ( unsigned int i = 0; i < workers.size(); ++i ) {
+        const PThreadWorkerStats & w = workers[i];
+        out << prefix << "worker " << i
+            << ": busy " << w.busy_time << " s"
+            << ", idle " << w.idle_time << " s"
+            << ", tasks " << w.n_tasks
+            << ", steals " << w.n_steals
+            << ", injected " << w.n_injected
+            << ", parks " << w.n_parks << '\n';
+      }
+
+      out << prefix << "task wait (s):  median " << wait_time.quantile(0.5)
+                    << ", 99% " << wait_time.quantile(0.99) << '\n'
+          << prefix << "task run  (s):  median " << run_time.quantile(0.5)
+                    << ", 99% " << run_time.quantile(0.99) << '\n';
+      return out;
+    }
+  };
+
+  /** Insertion operator to ease writing the statistics to a stream. */
+  inline std::ostream & operator<< ( std::ostream & out,
+                                     const PThreadCacheStats & s ) {
+    return s.print( out );
+  }
+
+  namespace detail {
+    /** Counters of a single worker; written only by the worker itself. */
+    struct PThreadWorkerCounters {
+      long long busy_ns, idle_ns;
+      long n_tasks, n_steals, n_injected, n_parks;
+      int depth;                  /**< nesting of executing tasks. */
+      PThreadLatencyHistogram wait_time, run_time;
+
+      PThreadWorkerCounters() { reset(); }
+
+      void reset() {
+        busy_ns = idle_ns = 0;
+        n_tasks = n_steals = n_injected = n_parks = 0;
+        depth = 0;
+        wait_time.clearBins();
+        run_time.clearBins();
+      }
+
+      /** Add the counts of another worker (depth is not changed). */
+      void add( const PThreadWorkerCounters & that ) {
+        busy_ns    += that.busy_ns;
+        idle_ns    += that.idle_ns;
+        n_tasks    += that.n_tasks;
+        n_steals   += that.n_steals;
+        n_injected += that.n_injected;
+        n_parks    += that.n_parks;
+        wait_time  += that.wait_time;
+        run_time   += that.run_time;
+      }
+
+      PThreadWorkerStats get() const {
+        PThreadWorkerStats s;
+        s.busy_time  = busy_ns * 1e-9;
+        s.idle_time  = idle_ns * 1e-9;
+        s.n_tasks    = n_tasks;
+        s.n_steals   = n_steals;
+        s.n_injected = n_injected;
+        s.n_parks    = n_parks;
+        return s;
+      }
+    };
+  }
+
+} /* namespace xylose */
+
+#endif // xylose_PThreadCacheStats_h
@@ -138,7 +138,7 @@ namespace xylose {
     PThreadCache & cache;
 
     /** The tasks to evaluate. */
-    PThreadTaskSet tasks;
+    PThreadTaskGroup tasks;
 
 
 
@@ -149,14 +149,12 @@ namespace xylose {
      *    Specify the cache instance to use [default xylose::pthreadCache].
      */
     PThreadEval( PThreadCache & cache = xylose::pthreadCache )
-      : cache(cache) { }
+      : cache(cache), tasks(cache) { }
 
     /** Task scatterer.  */
     inline void eval( const Functor & f, bool self_if_none_avail = false ) {
       /* first wait for a thread to become available */
-      PThreadTask * task = new PThreadEvalTask( f );
-      tasks.insert(task);
-      cache.addTask( task, self_if_none_avail );
+      tasks.add( new PThreadEvalTask( f ), self_if_none_avail );
     }
 
     /** Task gatherer.  This function makes sure that all of this
@@ -172,20 +170,12 @@ namespace xylose {
      */
     template < typename Gatherer >
     inline void joinAll( Gatherer & g ) {
-      while (tasks.size() > 0) {
-        PThreadTaskSet finished = cache.waitForTasks(tasks);
-
-        /* Allow the user to do something with the task results. */
-        for_each( finished.begin(), finished.end(), deleteTasks<Gatherer>(g) );
-
-        /* Now make sure that we remove the finished tasks from the
-         * tasks set.  We'll use the set operations to do this. */
-        PThreadTaskSet tmp;
-        std::set_difference( tasks.begin(), tasks.end(),
-                             finished.begin(), finished.end(),
-                             inserter(tmp, tmp.begin()) );
-        tasks.swap(tmp);
-      }
+      deleteTasks<Gatherer> gather( g );
+
+      /* Allow the user to do something with the task results. */
+      PThreadTask * task;
+      while ( ( task = tasks.waitAny() ) != NULL )
+        gather( task );
     }
   };
 
@@ -0,0 +1,227 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \file
+ * Execution of a graph of dependent tasks on the xylose::PThreadCache
+ * facility.
+ */
+
+#ifndef xylose_PThreadTaskGraph_h
+#define xylose_PThreadTaskGraph_h
+
+#include <xylose/PThreadCache.h>
+#include <xylose/detail/atomic.h>
+
+#include <vector>
+#include <stdexcept>
+
+namespace xylose {
+
+  /** A graph of tasks with edges that order their execution.  A task is
+   * started as soon as all of its predecessors have finished; there are no
+   * barriers between unrelated tasks.  The graph is built once and can then
+   * be launched any number of times (e.g. once per timestep) at the cost of
+   * resetting one counter per task:
+   * <pre>
+   *    PThreadTaskGraph graph;
+   *    for ( int b = 0; b < n_blocks; ++b ) {
+   *      PThreadTaskGraph::Node p = graph.add( &push[b] ),
+   *                             s = graph.add( &sort[b] ),
+   *                             c = graph.add( &collide[b] );
+   *      graph.precede( p, s );
+   *      graph.precede( s, c );
+   *    }
+   *
+   *    for ( int step = 0; step < n_steps; ++step )
+   *      graph.run();
+   * </pre>
+   * When a task finishes, the first of its successors that becomes ready is
+   * executed directly by the same thread (keeping its data in cache); the
+   * other ready successors are added to the cache.  The graph does not own
+   * the tasks, and the tasks and the graph must not be changed while the
+   * graph is running.
+   */
+  class PThreadTaskGraph {
+    /* TYPEDEFS */
+  public:
+    /** Handle of a task in the graph. */
+    typedef int Node;
+
+  private:
+    /** The task that the cache executes for each node. */
+    struct NodeTask : PThreadTask {
+      PThreadTaskGraph * graph;
+      Node node;
+
+      NodeTask( PThreadTaskGraph * graph, const Node & node )
+        : PThreadTask(), graph(graph), node(node) { }
+
+      virtual void exec() { graph->execute( node ); }
+    };
+
+    /** Per-node storage. */
+    struct NodeData {
+      PThreadTask * task;
+      std::vector<Node> successors;
+      int n_predecessors;
+      int pending;          /**< atomic:  unfinished predecessors. */
+
+      NodeData( PThreadTask * task )
+        : task(task), n_predecessors(0), pending(0) { }
+    };
+
+
+    /* MEMBER STORAGE */
+  private:
+    std::vector<NodeData> nodes;
+    std::vector<NodeTask> node_tasks;
+    std::vector<Node> roots;  /**< nodes without predecessors. */
+    std::vector<PThreadTask *> root_tasks; /**< their node tasks. */
+    bool checked;             /**< whether the graph is known to be acyclic. */
+    PThreadTaskGroup group;
+
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Constructor.
+     * @param cache
+     *    Specify the cache instance to use [default xylose::pthreadCache].
+     */
+    PThreadTaskGraph( PThreadCache & cache = pthreadCache )
+      : checked(true), group(cache) { }
+
+    /** Add a task to the graph.
+     * @return the handle of the task for precede().
+     */
+    Node add( PThreadTask * task ) {
+      nodes.push_back( NodeData( task ) );
+      node_tasks.push_back( NodeTask( this, nodes.size() - 1 ) );
+      checked = false;
+      return nodes.size() - 1;
+    }
+
+    /** Require that task <code>before</code> finishes before task
+     * <code>after</code> starts. */
+    void precede( const Node & before, const Node & after ) {
+      nodes.at( before ).successors.push_back( after );
+      ++nodes.at( after ).n_predecessors;
+      checked = false;
+    }
+
+    /** Number of tasks in the graph. */
+    int size() const { return nodes.size(); }
+
+    /** Remove all tasks (and edges) from the graph. */
+    void clear() {
+      nodes.clear();
+      node_tasks.clear();
+      roots.clear();
+      root_tasks.clear();
+      checked = true;
+    }
+
+    /** Start executing the graph without waiting for it.  A previous launch
+     * must have finished (see wait()).
+     * @throws std::runtime_error if the edges contain a cycle.
+     */
+    void launch() {
+      if ( !checked )
+        check();
+
+      for ( unsigned int i = 0u; i < nodes.size(); ++i )
+        nodes[i].pending = nodes[i].n_predecessors;
+
+      group.addTasks( root_tasks.begin(), root_tasks.end() );
+    }
+
+    /** Wait for all tasks of a launched graph to finish. */
+    void wait() { group.wait(); }
+
+    /** Execute the graph and wait for it to finish. */
+    void run() {
+      launch();
+      wait();
+    }
+
+  private:
+    /** Copying is not allowed. */
+    PThreadTaskGraph( const PThreadTaskGraph & );
+    PThreadTaskGraph & operator= ( const PThreadTaskGraph & );
+
+    /** Execute the task of a node and the chain of successors that become
+     * ready after it. */
+    void execute( Node n ) {
+      while ( n >= 0 ) {
+        NodeData & d = nodes[n];
+        d.task->exec();
+
+        Node next = -1;
+        for ( unsigned int i = 0u; i < d.successors.size(); ++i ) {
+          const Node s = d.successors[i];
+          if ( detail::atomic::sub( &nodes[s].pending, 1 ) != 0 )
+            continue;
+
+          if ( next < 0 )
+            next = s;
+          else
+            group.add( &node_tasks[s] );
+        }
+        n = next;
+      }
+    }
+
+    /** Find the roots and make sure that all nodes are reachable in
+     * topological order (i.e. that there are no cycles). */
+    void check() {
+      roots.clear();
+      std::vector<int> pending( nodes.size() );
+      std::vector<Node> ready;
+      for ( unsigned int i = 0u; i < nodes.size(); ++i ) {
+        pending[i] = nodes[i].n_predecessors;
+        if ( pending[i] == 0 ) {
+          roots.push_back( i );
+          ready.push_back( i );
+        }
+      }
+
+      unsigned int n_visited = 0u;
+      while ( !ready.empty() ) {
+        const Node n = ready.back();
+        ready.pop_back();
+        ++n_visited;
+        for ( unsigned int i = 0u; i < nodes[n].successors.size(); ++i )
+          if ( --pending[ nodes[n].successors[i] ] == 0 )
+            ready.push_back( nodes[n].successors[i] );
+      }
+
+      root_tasks.clear();
+      for ( unsigned int i = 0u; i < roots.size(); ++i )
+        root_tasks.push_back( &node_tasks[ roots[i] ] );
+
+      if ( n_visited != nodes.size() )
+        throw std::runtime_error( "PThreadTaskGraph:  cycle in the task graph" );
+      checked = true;
+    }
+  };
+
+} /* namespace xylose */
+
+#endif // xylose_PThreadTaskGraph_h
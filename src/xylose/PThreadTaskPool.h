@@ -0,0 +1,135 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \file
+ * Recycling of task objects for the xylose::PThreadCache facility.
+ */
+
+#ifndef xylose_PThreadTaskPool_h
+#define xylose_PThreadTaskPool_h
+
+#include <xylose/PThreadCache.h>
+
+#include <vector>
+#include <cstddef>
+
+namespace xylose {
+
+  /** A free list of task objects such that tasks that are scheduled over
+   * and over (e.g. once per timestep or per function evaluation) are not
+   * allocated on the heap each time:
+   * <pre>
+   *    PThreadTaskPool<MyTask> pool;
+   *    ...
+   *    MyTask * t = pool.get();
+   *    t->set( ...inputs... );
+   *    group.add( t );
+   *    ...
+   *    pool.put( group.waitAny() );
+   * </pre>
+   * A recycled task is <b>not</b> constructed again; the caller must reset
+   * whatever state the task needs before reusing it.  The pool owns the
+   * tasks in its free list only (these are deleted by the destructor or
+   * clear()).  The pool is not synchronized and is meant to be used by the
+   * thread that owns (adds and waits for) the tasks.
+   *
+   * @tparam Task
+   *    The task type (derived from PThreadTask).
+   */
+  template < typename Task >
+  class PThreadTaskPool {
+    /* MEMBER STORAGE */
+  private:
+    std::vector<Task *> free_tasks;
+
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Constructor. */
+    PThreadTaskPool() : free_tasks() { }
+
+    /** Destructor deletes the tasks that are in the free list. */
+    ~PThreadTaskPool() { clear(); }
+
+    /** A recycled task or a new default constructed task. */
+    Task * get() {
+      if ( free_tasks.empty() )
+        return new Task();
+      return pop();
+    }
+
+    /** A recycled task or a task constructed as new Task(a). */
+    template < typename A >
+    Task * get( A & a ) {
+      if ( free_tasks.empty() )
+        return new Task( a );
+      return pop();
+    }
+
+    /** A recycled task or a task constructed as new Task(a). */
+    template < typename A >
+    Task * get( const A & a ) {
+      if ( free_tasks.empty() )
+        return new Task( a );
+      return pop();
+    }
+
+    /** Return a (finished) task to the pool.  NULL is ignored.  The task
+     * forgets the group it was added through. */
+    void put( PThreadTask * task ) {
+      if ( task ) {
+        task->group = NULL;
+        free_tasks.push_back( static_cast<Task *>( task ) );
+      }
+    }
+
+    /** Number of tasks in the free list. */
+    std::size_t available() const { return free_tasks.size(); }
+
+    /** Make sure that at least n tasks are available without further
+     * allocations (for default constructible tasks). */
+    void reserve( const std::size_t & n ) {
+      while ( free_tasks.size() < n )
+        free_tasks.push_back( new Task() );
+    }
+
+    /** Delete the tasks in the free list. */
+    void clear() {
+      for ( unsigned int i = 0u; i < free_tasks.size(); ++i )
+        delete free_tasks[i];
+      free_tasks.clear();
+    }
+
+  private:
+    Task * pop() {
+      Task * task = free_tasks.back();
+      free_tasks.pop_back();
+      return task;
+    }
+
+    /** Copying is not allowed. */
+    PThreadTaskPool( const PThreadTaskPool & );
+    PThreadTaskPool & operator= ( const PThreadTaskPool & );
+  };
+
+} /* namespace xylose */
+
+#endif // xylose_PThreadTaskPool_h
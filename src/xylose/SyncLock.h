@@ -65,8 +65,7 @@
 #endif
 
 #if defined(USE_PTHREAD) && !defined(THREAD_SYS_DEFINED)
-#  include <pthread.h>
-#  include <errno.h>
+#  include <xylose/detail/AdaptiveLock.h>
 #  define IF_PTHREAD(x) x
 #  define THREAD_SYS_DEFINED
 #else
@@ -88,46 +87,87 @@
 #  define IF_THREADS(x,y) y
 #endif
 
+#ifdef USE_SYNCLOCK_STATS
+#  include <time.h>
+#endif
+
+#include <cstddef>
+
+#if defined(__GNUC__)
+   /** Align (and thereby pad) a type to a cache line. */
+#  define XYLOSE_CACHE_ALIGNED __attribute__((aligned(64)))
+#else
+#  define XYLOSE_CACHE_ALIGNED
+#endif
+
 
 namespace xylose {
 
+  /** Contention counters of a SyncLock (see SyncLock::getStats). */
+  struct SyncLockStats {
+    /** Number of times the lock was acquired by lock(). */
+    long acquisitions;
+    /** Number of those that found the lock held by another thread. */
+    long contended;
+    /** Seconds spent waiting (spinning or blocked) in contended lock()s. */
+    double wait_time;
+
+    SyncLockStats() : acquisitions(0), contended(0), wait_time(0) { }
+  };
+
   /** SyncLock is a class to facilitate mutual exlusion locks for
    * multi-threaded code.  This should be specialized (by ifdefs) for the
    * specific type of mutex needed.
    *
    * Currently supported threading systems:
    * - OpenMP
-   * - PThreads.
+   * - PThreads (detail::AdaptiveLock:  spins briefly, then blocks on a
+   *   futex).
    * - Win32 (Critical Section stuff)
    * .
    *
+   * Each SyncLock occupies its own cache line so that neighboring locks (or
+   * data) do not share it.  If USE_SYNCLOCK_STATS is defined, each lock
+   * counts its acquisitions, contended acquisitions and waiting time (see
+   * getStats).
    */
-  class SyncLock {
+  class XYLOSE_CACHE_ALIGNED SyncLock {
   private:
     IF_OMP(omp_lock_t omplock;)
-    IF_PTHREAD(pthread_spinlock_t pthread_spin;)
+    IF_PTHREAD(detail::AdaptiveLock pthread_lock;)
     IF_WIN32(CRITICAL_SECTION critical_section;)
 
+    /* contention counters, protected by the lock itself. */
+    long n_acquisitions;
+    long n_contended;
+    long long wait_ns;
+
   public:
     /** Constructor initializes relevant mutex object. */
-    SyncLock() {
+    SyncLock() : n_acquisitions(0), n_contended(0), wait_ns(0) {
       IF_OMP(omp_init_lock(&omplock);)
-      IF_PTHREAD(pthread_spin_init(&pthread_spin, 0);)
       IF_WIN32(InitializeCriticalSectionEx(&critical_section,4000,0);)
     }
 
     /** Destructor destroys relevant mutex object. */
     ~SyncLock() {
       IF_OMP(omp_destroy_lock(&omplock);)
-      IF_PTHREAD(pthread_spin_destroy(&pthread_spin);)
       IF_WIN32(DeleteCriticalSection(&critical_section);)
     }
 
     /** Locks relevant mutex object. */
     inline void lock() {
-      IF_OMP(omp_set_lock(&omplock);)
-      IF_PTHREAD(pthread_spin_lock(&pthread_spin);)
-      IF_WIN32(EnterCriticalSection(&critical_section);)
+#ifdef USE_SYNCLOCK_STATS
+      if ( !tryLock() ) {
+        const long long t0 = nowNs();
+        lockImpl();
+        wait_ns += nowNs() - t0;
+        ++n_contended;
+      }
+      ++n_acquisitions;
+#else
+      lockImpl();
+#endif
     }
 
     /** Attempts to lock mutex, but does not block if unsuccessful.
@@ -136,7 +176,7 @@ namespace xylose {
      */
     inline bool tryLock() {
       IF_OMP(return omp_test_lock(&omplock);)
-      IF_PTHREAD(return pthread_spin_trylock(&pthread_spin) == 0;)
+      IF_PTHREAD(return pthread_lock.tryLock();)
       IF_WIN32(return TryEnterCriticalSection(&critical_section);)
       IF_THREADS(/*threads active*/,return true;)
     }
@@ -151,17 +191,7 @@ namespace xylose {
           return true;
       )
 
-      IF_PTHREAD(
-        int v = pthread_spin_trylock(&pthread_spin);
-        switch (v) {
-          case EBUSY:
-            return true;
-          case 0:
-            unlock();
-          default:
-            return false;
-        }
-      )
+      IF_PTHREAD(return pthread_lock.isLocked();)
 
       IF_WIN32(
         if ( TryEnterCriticalSection(&critical_section) ) {
@@ -177,9 +207,42 @@ namespace xylose {
     /** Unlocks relevant mutex object. */
     inline void unlock() {
       IF_OMP(omp_unset_lock(&omplock);)
-      IF_PTHREAD(pthread_spin_unlock(&pthread_spin);)
+      IF_PTHREAD(pthread_lock.unlock();)
       IF_WIN32(LeaveCriticalSection(&critical_section);)
     }
+
+    /** The contention counters (all zero unless USE_SYNCLOCK_STATS is
+     * defined).  Taken without the lock; exact when the lock is free. */
+    SyncLockStats getStats() const {
+      SyncLockStats s;
+      s.acquisitions = n_acquisitions;
+      s.contended = n_contended;
+      s.wait_time = wait_ns * 1e-9;
+      return s;
+    }
+
+    /** Reset the contention counters (call while holding the lock or while
+     * no other thread uses it). */
+    void resetStats() {
+      n_acquisitions = n_contended = 0;
+      wait_ns = 0;
+    }
+
+  private:
+    /** Blocking lock of the underlying mutex object. */
+    inline void lockImpl() {
+      IF_OMP(omp_set_lock(&omplock);)
+      IF_PTHREAD(pthread_lock.lock();)
+      IF_WIN32(EnterCriticalSection(&critical_section);)
+    }
+
+#ifdef USE_SYNCLOCK_STATS
+    static long long nowNs() {
+      struct timespec t;
+      clock_gettime( CLOCK_MONOTONIC, &t );
+      return static_cast<long long>(t.tv_sec) * 1000000000LL + t.tv_nsec;
+    }
+#endif
   };
 
   /** An RAII type automatic locking/unlocking key for a SyncLock. 
@@ -193,12 +256,169 @@ namespace xylose {
     ~SyncKey() { lock.unlock(); }
   };
 
+  /** A reader-writer lock:  any number of readers (lockShared()) or one
+   * writer (lock()) may hold the lock at a time.  The read path is a single
+   * atomic increment unless a writer holds or waits for the lock.
+   *
+   * Currently supported threading systems:
+   * - OpenMP (readers are exclusive, too)
+   * - PThreads (detail::AdaptiveSharedLock).
+   * - Win32 (slim reader/writer lock)
+   * .
+   */
+  class XYLOSE_CACHE_ALIGNED SharedSyncLock {
+  private:
+    IF_OMP(omp_lock_t omplock;)
+    IF_PTHREAD(detail::AdaptiveSharedLock pthread_lock;)
+    IF_WIN32(SRWLOCK srwlock;)
+
+  public:
+    /** Constructor initializes relevant lock object. */
+    SharedSyncLock() {
+      IF_OMP(omp_init_lock(&omplock);)
+      IF_WIN32(InitializeSRWLock(&srwlock);)
+    }
+
+    /** Destructor destroys relevant lock object. */
+    ~SharedSyncLock() {
+      IF_OMP(omp_destroy_lock(&omplock);)
+    }
+
+    /** Locks for exclusive (writer) access. */
+    inline void lock() {
+      IF_OMP(omp_set_lock(&omplock);)
+      IF_PTHREAD(pthread_lock.lock();)
+      IF_WIN32(AcquireSRWLockExclusive(&srwlock);)
+    }
+
+    /** Unlocks exclusive access. */
+    inline void unlock() {
+      IF_OMP(omp_unset_lock(&omplock);)
+      IF_PTHREAD(pthread_lock.unlock();)
+      IF_WIN32(ReleaseSRWLockExclusive(&srwlock);)
+    }
+
+    /** Locks for shared (reader) access. */
+    inline void lockShared() {
+      IF_OMP(omp_set_lock(&omplock);)
+      IF_PTHREAD(pthread_lock.lockShared();)
+      IF_WIN32(AcquireSRWLockShared(&srwlock);)
+    }
+
+    /** Unlocks shared access. */
+    inline void unlockShared() {
+      IF_OMP(omp_unset_lock(&omplock);)
+      IF_PTHREAD(pthread_lock.unlockShared();)
+      IF_WIN32(ReleaseSRWLockShared(&srwlock);)
+    }
+
+    /** Attempts exclusive access without blocking.
+     * @returns true if successful in locking.
+     */
+    inline bool tryLock() {
+      IF_OMP(return omp_test_lock(&omplock);)
+      IF_PTHREAD(return pthread_lock.tryLock();)
+      IF_WIN32(return TryAcquireSRWLockExclusive(&srwlock);)
+      IF_THREADS(/*threads active*/,return true;)
+    }
+
+    /** Attempts shared access without blocking.
+     * @returns true if successful in locking.
+     */
+    inline bool tryLockShared() {
+      IF_OMP(return omp_test_lock(&omplock);)
+      IF_PTHREAD(return pthread_lock.tryLockShared();)
+      IF_WIN32(return TryAcquireSRWLockShared(&srwlock);)
+      IF_THREADS(/*threads active*/,return true;)
+    }
+
+    /** Tests to see if any reader or writer holds the lock. */
+    inline bool isLocked() {
+      IF_OMP(
+        if ( omp_test_lock(&omplock) ) {
+          omp_unset_lock(&omplock);
+          return false;
+        } else
+          return true;
+      )
+
+      IF_PTHREAD(return pthread_lock.isLocked();)
+
+      IF_WIN32(
+        if ( TryAcquireSRWLockExclusive(&srwlock) ) {
+          ReleaseSRWLockExclusive(&srwlock);
+          return false;
+        } else
+          return true;
+      )
+
+      IF_THREADS(/*threads active*/,return false;)
+    }
+  };
+
+  /** An RAII type key for shared (reader) access to a SharedSyncLock. */
+  struct ReadSyncKey {
+    SharedSyncLock & lock;
+
+    ReadSyncKey( SharedSyncLock & lock ) : lock(lock) { lock.lockShared(); }
+    ~ReadSyncKey() { lock.unlockShared(); }
+  };
+
+  /** An RAII type key for exclusive (writer) access to a SharedSyncLock. */
+  struct WriteSyncKey {
+    SharedSyncLock & lock;
+
+    WriteSyncKey( SharedSyncLock & lock ) : lock(lock) { lock.lock(); }
+    ~WriteSyncKey() { lock.unlock(); }
+  };
+
+  /** A table of SyncLocks that are selected by a hash or by the address of
+   * the protected object.  Unrelated objects then (mostly) use different
+   * locks, while a single table serves any number of objects:
+   * <pre>
+   *    StripedSyncLock<> locks;
+   *    ...
+   *    SyncKey key( locks.get( &cell ) );
+   * </pre>
+   * @tparam n_stripes
+   *    Number of locks in the table [Default 64].
+   */
+  template < unsigned int n_stripes = 64u >
+  class StripedSyncLock {
+    /* MEMBER STORAGE */
+  private:
+    SyncLock locks[n_stripes];
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Number of locks in the table. */
+    static unsigned int size() { return n_stripes; }
+
+    /** The lock for a hash value. */
+    SyncLock & operator[] ( const std::size_t & hash ) {
+      return locks[ hash % n_stripes ];
+    }
+
+    /** The lock for the object at the given address. */
+    SyncLock & get( const void * object ) {
+      /* ignore the low (alignment) bits and mix the rest (Fibonacci
+       * hashing) such that neighboring objects use different locks. */
+      std::size_t h = reinterpret_cast<std::size_t>( object ) >> 4;
+      h *= static_cast<std::size_t>( 0x9E3779B97F4A7C15ULL );
+      return (*this)[ h >> ( sizeof(std::size_t) * 4 ) ];
+    }
+  };
+
   /** Automatic locking/unlocking facility with a typename scope. */
   template < typename T >
   struct Synchronize : SyncKey {
     /* STATIC STORAGE */
     static SyncLock lock;
 
+    /** Locks for individual objects of type T (see
+     * Synchronize(const void *)). */
+    static StripedSyncLock<> stripes;
+
     /* MEMBER FUNCTIONS */
     /** Default constructor locks sync object.
      * This uses the SyncKey on a static member.
@@ -206,11 +426,45 @@ namespace xylose {
      * @see SyncKey
      */
     Synchronize() : SyncKey(Synchronize::lock) { }
+
+    /** Lock only the stripe of the given object, such that unrelated
+     * objects of the same type do not contend.  This does <b>not</b> exclude
+     * the default (type-wide) lock. */
+    explicit Synchronize( const void * object )
+      : SyncKey( Synchronize::stripes.get( object ) ) { }
   };
 
   template < typename T >
   SyncLock Synchronize<T>::lock = SyncLock();
 
+  template < typename T >
+  StripedSyncLock<> Synchronize<T>::stripes;
+
+  /** Reader-writer locking with a typename scope:  SynchronizeRead<T> keys
+   * share access with each other and exclude SynchronizeWrite<T> keys. */
+  template < typename T >
+  struct SharedSynchronize {
+    /* STATIC STORAGE */
+    static SharedSyncLock lock;
+  };
+
+  template < typename T >
+  SharedSyncLock SharedSynchronize<T>::lock;
+
+  /** RAII shared (reader) access with a typename scope.
+   * @see SharedSynchronize */
+  template < typename T >
+  struct SynchronizeRead : ReadSyncKey {
+    SynchronizeRead() : ReadSyncKey( SharedSynchronize<T>::lock ) { }
+  };
+
+  /** RAII exclusive (writer) access with a typename scope.
+   * @see SharedSynchronize */
+  template < typename T >
+  struct SynchronizeWrite : WriteSyncKey {
+    SynchronizeWrite() : WriteSyncKey( SharedSynchronize<T>::lock ) { }
+  };
+
   /** Synchronize the execution of a Functor class. */
   template < typename Functor >
   inline Functor synchronize( const Functor & f ) {
@@ -220,6 +474,36 @@ namespace xylose {
     return fout;
   }
 
+  /** Synchronize the execution of a Functor class with the other executions
+   * for the same object only (see Synchronize(const void *)). */
+  template < typename Functor >
+  inline Functor synchronize( const Functor & f, const void * object ) {
+    Synchronize<Functor> sync( object );
+    Functor fout(f);
+    fout();
+    return fout;
+  }
+
+  /** Execute a (reading) Functor class concurrently with other readers but
+   * not with the writers (synchronize_write) of the same Functor type. */
+  template < typename Functor >
+  inline Functor synchronize_read( const Functor & f ) {
+    SynchronizeRead<Functor> sync;
+    Functor fout(f);
+    fout();
+    return fout;
+  }
+
+  /** Execute a (writing) Functor class exclusively with respect to the
+   * readers (synchronize_read) and writers of the same Functor type. */
+  template < typename Functor >
+  inline Functor synchronize_write( const Functor & f ) {
+    SynchronizeWrite<Functor> sync;
+    Functor fout(f);
+    fout();
+    return fout;
+  }
+
 } /*namespace xylose*/
 
 #endif // xylose_SyncLock_h
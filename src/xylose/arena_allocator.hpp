@@ -0,0 +1,394 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \file
+ * Monotonic (bump pointer) arena and the STL allocators that draw from it.
+ */
+
+#ifndef xylose_arena_allocator_h
+#define xylose_arena_allocator_h
+
+#include <xylose/logger.h>
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+
+/* Each thread needs its own arena whenever there are threads at all. */
+#if defined(USE_PTHREAD) || defined(_OPENMP)
+#  define XYLOSE_ARENA_THREAD_LOCAL
+#endif
+
+#if defined(USE_PTHREAD)
+#  include <pthread.h>
+#endif
+
+namespace xylose {
+
+  namespace detail {
+    /** Alignment requirement of T (what alignof(T) gives in C++11). */
+    template < typename T >
+    struct alignment_of {
+      struct S { char c; T t; };
+      enum { value = sizeof(S) - sizeof(T) };
+    };
+  }
+
+  /** Memory arena for objects that all die at the same time, such as the
+   * scratch data of a single timestep:
+   * <pre>
+   *    Arena arena;
+   *    for ( ... each timestep ... ) {
+   *      {
+   *        std::vector< Pair, arena_allocator<Pair> >
+   *          pairs( (arena_allocator<Pair>(arena)) );
+   *        ...
+   *      }
+   *      arena.reset();
+   *    }
+   * </pre>
+   * Memory is handed out by bumping a pointer through large blocks.  Single
+   * items are never freed; instead, reset() makes the whole arena available
+   * again at once.  The blocks are kept across resets, so that after the
+   * first few timesteps no more memory is requested from the system.  reset()
+   * does not run destructors; everything allocated from the arena must be
+   * destroyed (or be trivially destructible) before then.
+   *
+   * An Arena is not synchronized; see ThreadArena for one arena per thread.
+   */
+  class Arena {
+    /* TYPEDEFS */
+  private:
+    struct Block {
+      char * begin;
+      std::size_t size;
+    };
+
+    /* MEMBER STORAGE */
+  private:
+    /** All blocks owned by this arena (in the order they are used). */
+    std::vector<Block> blocks;
+    /** Index of the next block to bump through. */
+    std::size_t next_block;
+    /** Bump pointer and end of the current block. */
+    char * top;
+    char * end;
+    /** Default size of new blocks. */
+    std::size_t block_size;
+    /** Bytes handed out since the last reset() (excluding padding). */
+    std::size_t allocated;
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Constructor.
+     * @param block_size
+     *    Size of the blocks to get from the system.  Larger requests get a
+     *    block of their own.  [Default 1MB]
+     */
+    explicit Arena( const std::size_t & block_size = 1u << 20 )
+      : blocks(), next_block(0), top(NULL), end(NULL),
+        block_size(block_size), allocated(0) { }
+
+    ~Arena() { release(); }
+
+    /** Allocate n bytes aligned to align (a power of two). */
+    void * allocate( std::size_t n, const std::size_t & align = sizeof(long) ) {
+      if ( n == 0 )
+        n = 1;
+
+      char * p = alignUp( top, align );
+      if ( p > end || std::size_t(end - p) < n )
+        p = nextBlock( n, align );
+
+      top = p + n;
+      allocated += n;
+      return p;
+    }
+
+    /** Make all memory available again (keeping the blocks). */
+    void reset() {
+      next_block = 0;
+      top = end = NULL;
+      allocated = 0;
+    }
+
+    /** Reset and give all blocks back to the system. */
+    void release() {
+      for ( std::size_t i = 0; i < blocks.size(); ++i )
+        std::free( blocks[i].begin );
+      blocks.clear();
+      reset();
+    }
+
+    /** Bytes handed out since the last reset(). */
+    std::size_t size() const { return allocated; }
+
+    /** Total size of the blocks owned by this arena. */
+    std::size_t capacity() const {
+      std::size_t c = 0;
+      for ( std::size_t i = 0; i < blocks.size(); ++i )
+        c += blocks[i].size;
+      return c;
+    }
+
+  private:
+    /* not copyable */
+    Arena( const Arena & );
+    Arena & operator=( const Arena & );
+
+    static char * alignUp( char * p, const std::size_t & align ) {
+      return reinterpret_cast<char*>(
+        ( reinterpret_cast<std::size_t>(p) + align - 1u ) & ~(align - 1u)
+      );
+    }
+
+    /** Move on to the next kept block that can hold n bytes, or get a new
+     * one from the system. */
+    char * nextBlock( const std::size_t & n, const std::size_t & align ) {
+      const std::size_t need = n + align - 1u;
+      while ( next_block < blocks.size() && blocks[next_block].size < need )
+        ++next_block;
+
+      if ( next_block == blocks.size() ) {
+        Block b;
+        b.size = need > block_size ? need : block_size;
+        b.begin = static_cast<char*>( std::malloc( b.size ) );
+        if ( !b.begin ) {
+          logger::log_severe("arena could not allocate a block of %lu bytes",
+                             static_cast<unsigned long>(b.size));
+          throw std::bad_alloc();
+        }
+        blocks.push_back( b );
+      }
+
+      const Block & b = blocks[next_block++];
+      end = b.begin + b.size;
+      return alignUp( b.begin, align );
+    }
+  };
+
+
+  /** STL allocator handle that draws from an Arena.  deallocate does nothing
+   * (memory comes back with Arena::reset()).  Handles compare equal when they
+   * refer to the same arena. */
+  template < typename T >
+  class arena_allocator {
+    /* TYPEDEFS */
+  public:
+    typedef T                 value_type;
+    typedef value_type*       pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type&       reference;
+    typedef const value_type& const_reference;
+    typedef std::size_t       size_type;
+    typedef std::ptrdiff_t    difference_type;
+
+    /** Required rebind template creates a new arena_allocator that supports
+     * a different type (from the same arena). */
+    template < typename T2 >
+    struct rebind {
+      typedef arena_allocator<T2> other;
+    };
+
+    /* MEMBER STORAGE */
+  public:
+    /** The arena that memory is drawn from. */
+    Arena * arena;
+
+    /* MEMBER FUNCTIONS */
+  public:
+    /** Constructor binds this handle to an arena. */
+    explicit arena_allocator( Arena & arena ) : arena( &arena ) { }
+
+    /** Copy constructor from allocator of different type--required by stl
+     * containers. */
+    template < typename T1 >
+    arena_allocator( const arena_allocator<T1> & other )
+      : arena( other.arena ) { }
+
+    pointer address(reference x) const {
+      return &x;
+    }
+
+    const_pointer address(const_reference x) const {
+      return &x;
+    }
+
+    pointer allocate(size_type n, std::allocator<void>::const_pointer p = 0) {
+      return static_cast<pointer>(
+        arena->allocate( n * sizeof(T), detail::alignment_of<T>::value )
+      );
+    }
+
+    /** Does nothing; see Arena::reset(). */
+    void deallocate(pointer p, size_type n = 1) { }
+
+    void construct(pointer p, const T& t = T()) {
+      new(p) T(t);
+    }
+
+    void destroy(pointer p) {
+      p->~T();
+    }
+
+    size_type max_size() const {
+      return static_cast<size_type>(-1) / sizeof(value_type);
+    }
+  };
+
+  template < typename T1, typename T2 >
+  inline bool operator==( const arena_allocator<T1> & lhs,
+                          const arena_allocator<T2> & rhs ) {
+    return lhs.arena == rhs.arena;
+  }
+
+  template < typename T1, typename T2 >
+  inline bool operator!=( const arena_allocator<T1> & lhs,
+                          const arena_allocator<T2> & rhs ) {
+    return lhs.arena != rhs.arena;
+  }
+
+
+  /** One Arena per thread, created on first use, so that worker threads
+   * never share a bump pointer.  With pthreads, a thread's arena is released
+   * when the thread exits.  Different Tag types give independent sets of
+   * per-thread arenas.
+   */
+  template < typename Tag = void >
+  struct ThreadArena {
+    /** The calling thread's arena. */
+    static Arena & local() {
+#ifdef XYLOSE_ARENA_THREAD_LOCAL
+      static __thread Arena * a = NULL;
+      if ( !a ) {
+        a = new Arena;
+#  ifdef USE_PTHREAD
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once( &once, &ThreadArena::createKey );
+        pthread_setspecific( key(), a );
+#  endif
+      }
+      return *a;
+#else
+      static Arena a;
+      return a;
+#endif
+    }
+
+    /** Reset the calling thread's arena. */
+    static void reset() {
+      local().reset();
+    }
+
+#ifdef USE_PTHREAD
+  private:
+    static pthread_key_t & key() {
+      static pthread_key_t k;
+      return k;
+    }
+
+    static void createKey() {
+      pthread_key_create( &key(), &ThreadArena::destroy );
+    }
+
+    static void destroy( void * a ) {
+      delete static_cast<Arena*>( a );
+    }
+#endif
+  };
+
+
+  /** Stateless STL allocator that draws from the calling thread's
+   * ThreadArena<Tag>.  As with arena_allocator, deallocate does nothing; the
+   * memory comes back with ThreadArena<Tag>::reset() on the thread that
+   * allocated it. */
+  template < typename T, typename Tag = void >
+  class thread_arena_allocator {
+    /* TYPEDEFS */
+  public:
+    typedef T                 value_type;
+    typedef value_type*       pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type&       reference;
+    typedef const value_type& const_reference;
+    typedef std::size_t       size_type;
+    typedef std::ptrdiff_t    difference_type;
+
+    template < typename T2 >
+    struct rebind {
+      typedef thread_arena_allocator<T2,Tag> other;
+    };
+
+    /* MEMBER FUNCTIONS */
+  public:
+    thread_arena_allocator() { }
+
+    template < typename T1 >
+    thread_arena_allocator( const thread_arena_allocator<T1,Tag> & other ) { }
+
+    pointer address(reference x) const {
+      return &x;
+    }
+
+    const_pointer address(const_reference x) const {
+      return &x;
+    }
+
+    pointer allocate(size_type n, std::allocator<void>::const_pointer p = 0) {
+      return static_cast<pointer>(
+        ThreadArena<Tag>::local().allocate(
+          n * sizeof(T), detail::alignment_of<T>::value )
+      );
+    }
+
+    /** Does nothing; see ThreadArena::reset(). */
+    void deallocate(pointer p, size_type n = 1) { }
+
+    void construct(pointer p, const T& t = T()) {
+      new(p) T(t);
+    }
+
+    void destroy(pointer p) {
+      p->~T();
+    }
+
+    size_type max_size() const {
+      return static_cast<size_type>(-1) / sizeof(value_type);
+    }
+  };
+
+  template < typename T1, typename T2, typename Tag >
+  inline bool operator==( const thread_arena_allocator<T1,Tag> &,
+                          const thread_arena_allocator<T2,Tag> & ) {
+    return true;
+  }
+
+  template < typename T1, typename T2, typename Tag >
+  inline bool operator!=( const thread_arena_allocator<T1,Tag> &,
+                          const thread_arena_allocator<T2,Tag> & ) {
+    return false;
+  }
+
+}
+
+#endif // xylose_arena_allocator_h
@@ -0,0 +1,210 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+#ifndef xylose_detail_AdaptiveLock_h
+#define xylose_detail_AdaptiveLock_h
+
+#include <xylose/detail/atomic.h>
+
+#include <sched.h>
+
+#ifdef __linux__
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#  include <linux/futex.h>
+#endif
+
+namespace xylose {
+  namespace detail {
+
+    /** Hint to the cpu that the caller is spinning (pause on x86). */
+    inline void cpuRelax() {
+#if defined(__i386__) || defined(__x86_64__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+      __asm__ __volatile__( "yield" ::: "memory" );
+#else
+      __asm__ __volatile__( "" ::: "memory" );
+#endif
+    }
+
+    /** A mutual exclusion lock that spins for a short while and then blocks
+     * the calling thread in the kernel (on a futex on Linux; other systems
+     * yield the cpu instead).  Spinning alone wastes whole time slices when
+     * the holder of the lock has been preempted (e.g. with more threads than
+     * cores).
+     *
+     * The state is 0 (unlocked), 1 (locked) or 2 (locked and there may be
+     * blocked waiters); unlock() only enters the kernel in state 2 (see U.
+     * Drepper, "Futexes Are Tricky").
+     */
+    class AdaptiveLock {
+      /* MEMBER STORAGE */
+    private:
+      int state;
+
+      /* STATIC STORAGE */
+    public:
+      /** Number of pause instructions before a waiter blocks. */
+      static const int spin_limit = 128;
+
+      /* MEMBER FUNCTIONS */
+    public:
+      AdaptiveLock() : state(0) { }
+
+      /** Copies start unlocked. */
+      AdaptiveLock( const AdaptiveLock & ) : state(0) { }
+      AdaptiveLock & operator= ( const AdaptiveLock & ) { return *this; }
+
+      bool tryLock() {
+        return atomic::cas( &state, 0, 1, atomic::acquire, atomic::relaxed );
+      }
+
+      void lock() {
+        if ( !tryLock() )
+          lockSlow();
+      }
+
+      void unlock() {
+        if ( atomic::exchange( &state, 0, atomic::release ) == 2 )
+          wake();
+      }
+
+      bool isLocked() const {
+        return atomic::load( &state, atomic::relaxed ) != 0;
+      }
+
+    private:
+      void lockSlow() {
+        for ( int i = 0; i < spin_limit; ++i ) {
+          cpuRelax();
+          if ( atomic::load( &state, atomic::relaxed ) == 0 && tryLock() )
+            return;
+        }
+
+        /* announce a waiter (state 2) and block until the lock is free. */
+        while ( atomic::exchange( &state, 2, atomic::acquire ) != 0 )
+          wait();
+      }
+
+      /** Block while the state is 2. */
+      void wait() {
+#ifdef __linux__
+        syscall( SYS_futex, &state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0 );
+#else
+        sched_yield();
+#endif
+      }
+
+      /** Wake one blocked waiter. */
+      void wake() {
+#ifdef __linux__
+        syscall( SYS_futex, &state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0 );
+#endif
+      }
+    };
+
+    /** A reader-writer lock built on AdaptiveLock.  Readers only increment
+     * and decrement a counter unless a writer holds (or waits for) the lock;
+     * writers are serialized by an AdaptiveLock and then wait for the
+     * active readers to leave.  New readers back off while a writer is
+     * waiting, such that writers do not starve.
+     */
+    class AdaptiveSharedLock {
+      /* MEMBER STORAGE */
+    private:
+      /** Number of readers plus writer_bit while a writer holds or waits for
+       * the lock. */
+      int state;
+      AdaptiveLock writer;
+
+      /* STATIC STORAGE */
+    public:
+      enum { writer_bit = 1 << 30 };
+
+      /* MEMBER FUNCTIONS */
+    public:
+      AdaptiveSharedLock() : state(0), writer() { }
+
+      /** Copies start unlocked. */
+      AdaptiveSharedLock( const AdaptiveSharedLock & ) : state(0), writer() { }
+      AdaptiveSharedLock & operator= ( const AdaptiveSharedLock & ) {
+        return *this;
+      }
+
+      bool tryLockShared() {
+        if ( ( atomic::add( &state, 1, atomic::acquire ) & writer_bit ) == 0 )
+          return true;
+        atomic::sub( &state, 1, atomic::relaxed );
+        return false;
+      }
+
+      void lockShared() {
+        while ( !tryLockShared() )
+          waitWhile( writer_bit, writer_bit );
+      }
+
+      void unlockShared() {
+        atomic::sub( &state, 1, atomic::release );
+      }
+
+      bool tryLock() {
+        if ( !writer.tryLock() )
+          return false;
+        if ( atomic::cas( &state, 0, int(writer_bit),
+                          atomic::acquire, atomic::relaxed ) )
+          return true;
+        writer.unlock();
+        return false;
+      }
+
+      void lock() {
+        writer.lock();
+        atomic::add( &state, int(writer_bit), atomic::acquire );
+        waitWhile( ~writer_bit, 1 );
+      }
+
+      void unlock() {
+        atomic::sub( &state, int(writer_bit), atomic::release );
+        writer.unlock();
+      }
+
+      bool isLocked() const {
+        return atomic::load( &state, atomic::relaxed ) != 0;
+      }
+
+    private:
+      /** Spin (and then yield) while (state & mask) >= min. */
+      void waitWhile( const int mask, const int min ) const {
+        for ( int i = 0;
+              ( atomic::load( &state, atomic::acquire ) & mask ) >= min; ++i ) {
+          if ( i < AdaptiveLock::spin_limit )
+            cpuRelax();
+          else
+            sched_yield();
+        }
+      }
+    };
+
+  } /* namespace xylose::detail */
+} /* namespace xylose */
+
+#endif // xylose_detail_AdaptiveLock_h
@@ -0,0 +1,175 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_detail_WorkStealingDeque_h
+#define xylose_detail_WorkStealingDeque_h
+
+#include <xylose/detail/atomic.h>
+
+#include <vector>
+
+namespace xylose {
+  namespace detail {
+
+    /** Chase-Lev work-stealing deque of pointers.
+     * The owner thread pushes and pops at the bottom (LIFO) without locking;
+     * any other thread may steal from the top (FIFO).  The memory orders
+     * follow Le, Pop, Cohen, and Zappa Nardelli, "Correct and efficient
+     * work-stealing for weak memory models" (PPoPP 2013).
+     *
+     * The circular array grows as needed.  Since a thief may still read an
+     * old array, replaced arrays are only freed by the destructor (the
+     * total is less than the final array).
+     *
+     * @tparam T
+     *    Pointer type of the elements; a null pointer means "no element".
+     */
+    template < typename T >
+    class WorkStealingDeque {
+      /* TYPEDEFS */
+    private:
+      struct Array {
+        long mask;
+        T * buf;
+
+        Array( const long & size ) : mask( size - 1 ), buf( new T[size] ) { }
+        ~Array() { delete[] buf; }
+
+        long size() const { return mask + 1; }
+
+        T get( const long & i ) const {
+          return atomic::load( buf + ( i & mask ), atomic::relaxed );
+        }
+
+        void put( const long & i, const T & x ) {
+          atomic::store( buf + ( i & mask ), x, atomic::relaxed );
+        }
+      };
+
+
+      /* MEMBER STORAGE */
+    private:
+      long top;
+      long bottom;
+      Array * array;
+      std::vector<Array *> garbage;
+
+
+      /* MEMBER FUNCTIONS */
+    public:
+      /** Constructor.
+       * @param size
+       *    Initial capacity; must be a power of two. [Default 256]
+       */
+      WorkStealingDeque( const long & size = 256 )
+        : top( 0 ), bottom( 0 ), array( new Array( size ) ) { }
+
+      ~WorkStealingDeque() {
+        delete array;
+        for ( unsigned int i = 0u; i < garbage.size(); ++i )
+          delete garbage[i];
+      }
+
+      /** Push an element at the bottom (owner only). */
+      void push( const T & x ) {
+        const long b = atomic::load( &bottom, atomic::relaxed );
+        const long t = atomic::load( &top, atomic::acquire );
+        Array * a = atomic::load( &array, atomic::relaxed );
+        if ( b - t > a->mask )
+          a = grow( a, t, b );
+        a->put( b, x );
+        atomic::fence( atomic::release );
+        atomic::store( &bottom, b + 1, atomic::relaxed );
+      }
+
+      /** Pop the element at the bottom (owner only).
+       * @return the element or a null pointer if the deque is empty.
+       */
+      T pop() {
+        const long b = atomic::load( &bottom, atomic::relaxed ) - 1;
+        Array * a = atomic::load( &array, atomic::relaxed );
+        atomic::store( &bottom, b, atomic::relaxed );
+        atomic::fence( atomic::seq_cst );
+        long t = atomic::load( &top, atomic::relaxed );
+
+        T x = T();
+        if ( t <= b ) {
+          x = a->get( b );
+          if ( t == b ) {
+            /* last element:  race against the thieves for it. */
+            if ( !atomic::cas( &top, t, t + 1,
+                               atomic::seq_cst, atomic::relaxed ) )
+              x = T();
+            atomic::store( &bottom, b + 1, atomic::relaxed );
+          }
+        } else
+          atomic::store( &bottom, b + 1, atomic::relaxed );
+        return x;
+      }
+
+      /** Steal the element at the top (any thread).
+       * @return the element or a null pointer if the deque is empty or the
+       *    race for the element was lost.
+       */
+      T steal() {
+        long t = atomic::load( &top, atomic::acquire );
+        atomic::fence( atomic::seq_cst );
+        const long b = atomic::load( &bottom, atomic::acquire );
+
+        if ( t < b ) {
+          Array * a = atomic::load( &array, atomic::acquire );
+          T x = a->get( t );
+          if ( atomic::cas( &top, t, t + 1, atomic::seq_cst, atomic::relaxed ) )
+            return x;
+        }
+        return T();
+      }
+
+      /** Approximate number of elements (exact for the owner when no
+       * thief is active). */
+      long size() const {
+        const long b = atomic::load( &bottom, atomic::relaxed );
+        const long t = atomic::load( &top, atomic::relaxed );
+        return b > t ? b - t : 0;
+      }
+
+      bool empty() const { return size() == 0; }
+
+    private:
+      /** Copying is not allowed. */
+      WorkStealingDeque( const WorkStealingDeque & );
+      WorkStealingDeque & operator= ( const WorkStealingDeque & );
+
+      Array * grow( Array * a, const long & t, const long & b ) {
+        Array * n = new Array( 2 * a->size() );
+        for ( long i = t; i < b; ++i )
+          n->put( i, a->get( i ) );
+        garbage.push_back( a );
+        atomic::store( &array, n, atomic::release );
+        return n;
+      }
+    };
+
+  }/* namespace xylose::detail */
+}/* namespace xylose */
+
+#endif // xylose_detail_WorkStealingDeque_h
@@ -0,0 +1,244 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+#ifndef xylose_detail_affinity_h
+#define xylose_detail_affinity_h
+
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace xylose {
+  namespace detail {
+    /** Cpu topology (read from Linux sysfs) and thread pinning for the thread
+     * cache.  On other systems no topology is known and pinning does
+     * nothing. */
+    namespace affinity {
+
+      /** Location of a logical cpu. */
+      struct Cpu {
+        int id;      /**< logical cpu number. */
+        int package; /**< physical package (socket). */
+        int core;    /**< core within the package. */
+        int node;    /**< NUMA node (0 if unknown). */
+
+        Cpu( const int & id = 0, const int & package = 0,
+             const int & core = 0, const int & node = 0 )
+          : id(id), package(package), core(core), node(node) { }
+      };
+
+      /** Parse a cpu list such as "0-3,8,10-11".
+       * @return the listed cpus in the given order, or an empty vector if
+       *    the string is not a valid list. */
+      inline std::vector<int> parseCpuList( const std::string & s ) {
+        std::vector<int> cpus;
+        const char * p = s.c_str();
+        while ( *p ) {
+          char * e;
+          const long a = std::strtol( p, &e, 10 );
+          if ( e == p || a < 0 )
+            return std::vector<int>();
+          long b = a;
+          p = e;
+          if ( *p == '-' ) {
+            b = std::strtol( ++p, &e, 10 );
+            if ( e == p || b < a )
+              return std::vector<int>();
+            p = e;
+          }
+          for ( long c = a; c <= b; ++c )
+            cpus.push_back( static_cast<int>(c) );
+          if ( *p == ',' )
+            ++p;
+          else if ( *p && *p != '\n' )
+            return std::vector<int>();
+          else
+            break;
+        }
+        return cpus;
+      }
+
+      /** Read a single integer from a (sysfs) file. */
+      inline bool readInt( const std::string & file, int & value ) {
+        FILE * f = std::fopen( file.c_str(), "r" );
+        if ( !f )
+          return false;
+        const bool ok = std::fscanf( f, "%d", &value ) == 1;
+        std::fclose( f );
+        return ok;
+      }
+
+      /** Read a cpu list from a (sysfs) file. */
+      inline std::vector<int> readCpuList( const std::string & file ) {
+        FILE * f = std::fopen( file.c_str(), "r" );
+        if ( !f )
+          return std::vector<int>();
+        char buf[4096];
+        const bool ok = std::fgets( buf, sizeof(buf), f ) != NULL;
+        std::fclose( f );
+        return ok ? parseCpuList( buf ) : std::vector<int>();
+      }
+
+      /** The cpus that the calling process may run on, with their
+       * topology, ordered by cpu number. */
+      inline std::vector<Cpu> getCpus() {
+        std::vector<Cpu> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        if ( sched_getaffinity( 0, sizeof(set), &set ) != 0 )
+          return cpus;
+
+        /* NUMA node of each cpu. */
+        std::map<int,int> node_of;
+        const std::string node_dir = "/sys/devices/system/node";
+        if ( DIR * d = opendir( node_dir.c_str() ) ) {
+          while ( struct dirent * e = readdir( d ) ) {
+            int node;
+            if ( std::sscanf( e->d_name, "node%d", &node ) != 1 )
+              continue;
+            const std::vector<int> l =
+              readCpuList( node_dir + '/' + e->d_name + "/cpulist" );
+            for ( unsigned int i = 0; i < l.size(); ++i )
+              node_of[ l[i] ] = node;
+          }
+          closedir( d );
+        }
+
+        for ( int c = 0; c < CPU_SETSIZE; ++c ) {
+          if ( !CPU_ISSET( c, &set ) )
+            continue;
+
+          char dir[64];
+          std::sprintf( dir, "/sys/devices/system/cpu/cpu%d/topology/", c );
+          Cpu cpu( c, 0, c, node_of.count(c) ? node_of[c] : 0 );
+          readInt( std::string(dir) + "physical_package_id", cpu.package );
+          readInt( std::string(dir) + "core_id", cpu.core );
+          cpus.push_back( cpu );
+        }
+#endif
+        return cpus;
+      }
+
+      /** Ordering of the compact policy:  node, package, core, then the
+       * hardware threads of each core. */
+      struct CompactLess {
+        bool operator() ( const Cpu & a, const Cpu & b ) const {
+          if ( a.node != b.node )       return a.node < b.node;
+          if ( a.package != b.package ) return a.package < b.package;
+          if ( a.core != b.core )       return a.core < b.core;
+          return a.id < b.id;
+        }
+      };
+
+      /** Compact placement:  consecutive workers share cores, then packages,
+       * then NUMA nodes. */
+      inline std::vector<int> compactOrder( std::vector<Cpu> cpus ) {
+        std::sort( cpus.begin(), cpus.end(), CompactLess() );
+        std::vector<int> order;
+        for ( unsigned int i = 0; i < cpus.size(); ++i )
+          order.push_back( cpus[i].id );
+        return order;
+      }
+
+      /** Scatter placement:  consecutive workers go round-robin over the
+       * (node, package) domains; within each domain the first hardware
+       * thread of every core is used before the second one and so on. */
+      inline std::vector<int> scatterOrder( std::vector<Cpu> cpus ) {
+        std::sort( cpus.begin(), cpus.end(), CompactLess() );
+
+        /* rank of each cpu among the hardware threads of its core and the
+         * cpus of each domain. */
+        typedef std::pair<int,int> Domain;
+        std::map< Domain, std::vector< std::pair<int,int> > > domains;
+        for ( unsigned int i = 0; i < cpus.size(); ++i ) {
+          int rank = 0;
+          for ( unsigned int j = i; j > 0 &&
+                cpus[j-1].node == cpus[i].node &&
+                cpus[j-1].package == cpus[i].package &&
+                cpus[j-1].core == cpus[i].core; --j )
+            ++rank;
+          domains[ Domain( cpus[i].node, cpus[i].package ) ].push_back(
+            std::make_pair( rank, i ) );
+        }
+
+        std::vector< std::vector<int> > lists;
+        for ( std::map< Domain, std::vector< std::pair<int,int> > >::iterator
+              d = domains.begin(); d != domains.end(); ++d ) {
+          /* stable: cores keep their compact order within each rank. */
+          std::stable_sort( d->second.begin(), d->second.end() );
+          lists.push_back( std::vector<int>() );
+          for ( unsigned int k = 0; k < d->second.size(); ++k )
+            lists.back().push_back( cpus[ d->second[k].second ].id );
+        }
+
+        std::vector<int> order;
+        for ( unsigned int k = 0; order.size() < cpus.size(); ++k )
+          for ( unsigned int l = 0; l < lists.size(); ++l )
+            if ( k < lists[l].size() )
+              order.push_back( lists[l][k] );
+        return order;
+      }
+
+      /** NUMA node of a cpu (-1 if the cpu is not known). */
+      inline int nodeOf( const std::vector<Cpu> & cpus, const int & cpu ) {
+        for ( unsigned int i = 0; i < cpus.size(); ++i )
+          if ( cpus[i].id == cpu )
+            return cpus[i].node;
+        return -1;
+      }
+
+      /** Restrict a thread to a set of cpus.
+       * @return true on success. */
+      inline bool pin( const pthread_t & thread, const std::vector<int> & cpus ) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        for ( unsigned int i = 0; i < cpus.size(); ++i ) {
+          if ( cpus[i] < 0 || cpus[i] >= CPU_SETSIZE )
+            return false;
+          CPU_SET( cpus[i], &set );
+        }
+        return !cpus.empty() &&
+               pthread_setaffinity_np( thread, sizeof(set), &set ) == 0;
+#else
+        return false;
+#endif
+      }
+
+      /** Restrict a thread to a single cpu.
+       * @return true on success. */
+      inline bool pin( const pthread_t & thread, const int & cpu ) {
+        return pin( thread, std::vector<int>( 1, cpu ) );
+      }
+
+    } /* namespace xylose::detail::affinity */
+  } /* namespace xylose::detail */
+} /* namespace xylose */
+
+#endif // xylose_detail_affinity_h
@@ -0,0 +1,88 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_detail_atomic_h
+#define xylose_detail_atomic_h
+
+namespace xylose {
+  namespace detail {
+    /** Thin wrappers around the GCC __atomic builtins (also provided by
+     * clang and icc) for the lock-free parts of the thread cache.  The
+     * default memory order is sequentially consistent; the orders are
+     * the same as those of C++11. */
+    namespace atomic {
+
+      enum order {
+        relaxed = __ATOMIC_RELAXED,
+        acquire = __ATOMIC_ACQUIRE,
+        release = __ATOMIC_RELEASE,
+        acq_rel = __ATOMIC_ACQ_REL,
+        seq_cst = __ATOMIC_SEQ_CST
+      };
+
+      template < typename T >
+      inline T load( const T * p, const order & o = seq_cst ) {
+        return __atomic_load_n( p, o );
+      }
+
+      template < typename T >
+      inline void store( T * p, const T & v, const order & o = seq_cst ) {
+        __atomic_store_n( p, v, o );
+      }
+
+      /** Add v to *p and return the new value. */
+      template < typename T >
+      inline T add( T * p, const T & v, const order & o = seq_cst ) {
+        return __atomic_add_fetch( p, v, o );
+      }
+
+      /** Subtract v from *p and return the new value. */
+      template < typename T >
+      inline T sub( T * p, const T & v, const order & o = seq_cst ) {
+        return __atomic_sub_fetch( p, v, o );
+      }
+
+      /** Store v into *p and return the old value. */
+      template < typename T >
+      inline T exchange( T * p, const T & v, const order & o = seq_cst ) {
+        return __atomic_exchange_n( p, v, o );
+      }
+
+      /** Strong compare-and-swap:  if *p == expected, store desired and
+       * return true; otherwise return false. */
+      template < typename T >
+      inline bool cas( T * p, T expected, const T & desired,
+                       const order & success = seq_cst,
+                       const order & failure = relaxed ) {
+        return __atomic_compare_exchange_n( p, &expected, desired, false,
+                                            success, failure );
+      }
+
+      inline void fence( const order & o = seq_cst ) {
+        __atomic_thread_fence( o );
+      }
+
+    }/* namespace xylose::detail::atomic */
+  }/* namespace xylose::detail */
+}/* namespace xylose */
+
+#endif // xylose_detail_atomic_h
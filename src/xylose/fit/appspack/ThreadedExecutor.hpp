@@ -38,6 +38,7 @@
 
 #include <xylose/strutil.h>
 #include <xylose/PThreadCache.h>
+#include <xylose/PThreadTaskPool.h>
 
 #include <appspack/APPSPACK_Executor_Interface.hpp> // Abstract interface for class
 
@@ -60,13 +61,13 @@ namespace xylose {
           const MinFunc & minFunc;
 
           /** MinFunc function input. */
-          const APPSPACK::Vector x;
+          APPSPACK::Vector x;
 
           /** MinFunc function output. */
           APPSPACK::Vector f;
 
           /** Task tag. */
-          const int tag;
+          int tag;
 
           /** Success/Error message. */
           std::string msg_out;
@@ -75,10 +76,16 @@ namespace xylose {
 
           /* MEMBER FUNCTIONS */
           /** APPSPACK Task constructor. */
-          Task( const MinFunc & minFunc,
-                const APPSPACK::Vector & x,
-                const int & tag )
-            : minFunc(minFunc), x(x), f(), tag(tag) { }
+          Task( const MinFunc & minFunc )
+            : minFunc(minFunc), x(), f(), tag(0) { }
+
+          /** Prepare a (possibly recycled) task for the next evaluation. */
+          void set( const APPSPACK::Vector & x_in, const int & tag_in ) {
+            x = x_in;
+            f = APPSPACK::Vector();
+            tag = tag_in;
+            msg_out.clear();
+          }
 
           /** APPSPACK Task virtual destructor. */
           virtual ~Task() { }
@@ -95,7 +102,6 @@ namespace xylose {
           }/* exec() */
         };
 
-        typedef xylose::PThreadTaskSet PThreadTaskSet;
 
 
         /* MEMBER STORAGE */
@@ -103,8 +109,11 @@ namespace xylose {
         /** Reference to MinFunc functor object. */
         const MinFunc & minFunc;
 
-        PThreadTaskSet queued_tasks;
-        PThreadTaskSet finished_tasks;
+        /** Recycled task objects. */
+        xylose::PThreadTaskPool<Task> pool;
+
+        /** The queued (and finished, but not yet received) tasks. */
+        xylose::PThreadTaskGroup tasks;
 
 
 
@@ -113,10 +122,15 @@ namespace xylose {
       public:
         /** Constuctor for ThreadExecutor. */
         ThreadedExecutor( const MinFunc & minFunc)
-          : minFunc(minFunc), queued_tasks(), finished_tasks() { }
+          : minFunc(minFunc), pool(), tasks( pthreadCache ) { }
 
         /** Destuctor for ThreadExecutor. */
-        virtual ~ThreadedExecutor() { }
+        virtual ~ThreadedExecutor() {
+          /* recycle (and thereby free) the tasks that were not received. */
+          xylose::PThreadTask * t;
+          while ( ( t = tasks.waitAny() ) != NULL )
+            pool.put( t );
+        }
 
         /** Returns true if there is a worker free; otherwise, returns false.
          * Since this implementation uses a task queue, we'll always return true.
@@ -125,9 +139,9 @@ namespace xylose {
 
         //! Spawns a point on a free worker and returns true if successful; otherwise, returns false
         virtual bool spawn(const APPSPACK::Vector& x_in, int tag_in) {
-          Task * t = new Task( minFunc, x_in, tag_in );
-          queued_tasks.insert(t);
-          pthreadCache.addTask(t);
+          Task * t = pool.get( minFunc );
+          t->set( x_in, tag_in );
+          tasks.add( t );
           return true;
         }
 
@@ -141,42 +155,19 @@ namespace xylose {
           even for successful evaluations, e.g., "success".
         */
         virtual int recv(int& tag_out, APPSPACK::Vector& f_out, std::string& msg_out) {
-          Task * t = NULL;
-
-          if ( finished_tasks.size() > 0 ) {
-            t = static_cast<Task*>( * finished_tasks.begin() );
-            finished_tasks.erase( t );
-
-          } else if ( queued_tasks.size() > 0 ) {
-            PThreadTaskSet finished = pthreadCache.waitForTasks(queued_tasks);
-            {
-              /* let's make sure that we remove the finished tasks from the queue
-               * list */
-              PThreadTaskSet tmp;
-              std::set_difference(queued_tasks.begin(), queued_tasks.end(),
-                                  finished.begin(), finished.end(),
-                                  inserter(tmp, tmp.begin()));
-              queued_tasks.swap(tmp);
-            }
-
-            t = static_cast<Task*>( * finished.begin() );
-            finished.erase( t );
-            /* now add the remaining items to the finished_tasks array for later
-             * retrieval. */
-            finished_tasks.insert( finished.begin(), finished.end() );
-
-          } else {
+          Task * t = static_cast<Task*>( tasks.waitAny() );
+
+          if ( t == NULL ) {
             msg_out = "no tasks to complete";
             return 0;
           }
 
-
           tag_out = t->tag;
           f_out = t->f;
           msg_out = t->msg_out;
 
-          /* we can now free the task memory. */
-          delete t;
+          /* the task object can now be reused. */
+          pool.put( t );
 
           return 1;
         }
@@ -37,11 +37,19 @@
 #define xylose_nsort_NSort_h
 
 #include <xylose/nsort/map/direct.h>
+#include <xylose/nsort/map/detail/batch_keys.h>
+#include <xylose/nsort/detail/aligned_buffer.h>
 #include <xylose/nsort/tweak/Null.h>
 #include <xylose/ref_of.h>
 
+#include <boost/cstdint.hpp>
+
 #include <ostream>
+#include <vector>
+#include <memory>
+#include <iterator>
 #include <algorithm>
+#include <cstddef>
 
 namespace xylose {
 
@@ -60,27 +68,98 @@ namespace xylose {
      *    Optional class to allow the user code to tweak the map according to
      *    the preliminary counting statistics. <br>
      *    [Default nsort::tweak::Null]
+     *
+     * @tparam Allocator
+     *    Allocator (rebound as necessary) for the bucket array and for the
+     *    workspace of the sort.  The workspace (start positions, cached keys,
+     *    write-combining buffers, ...) is owned by the NSort instance and only
+     *    grows, so that repeated sorts of no more items than before do not
+     *    allocate at all. <br>
+     *    [Default std::allocator<int>]
      */
     template < typename val_map = map::direct,
-               typename NSortTweaker = tweak::Null >
+               typename NSortTweaker = tweak::Null,
+               typename Allocator = std::allocator<int> >
     class NSort {
-    private:
+      /* TYPEDEFS */
+    public:
+      typedef Allocator allocator_type;
+
+    protected:
+      typedef std::vector< int, Allocator > int_vector;
+
+      typedef typename Allocator::template rebind<boost::uint32_t>::other
+        key_allocator;
+      typedef std::vector< boost::uint32_t, key_allocator > key_vector;
+
+      /* raw storage for staged items (see detail::aligned_buffer). */
+      typedef typename Allocator::template rebind<double>::other
+        stage_allocator;
+      typedef std::vector< double, stage_allocator > stage_vector;
+
+    public:
+      /** Assumed size of a cache line (used for write-combining). */
+      static const unsigned int cache_line_bytes = 64u;
+
+      /** Upper limit of the memory used for all write-combining buffers. */
+      static const unsigned int max_staging_bytes = 256u * 1024u;
+
+    protected:
       int n_values;
-      int * bin;
+      int_vector bin;
+
+    private:
+      bool write_combining;
+
+      /* workspace that is reused between calls. */
+      int_vector work_ptr;
+      int_vector work_aux;
+      int_vector work_aux2;
+      int_vector migrants;
+      int_vector wrong;
+      key_vector key_store;
+      stage_vector stage_store;
 
     public:
       /** Constructor allocates the specified number of buckets. */
-      NSort(const int & n_values) : n_values (n_values) {
-        bin = new int[n_values];
+      NSort(const int & n_values, const Allocator & alloc = Allocator())
+        : n_values (n_values),
+          bin( std::max(n_values, 1), 0, alloc ),
+          write_combining(false),
+          work_ptr( n_values + 1, 0, alloc ),
+          work_aux( n_values + 1, 0, alloc ),
+          work_aux2( n_values + 1, 0, alloc ),
+          migrants( alloc ),
+          wrong( alloc ),
+          key_store( key_allocator(alloc) ),
+          stage_store( stage_allocator(alloc) ) { }
+
+      /** Get the number of bins/values used in this sort. */
+      inline const int & size() const { return n_values; }
+
+      /** Change the number of bins/values used in this sort.  The bucket
+       * offsets are reset (begin(i)/end(i) are invalid until the next sort)
+       * and the workspace is only reallocated if it is too small. */
+      void resize(const int & n_values) {
+        this->n_values = n_values;
+        bin.assign( std::max(n_values, 1), 0 );
+        grow( work_ptr,  n_values + 1 );
+        grow( work_aux,  n_values + 1 );
+        grow( work_aux2, n_values + 1 );
       }
 
-      /** Destructor frees the buckets. */
-      ~NSort() {
-        delete[] bin;
+      /** Pre-allocate the workspace needed to sort up to n_items items (with
+       * any of the sort functions) so that not even the first sort allocates.
+       * The write-combining buffers of stable_sort_copy are allocated on
+       * first use. */
+      void reserve(const int & n_items) {
+        key_buffer< boost::uint32_t >( n_items );
+        migrants.reserve( n_items );
+        wrong.reserve( n_items );
       }
 
-      /** Get the number of bins/values used in this sort. */
-      inline const int & size() const { return n_values; }
+      /** The allocator of the bucket array and workspace. */
+      allocator_type get_allocator() const { return bin.get_allocator(); }
 
       /** Obtain the index of the end() element of the ith value.
        * Note that i should conform to 0 <= i < n_values; there is no bound
@@ -122,10 +201,10 @@ namespace xylose {
       template <class Iter>
       void sort(const Iter & Ai, const Iter & Af,
                 val_map & map, NSortTweaker & nsortTweaker ) {
-        int * ptr = new int[n_values];
+        int * const ptr = &work_ptr[0];
 
         using std::fill;
-        fill(bin, bin + n_values, 0);
+        fill(bin.begin(), bin.end(), 0);
         fill(ptr, ptr + n_values, 0);
 
         /* first count the number of occurrences for each value. */
@@ -134,7 +213,8 @@ namespace xylose {
 
         /* Allow user code to tweak the map according to the preliminary
          * counting statistics. */
-        nsortTweaker.tweakNSort(map, bin, static_cast<const int&>(n_values));
+        nsortTweaker.tweakNSort(map, static_cast<const int*>(&bin[0]),
+                                static_cast<const int&>(n_values));
 
         /* now change this array of occurrences to an array of start
          * positions. */
@@ -159,9 +239,433 @@ namespace xylose {
             std::iter_swap(Ai+pos, Ai + pos2++);
           }/*while*/
         }/*for*/
-
-        delete[] ptr;
       }/*sort()*/
+
+      /** Overload of cached_sort for using default constructed value map and
+       * tweaker.  This function subsequently calls the other overload of
+       * cached_sort().
+       */
+      template <class Iter>
+      void cached_sort(const Iter & Ai, const Iter & Af,
+                       const val_map & map = val_map(),
+                       const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        cached_sort(Ai,Af,mapcopy,tweakcopy);
+      }
+
+      /** Sort the items within the range [Ai,Af) using the specified value map
+       * and NSort tweaker, evaluating the map only once per item.
+       * The bucket of each item is stored in a compact key array during the
+       * counting pass and the permutation is driven entirely by this array.
+       * The key array uses the smallest of uint8/uint16/uint32 that can hold
+       * n_values, and therefore costs between one and four bytes per item.
+       *
+       * Note that the map is evaluated before the tweaker is called; the
+       * tweaker must not change the bucket of an item that has already been
+       * counted.
+       */
+      template <class Iter>
+      void cached_sort(const Iter & Ai, const Iter & Af,
+                       val_map & map, NSortTweaker & nsortTweaker ) {
+        if ( n_values <= 0x100 )
+          cached_sort_impl< boost::uint8_t  >( Ai, Af, map, nsortTweaker );
+        else if ( n_values <= 0x10000 )
+          cached_sort_impl< boost::uint16_t >( Ai, Af, map, nsortTweaker );
+        else
+          cached_sort_impl< boost::uint32_t >( Ai, Af, map, nsortTweaker );
+      }
+
+      /** Overload of stable_sort_copy for using default constructed value map
+       * and tweaker.  This function subsequently calls the other overload of
+       * stable_sort_copy().
+       */
+      template <class Iter, class OIter>
+      void stable_sort_copy(const Iter & Ai, const Iter & Af, const OIter & Bi,
+                            const val_map & map = val_map(),
+                            const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        stable_sort_copy(Ai,Af,Bi,mapcopy,tweakcopy);
+      }
+
+      /** Stable, out-of-place sort of the items within the range [Ai,Af) into
+       * the range [Bi, Bi + (Af-Ai)) using the specified value map and NSort
+       * tweaker.
+       * The source is read sequentially and each item is written exactly once
+       * to the (already constructed) destination range.  The destination
+       * serves as the scratch buffer of the sort and can be reused between
+       * calls by ping-ponging:  sort from buffer A into buffer B, use B, and
+       * then sort from B back into A on the next call (e.g. std::vector::swap
+       * on the owning containers).
+       *
+       * If write combining is enabled (see set_write_combining), items are
+       * first staged in small per-bucket buffers that are flushed to the
+       * destination in cache-line sized chunks.
+       *
+       * As with cached_sort, the map is evaluated once per item, before the
+       * tweaker is called.
+       */
+      template <class Iter, class OIter>
+      void stable_sort_copy(const Iter & Ai, const Iter & Af, const OIter & Bi,
+                            val_map & map, NSortTweaker & nsortTweaker ) {
+        if ( n_values <= 0x100 )
+          stable_sort_copy_impl< boost::uint8_t  >( Ai, Af, Bi,
+                                                    map, nsortTweaker );
+        else if ( n_values <= 0x10000 )
+          stable_sort_copy_impl< boost::uint16_t >( Ai, Af, Bi,
+                                                    map, nsortTweaker );
+        else
+          stable_sort_copy_impl< boost::uint32_t >( Ai, Af, Bi,
+                                                    map, nsortTweaker );
+      }
+
+      /** Overload of permutation for using default constructed value map and
+       * tweaker.  This function subsequently calls the other overload of
+       * permutation().
+       */
+      template <class Iter, class PIter>
+      void permutation(const Iter & Ai, const Iter & Af, const PIter & Pi,
+                       const val_map & map = val_map(),
+                       const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        permutation(Ai,Af,Pi,mapcopy,tweakcopy);
+      }
+
+      /** Compute the stable sorting permutation of the items within the range
+       * [Ai,Af) without moving any of the items.
+       * Upon return, [Pi, Pi + (Af-Ai)) is the gather list of the sort:
+       * <code>*(Pi + j)</code> is the index (relative to Ai) of the item that
+       * belongs at sorted position j.  The bucket offsets are available
+       * through begin(i)/end(i) as for the other sorts.  The gather list can be
+       * applied to any number of parallel arrays with
+       * nsort::utility::apply_permutation or nsort::utility::PGather.
+       *
+       * As with cached_sort, the map is evaluated once per item, before the
+       * tweaker is called.
+       */
+      template <class Iter, class PIter>
+      void permutation(const Iter & Ai, const Iter & Af, const PIter & Pi,
+                       val_map & map, NSortTweaker & nsortTweaker ) {
+        if ( n_values <= 0x100 )
+          permutation_impl< boost::uint8_t  >( Ai, Af, Pi, map, nsortTweaker );
+        else if ( n_values <= 0x10000 )
+          permutation_impl< boost::uint16_t >( Ai, Af, Pi, map, nsortTweaker );
+        else
+          permutation_impl< boost::uint32_t >( Ai, Af, Pi, map, nsortTweaker );
+      }
+
+      /** Overload of resort for using default constructed value map and
+       * tweaker.  This function subsequently calls the other overload of
+       * resort().
+       */
+      template <class Iter>
+      void resort(const Iter & Ai, const Iter & Af,
+                  const val_map & map = val_map(),
+                  const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        resort(Ai,Af,mapcopy,tweakcopy);
+      }
+
+      /** Incrementally re-sort the items within the range [Ai,Af) that were
+       * previously sorted by this instance (by any of the sort functions).
+       * The previous bucket boundaries are kept.  The map is evaluated once
+       * for each item to find the migrants (items whose bucket changed) and a
+       * delta histogram of the migrants yields the new bucket boundaries.
+       * Only the migrants and the items that are left outside of their
+       * bucket by a moved boundary are then swapped into place.  For nearly
+       * sorted ranges, the number of items moved is therefore proportional
+       * to the number of migrants instead of to the size of the range.
+       *
+       * If the previous boundaries do not describe a range of the same length
+       * (e.g. no sort has been done yet), a full cached_sort is done instead.
+       * This is not a stable sort.
+       */
+      template <class Iter>
+      void resort(const Iter & Ai, const Iter & Af,
+                  val_map & map, NSortTweaker & nsortTweaker ) {
+        if ( n_values <= 0x100 )
+          resort_impl< boost::uint8_t  >( Ai, Af, map, nsortTweaker );
+        else if ( n_values <= 0x10000 )
+          resort_impl< boost::uint16_t >( Ai, Af, map, nsortTweaker );
+        else
+          resort_impl< boost::uint32_t >( Ai, Af, map, nsortTweaker );
+      }
+
+      /** Enable/disable staging of items in per-bucket write-combining buffers
+       * for stable_sort_copy.  Staging is only used if at least two items fit
+       * in the (two cache line) staging buffer of a bucket and if the staging
+       * buffers of all buckets fit within max_staging_bytes; otherwise items
+       * are written directly to the destination. [Default false]
+       */
+      inline void set_write_combining( const bool & wc ) {
+        write_combining = wc;
+      }
+
+      /** Whether write-combining is requested for stable_sort_copy. */
+      inline const bool & get_write_combining() const {
+        return write_combining;
+      }
+
+    private:
+      /** Compute and cache the key of each item, count the occurrences of
+       * each value, call the tweaker, and then change bin[] to the end
+       * positions and ptr[] to the start positions of each value. */
+      template <class Key, class Iter>
+      void count_keys(const Iter & Ai, const Iter & Af, Key * keys, int * ptr,
+                      val_map & map, NSortTweaker & nsortTweaker ) {
+        using std::fill;
+        fill(bin.begin(), bin.end(), 0);
+
+        /* first compute the keys (with the batch function of the map if it
+         * has one) and count the number of occurrences for each value. */
+        xylose::nsort::map::detail::map_keys( map, Ai, Af, keys );
+        for (const Key * k = keys, * kf = keys + (Af - Ai); k < kf; ++k)
+          ++bin[*k];
+
+        /* Allow user code to tweak the map according to the preliminary
+         * counting statistics. */
+        nsortTweaker.tweakNSort(map, static_cast<const int*>(&bin[0]),
+                                static_cast<const int&>(n_values));
+
+        /* now change this array of occurrences to an array of start
+         * positions. */
+        for (int i = 0, cur_ptr = 0; i < n_values; ++i) {
+          ptr[i]   = cur_ptr;
+          cur_ptr += bin[i];
+          bin[i]   = cur_ptr;
+        }
+      }
+
+      /** Implementation of cached_sort for a particular key type. */
+      template <class Key, class Iter>
+      void cached_sort_impl(const Iter & Ai, const Iter & Af,
+                            val_map & map, NSortTweaker & nsortTweaker ) {
+        Key * const keys = key_buffer<Key>( Af - Ai );
+        int * const ptr = &work_ptr[0];
+
+        count_keys( Ai, Af, keys, ptr, map, nsortTweaker );
+
+        for (int i = 0; i < n_values; ++i) {
+          const int & end_pos = end(i);
+          int & pos = ptr[i];
+
+          while (pos < end_pos) {
+            const Key k = keys[pos];
+
+            if (static_cast<int>(k) == i) {
+              /* don't need to swap current position, move to next... */
+              pos++;
+              continue;
+            }
+
+            /* skip items that are already in their destination bucket. */
+            int & pos2 = ptr[k];
+            while (keys[pos2] == k)
+              ++pos2;
+
+            std::iter_swap(Ai + pos, Ai + pos2);
+            keys[pos] = keys[pos2];
+            keys[pos2++] = k;
+          }/*while*/
+        }/*for*/
+      }/*cached_sort_impl()*/
+
+      /** Implementation of stable_sort_copy for a particular key type. */
+      template <class Key, class Iter, class OIter>
+      void stable_sort_copy_impl(const Iter & Ai, const Iter & Af,
+                                 const OIter & Bi,
+                                 val_map & map, NSortTweaker & nsortTweaker ) {
+        typedef typename std::iterator_traits<Iter>::value_type value_type;
+
+        Key * const keys = key_buffer<Key>( Af - Ai );
+        int * const ptr = &work_ptr[0];
+
+        count_keys( Ai, Af, keys, ptr, map, nsortTweaker );
+
+        /* number of items that fill two cache lines. */
+        const int n_stage = std::max( 1, int( 2u * cache_line_bytes
+                                              / sizeof(value_type) ) );
+
+        if ( !write_combining || n_stage < 2 ||
+             n_values * n_stage * sizeof(value_type) > max_staging_bytes ) {
+          /* write directly to the destination. */
+          const Key * k = keys;
+          for (Iter i = Ai; i < Af; ++i, ++k)
+            *(Bi + ptr[*k]++) = *i;
+          return;
+        }
+
+        /* stage items per bucket and flush them in n_stage sized chunks. */
+        value_type * stage = detail::aligned_buffer<value_type>(
+                               stage_store, n_values * n_stage );
+        int * const n_staged = &work_aux[0];
+        std::fill( n_staged, n_staged + n_values, 0 );
+
+        const Key * k = keys;
+        for (Iter i = Ai; i < Af; ++i, ++k) {
+          value_type * s = stage + (*k) * n_stage;
+          int & n = n_staged[*k];
+          new ( s + n ) value_type( *i );
+
+          if ( ++n == n_stage ) {
+            flush( s, n, Bi + ptr[*k] );
+            ptr[*k] += n;
+            n = 0;
+          }
+        }
+
+        for (int v = 0; v < n_values; ++v)
+          flush( stage + v * n_stage, n_staged[v], Bi + ptr[v] );
+      }/*stable_sort_copy_impl()*/
+
+      /** Implementation of permutation for a particular key type. */
+      template <class Key, class Iter, class PIter>
+      void permutation_impl(const Iter & Ai, const Iter & Af, const PIter & Pi,
+                            val_map & map, NSortTweaker & nsortTweaker ) {
+        const int n_items = static_cast<int>(Af - Ai);
+        Key * const keys = key_buffer<Key>( n_items );
+        int * const ptr = &work_ptr[0];
+
+        count_keys( Ai, Af, keys, ptr, map, nsortTweaker );
+
+        for (int k = 0; k < n_items; ++k)
+          *(Pi + ptr[keys[k]]++) = k;
+      }/*permutation_impl()*/
+
+      /** Implementation of resort for a particular key type. */
+      template <class Key, class Iter>
+      void resort_impl(const Iter & Ai, const Iter & Af,
+                       val_map & map, NSortTweaker & nsortTweaker ) {
+        const int n_items = static_cast<int>(Af - Ai);
+        if ( n_values <= 0 || bin[n_values-1] != n_items ) {
+          cached_sort_impl<Key>( Ai, Af, map, nsortTweaker );
+          return;
+        }
+
+        Key * const keys = key_buffer<Key>( n_items );
+        int * const old_begin = &work_aux[0];
+        migrants.clear();
+
+        /* save the previous boundaries and change bin[] to the previous
+         * occurrences of each value. */
+        old_begin[0] = 0;
+        for (int i = 0; i < n_values; ++i) {
+          old_begin[i+1] = bin[i];
+          bin[i] -= old_begin[i];
+        }
+
+        /* find the migrants and accumulate the delta histogram directly into
+         * the occurrences. */
+        xylose::nsort::map::detail::map_keys( map, Ai, Af, keys );
+        for (int i = 0; i < n_values; ++i) {
+          for (int pos = old_begin[i]; pos < old_begin[i+1]; ++pos) {
+            const Key k = keys[pos];
+            if (static_cast<int>(k) != i) {
+              migrants.push_back( pos );
+              --bin[i];
+              ++bin[k];
+            }
+          }
+        }
+
+        /* Allow user code to tweak the map according to the preliminary
+         * counting statistics. */
+        nsortTweaker.tweakNSort(map, static_cast<const int*>(&bin[0]),
+                                static_cast<const int&>(n_values));
+
+        /* now change this array of occurrences to an array of end
+         * positions. */
+        for (int i = 0, cur_ptr = 0; i < n_values; ++i) {
+          cur_ptr += bin[i];
+          bin[i]   = cur_ptr;
+        }
+
+        /* Collect the positions within each new bucket that hold an item of a
+         * different bucket:  migrants that did not leave the new region and
+         * any item in the part of the new region that was not part of the old
+         * region.  wrong[wrong_begin[i]...wrong_begin[i+1]) are the
+         * positions for the ith value. */
+        int * const wrong_begin = &work_aux2[0];
+        wrong.clear();
+        {
+          typename int_vector::const_iterator m = migrants.begin();
+          for (int i = 0; i < n_values; ++i) {
+            wrong_begin[i] = wrong.size();
+            const int b  = begin(i),        e  = end(i);
+            const int ob = old_begin[i],    oe = old_begin[i+1];
+            const int ib = std::max(b, ob), ie = std::max(ib, std::min(e, oe));
+
+            for (int pos = b; pos < std::min(e, ob); ++pos)
+              if (static_cast<int>(keys[pos]) != i) wrong.push_back( pos );
+
+            for ( ; m != migrants.end() && *m < ib; ++m );
+            for ( ; m != migrants.end() && *m < ie; ++m )
+              wrong.push_back( *m );
+
+            for (int pos = std::max(b, oe); pos < e; ++pos)
+              if (static_cast<int>(keys[pos]) != i) wrong.push_back( pos );
+          }
+          wrong_begin[n_values] = wrong.size();
+        }
+
+        /* move each of the wrongly placed items into a wrong position of its
+         * own bucket (same cycle-following as in cached_sort). */
+        int * const ptr = &work_ptr[0];
+        std::copy( wrong_begin, wrong_begin + n_values, ptr );
+        for (int i = 0; i < n_values; ++i) {
+          const int & end_w = wrong_begin[i+1];
+          int & w = ptr[i];
+
+          while (w < end_w) {
+            const int pos = wrong[w];
+            const Key k = keys[pos];
+
+            if (static_cast<int>(k) == i) {
+              w++;
+              continue;
+            }
+
+            const int pos2 = wrong[ ptr[k]++ ];
+            std::iter_swap(Ai + pos, Ai + pos2);
+            keys[pos] = keys[pos2];
+            keys[pos2] = k;
+          }/*while*/
+        }/*for*/
+      }/*resort_impl()*/
+
+    protected:
+      /** Grow a workspace vector to at least n elements.  The vector is
+       * never shrunk, so that its capacity is reused by later calls. */
+      template <class V>
+      static void grow( V & v, const std::size_t & n ) {
+        if ( v.size() < n )
+          v.resize( n );
+      }
+
+      /** Workspace for the keys of n_items items (plus one so that the
+       * address is also valid for an empty range). */
+      template <class Key>
+      Key * key_buffer( const int & n_items ) {
+        grow( key_store, ( (n_items + 1) * sizeof(Key)
+                           + sizeof(boost::uint32_t) - 1 )
+                         / sizeof(boost::uint32_t) );
+        return reinterpret_cast<Key*>( &key_store[0] );
+      }
+
+    private:
+      /** Copy n staged items to the destination and destroy the staged
+       * copies. */
+      template <class T, class OIter>
+      static void flush( T * s, const int & n, OIter dest ) {
+        for ( T * sf = s + n; s < sf; ++s, ++dest ) {
+          *dest = *s;
+          s->~T();
+        }
+      }
+
     };/* NSort class */
 
   }/* namespace nsort */
@@ -0,0 +1,451 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \example nsort/parallel/timePNSort.cpp
+ * Scaling benchmark of the multi-threaded xylose::nsort::PNSort class from
+ * one to 64 threads.
+ */
+
+
+#ifndef xylose_nsort_PNSort_h
+#define xylose_nsort_PNSort_h
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/PThreadEval.h>
+#include <xylose/ref_of.h>
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+namespace xylose {
+  namespace nsort {
+
+    /** Multi-threaded \f$ O(N) \f$ sort using a predefined number of sorting
+     * buckets.
+     * The items are divided into contiguous chunks, one chunk per thread.
+     * Each thread counts its chunk into a private histogram.  The histograms
+     * are merged with a parallel prefix sum so that each thread knows the
+     * destination of each of its items for each bucket.  Each thread then
+     * scatters its items into a temporary buffer which is copied back in
+     * parallel.  Because the chunks are scattered in order, the threaded sort
+     * <em>is</em> stable (unlike NSort::sort).  As in NSort::cached_sort, the
+     * map is evaluated only once per item; the resulting bucket is kept in a
+     * compact key array that drives the scatter.  If the range is not split
+     * (only one thread or fewer than 2*min_chunk_size items), the serial
+     * (unstable) NSort::sort is used instead.
+     *
+     * The threads are taken from a xylose::PThreadCache instance.  Results
+     * are available through the same begin(i)/end(i) interface as NSort.
+     * The keys, histograms and item buffer are kept in the same grow-only
+     * workspace as NSort so that repeated sorts do not allocate.
+     *
+     * @tparam val_map
+     *    Map a reference of the sorted items to an integer bucket index.  The
+     *    map is used concurrently from several threads, so
+     *    val_map::operator()(item&) const must be thread-safe. <br>
+     *    [Default nsort::map::direct]
+     *
+     * @tparam NSortTweaker
+     *    Optional class to allow the user code to tweak the map according to
+     *    the preliminary (merged) counting statistics. <br>
+     *    [Default nsort::tweak::Null]
+     *
+     * @tparam Allocator
+     *    Allocator (rebound as necessary) for the buckets and the workspace.
+     *    <br>
+     *    [Default std::allocator<int>]
+     */
+    template < typename val_map = map::direct,
+               typename NSortTweaker = tweak::Null,
+               typename Allocator = std::allocator<int> >
+    class PNSort : public NSort< val_map, NSortTweaker, Allocator > {
+      /* TYPEDEFS */
+    private:
+      typedef NSort< val_map, NSortTweaker, Allocator > super;
+      typedef typename super::int_vector int_vector;
+      typedef typename super::stage_vector stage_vector;
+
+      /** Data shared between all of the workers of one sort. */
+      template < typename Iter, typename Key >
+      struct State {
+        typedef typename std::iterator_traits<Iter>::value_type value_type;
+
+        Iter Ai;
+        int n_items;
+        int n_values;
+        int n_chunks;
+        const val_map * map;
+        /** Bucket of each item, as computed in the counting pass. */
+        Key * keys;
+        /** Per-chunk histograms/offsets:  hist[t*n_values + v]. */
+        int * hist;
+        int * bin;
+        /** Number of items in each slice of values. */
+        int * slice_sum;
+        value_type * buffer;
+        /** Number of items of each chunk that have been scattered into
+         * (or copied back out of) the buffer. */
+        int * done;
+        /** Whether copying an item of each chunk threw an exception. */
+        int * failed;
+
+        /** Whether any chunk failed in the last phase. */
+        bool anyFailed() const {
+          return std::find( failed, failed + n_chunks, 1 ) != failed + n_chunks;
+        }
+
+        /** Index of first item of the t'th chunk of items. */
+        int chunkBegin( const int & t ) const {
+          return static_cast<int>(
+            ( static_cast<long long>(n_items) * t ) / n_chunks
+          );
+        }
+
+        /** Index of first value of the t'th slice of values. */
+        int sliceBegin( const int & t ) const {
+          return static_cast<int>(
+            ( static_cast<long long>(n_values) * t ) / n_chunks
+          );
+        }
+      };
+
+      /** The work done by each thread for each phase of the sort. */
+      template < typename Iter, typename Key >
+      struct Worker : DefaultPThreadFunctor {
+        /* TYPEDEFS */
+        enum PHASE {
+          COUNT,   /* count the items of one chunk into its histogram. */
+          MERGE,   /* sum the histograms for one slice of values. */
+          OFFSETS, /* convert histograms into scatter offsets. */
+          SCATTER, /* move the items of one chunk into the buffer. */
+          COPY     /* copy one chunk of the buffer back to the range. */
+        };
+
+        typedef State<Iter,Key> S;
+        typedef typename S::value_type value_type;
+
+        /* MEMBER STORAGE */
+        S * s;
+        int t;
+        PHASE phase;
+
+        /* MEMBER FUNCTIONS */
+        Worker( S * s, const int & t, const PHASE & phase )
+          : s(s), t(t), phase(phase) { }
+
+        void operator() () {
+          switch ( phase ) {
+            case COUNT:   count();   break;
+            case MERGE:   merge();   break;
+            case OFFSETS: offsets(); break;
+            case SCATTER: scatter(); break;
+            case COPY:    copy();    break;
+          }
+        }
+
+        void count() {
+          int * h = s->hist + t * s->n_values;
+          Key * const ki = s->keys + s->chunkBegin(t);
+          Key * const kf = s->keys + s->chunkBegin(t+1);
+          xylose::nsort::map::detail::map_keys( *s->map,
+                                                s->Ai + s->chunkBegin(t),
+                                                s->Ai + s->chunkBegin(t+1), ki );
+          for ( const Key * k = ki; k < kf; ++k )
+            ++h[*k];
+        }
+
+        void merge() {
+          int sum = 0;
+          for ( int v = s->sliceBegin(t), vf = s->sliceBegin(t+1); v < vf; ++v ) {
+            int n = 0;
+            for ( int c = 0; c < s->n_chunks; ++c )
+              n += s->hist[ c * s->n_values + v ];
+            s->bin[v] = n;
+            sum += n;
+          }
+          s->slice_sum[t] = sum;
+        }
+
+        void offsets() {
+          /* slice_sum[t] has already been converted to a start position. */
+          int cur_ptr = s->slice_sum[t];
+          for ( int v = s->sliceBegin(t), vf = s->sliceBegin(t+1); v < vf; ++v ) {
+            for ( int c = 0; c < s->n_chunks; ++c ) {
+              int & h = s->hist[ c * s->n_values + v ];
+              const int n = h;
+              h = cur_ptr;
+              cur_ptr += n;
+            }
+            s->bin[v] = cur_ptr;
+          }
+        }
+
+        void scatter() {
+          int * h = s->hist + t * s->n_values;
+          const Iter f = s->Ai + s->chunkBegin(t+1);
+          const Key * k = s->keys + s->chunkBegin(t);
+          int & d = s->done[t];
+          try {
+            for ( Iter i = s->Ai + s->chunkBegin(t); i < f; ++i, ++k, ++d ) {
+              new ( s->buffer + h[*k] ) value_type( *i );
+              ++h[*k];
+            }
+          } catch ( ... ) {
+            s->failed[t] = 1;
+          }
+        }
+
+        void copy() {
+          value_type * b  = s->buffer + s->chunkBegin(t);
+          value_type * bf = s->buffer + s->chunkBegin(t+1);
+          int & d = s->done[t];
+          try {
+            for ( Iter i = s->Ai + s->chunkBegin(t); b < bf; ++b, ++i, ++d ) {
+              *i = *b;
+              b->~value_type();
+            }
+          } catch ( ... ) {
+            s->failed[t] = 1;
+          }
+        }
+      };
+
+      /** Destroys the items left in the buffer if the SCATTER or COPY phase
+       * fails.  The workers cannot pass exceptions through the thread cache;
+       * they record the failure of their chunk and the sort throws once all
+       * chunks of the phase have finished. */
+      template < typename Iter, typename Key >
+      struct BufferGuard {
+        /* TYPEDEFS */
+        typedef State<Iter,Key> S;
+        typedef typename S::value_type value_type;
+        enum PHASE { IDLE, SCATTER, COPY };
+
+        /* MEMBER STORAGE */
+        S & s;
+        PHASE phase;
+
+        /* MEMBER FUNCTIONS */
+        BufferGuard( S & s ) : s(s), phase(IDLE) { }
+
+        /** Start tracking the given phase. */
+        void enter( const PHASE & p ) {
+          std::fill( s.done, s.done + s.n_chunks, 0 );
+          std::fill( s.failed, s.failed + s.n_chunks, 0 );
+          phase = p;
+        }
+
+        /** Throw if any chunk failed in the current phase. */
+        void check() const {
+          if ( s.anyFailed() )
+            throw std::runtime_error( "PNSort:  copying an item failed" );
+        }
+
+        ~BufferGuard() {
+          if ( phase == SCATTER ) {
+            /* replay the scatter of each chunk backwards to find the
+             * constructed items. */
+            for ( int t = 0; t < s.n_chunks; ++t ) {
+              int * h = s.hist + t * s.n_values;
+              const Key * k0 = s.keys + s.chunkBegin(t);
+              for ( const Key * k = k0 + s.done[t]; k > k0; )
+                s.buffer[ --h[*--k] ].~value_type();
+            }
+          } else if ( phase == COPY ) {
+            for ( int t = 0; t < s.n_chunks; ++t ) {
+              value_type * b  = s.buffer + s.chunkBegin(t) + s.done[t];
+              value_type * bf = s.buffer + s.chunkBegin(t+1);
+              for ( ; b < bf; ++b )
+                b->~value_type();
+            }
+          }
+        }
+      };
+
+
+      /* STATIC STORAGE */
+    public:
+      /** Chunks smaller than this are not worth handing to another thread. */
+      static const int min_chunk_size = 4096;
+
+
+      /* MEMBER STORAGE */
+    private:
+      /** The thread cache used to execute the work. */
+      PThreadCache & cache;
+
+      /** The number of threads to use (<= 0 means ask the cache). */
+      int n_threads;
+
+      /* workspace that is reused between calls. */
+      int_vector hist;
+      int_vector slice_sum;
+      int_vector done;
+      int_vector failed;
+      stage_vector item_store;
+
+
+      /* MEMBER FUNCTIONS */
+    public:
+      /** Constructor allocates the specified number of buckets.
+       * @param n_values
+       *    Number of sorting buckets.
+       * @param n_threads
+       *    Number of threads to split the work over.  If n_threads <= 0, the
+       *    value of PThreadCache::get_max_threads() is used at the time of each
+       *    sort. [Default 0]
+       * @param cache
+       *    Specify the cache instance to use [Default xylose::pthreadCache].
+       * @param alloc
+       *    Allocator for the buckets and the workspace [Default Allocator()].
+       */
+      PNSort( const int & n_values,
+              const int & n_threads = 0,
+              PThreadCache & cache = xylose::pthreadCache,
+              const Allocator & alloc = Allocator() )
+        : super(n_values, alloc), cache(cache), n_threads(n_threads),
+          hist( alloc ), slice_sum( alloc ), done( alloc ), failed( alloc ),
+          item_store( typename stage_vector::allocator_type(alloc) ) { }
+
+      /** Get the number of threads requested for this sort. */
+      inline const int & get_n_threads() const { return n_threads; }
+
+      /** Set the number of threads requested for this sort.
+       * @see PNSort(const int&, const int&, PThreadCache&)
+       */
+      inline void set_n_threads( const int & n ) { n_threads = n; }
+
+      /** Overload of sort for using default constructed value map and tweaker.
+       * This function subsequently calls the other overload of sort().
+       */
+      template <class Iter>
+      void sort(const Iter & Ai, const Iter & Af,
+                const val_map & map = val_map(),
+                const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        sort(Ai,Af,mapcopy,tweakcopy);
+      }
+
+      /** Sort the items within the range [Ai,Af) using the specified value map
+       * and NSort tweaker.  If only one thread is available (or the range is
+       * too small to be worth splitting), this is just NSort::sort. */
+      template <class Iter>
+      void sort(const Iter & Ai, const Iter & Af,
+                val_map & map, NSortTweaker & nsortTweaker ) {
+        const int n_items = static_cast<int>(Af - Ai);
+        int n_chunks = n_threads > 0 ? n_threads : cache.get_max_threads();
+        n_chunks = std::max( 1, std::min( n_chunks, n_items / min_chunk_size ) );
+
+        if ( n_chunks == 1 )
+          super::sort( Ai, Af, map, nsortTweaker );
+        else if ( this->n_values <= 0x100 )
+          threaded_sort< boost::uint8_t  >( Ai, Af, map, nsortTweaker,
+                                            n_chunks );
+        else if ( this->n_values <= 0x10000 )
+          threaded_sort< boost::uint16_t >( Ai, Af, map, nsortTweaker,
+                                            n_chunks );
+        else
+          threaded_sort< boost::uint32_t >( Ai, Af, map, nsortTweaker,
+                                            n_chunks );
+      }/*sort()*/
+
+    private:
+      /** Implementation of the threaded sort for a particular key type. */
+      template <class Key, class Iter>
+      void threaded_sort(const Iter & Ai, const Iter & Af,
+                         val_map & map, NSortTweaker & nsortTweaker,
+                         const int & n_chunks ) {
+        typedef State<Iter,Key> S;
+        typedef Worker<Iter,Key> W;
+        typedef typename S::value_type value_type;
+
+        const int n_items = static_cast<int>(Af - Ai);
+        super::grow( hist, n_chunks * this->n_values );
+        super::grow( slice_sum, n_chunks );
+        super::grow( done, n_chunks );
+        super::grow( failed, n_chunks );
+        std::fill( hist.begin(), hist.begin() + n_chunks * this->n_values, 0 );
+
+        S s;
+        s.Ai        = Ai;
+        s.n_items   = n_items;
+        s.n_values  = this->n_values;
+        s.n_chunks  = n_chunks;
+        s.map       = &map;
+        s.keys      = this->template key_buffer<Key>( n_items );
+        s.hist      = &hist[0];
+        s.bin       = &this->bin[0];
+        s.slice_sum = &slice_sum[0];
+        s.buffer    = detail::aligned_buffer<value_type>( item_store, n_items );
+        s.done      = &done[0];
+        s.failed    = &failed[0];
+
+        /* first count the number of occurrences for each value in each chunk
+         * and merge them into the total counts in bin[]. */
+        run( s, W::COUNT );
+        run( s, W::MERGE );
+
+        /* Allow user code to tweak the map according to the preliminary
+         * counting statistics. */
+        nsortTweaker.tweakNSort( map, static_cast<const int*>(&this->bin[0]),
+                                 static_cast<const int&>(this->n_values) );
+
+        /* change the slice sums to slice start positions and then each of the
+         * per-chunk histograms to per-chunk start positions. */
+        for ( int t = 0, cur_ptr = 0; t < n_chunks; ++t ) {
+          const int n = slice_sum[t];
+          slice_sum[t] = cur_ptr;
+          cur_ptr += n;
+        }
+        run( s, W::OFFSETS );
+
+        /* move all items to their final locations.  If the scatter fails, the
+         * range is still untouched. */
+        BufferGuard<Iter,Key> guard( s );
+        guard.enter( guard.SCATTER );
+        run( s, W::SCATTER );
+        guard.check();
+        guard.enter( guard.COPY );
+        run( s, W::COPY );
+        guard.check();
+        guard.phase = guard.IDLE;
+      }/*threaded_sort()*/
+
+      /** Execute one phase of the sort on each chunk and wait for all chunks
+       * to finish. */
+      template < typename Iter, typename Key >
+      void run( State<Iter,Key> & s,
+                const typename Worker<Iter,Key>::PHASE & phase ) {
+        PThreadEval< Worker<Iter,Key> > evaluator( cache );
+        for ( int t = 0; t < s.n_chunks; ++t )
+          evaluator.eval( Worker<Iter,Key>( &s, t, phase ) );
+        evaluator.joinAll();
+      }
+    };/* PNSort class */
+
+  }/* namespace nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_PNSort_h
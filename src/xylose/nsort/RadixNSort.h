@@ -0,0 +1,251 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_RadixNSort_h
+#define xylose_nsort_RadixNSort_h
+
+#include <xylose/nsort/map/direct.h>
+#include <xylose/nsort/map/detail/batch_keys.h>
+#include <xylose/nsort/detail/aligned_buffer.h>
+#include <xylose/nsort/tweak/Null.h>
+#include <xylose/ref_of.h>
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+
+    /** Stable \f$ O(N) \f$ sort for a very large number of sorting buckets.
+     * With e.g. map::uniform_grid on a \f$ 512^3 \f$ grid, the bucket
+     * arrays of NSort no longer fit in cache and every count and every
+     * permutation step misses.  This class splits the bucket index into a
+     * high and a low digit, as in an MSD radix sort, and sorts in two passes
+     * whose histograms are each at most max_histogram_bytes in size:
+     *   -# The items are counted by their high digit and scattered into a
+     *      temporary buffer.
+     *   -# Each high-digit block is counted and scattered back by the low
+     *      digit.  The low-digit histogram of a block is the contiguous part
+     *      of the global bucket array belonging to that block.
+     *
+     * Both passes are stable, so the sort is stable.  The map is evaluated
+     * only once per item.  The global begin(i)/end(i) of every bucket is
+     * available after the sort, as with NSort, but as 64-bit offsets so that
+     * more than \f$ 2^{31} \f$ items can be sorted.
+     *
+     * @tparam val_map
+     *    Map a reference of the sorted items to an integer bucket index.  Note
+     *    that this class does NOT check for overruns in the mapped value (to
+     *    see if 0 <= val_map::operator()(item&) < n_values). <br>
+     *    [Default nsort::map::direct]
+     *
+     * @tparam NSortTweaker
+     *    Optional class to allow the user code to tweak the map according to
+     *    the preliminary counting statistics.  The tweaker is passed the
+     *    array of 64-bit counts (offset_type).  The map is evaluated before
+     *    the tweaker is called; the tweaker must not change the bucket of an
+     *    item that has already been counted. <br>
+     *    [Default nsort::tweak::Null]
+     */
+    template < typename val_map = map::direct,
+               typename NSortTweaker = tweak::Null >
+    class RadixNSort {
+    public:
+      /** Type of the bucket offsets. */
+      typedef boost::int64_t offset_type;
+
+      /** Upper limit of the memory used by the histogram of either digit. */
+      static const unsigned int max_histogram_bytes = 256u * 1024u;
+
+    private:
+      typedef boost::uint32_t Key;
+
+    protected:
+      int n_values;
+      int low_bits;
+      std::vector<offset_type> bin;
+
+    private:
+      /* workspace that is reused between calls. */
+      std::vector<Key> keys;
+      std::vector<Key> bkeys;
+      std::vector<offset_type> ptr;
+      std::vector<offset_type> high_begin;
+      /* raw storage for the buffered items (see detail::aligned_buffer). */
+      std::vector<double> buffer_store;
+
+    public:
+      /** Constructor allocates the specified number of buckets and chooses
+       * the split of the bucket index into the high and low digits. */
+      RadixNSort(const int & n_values)
+        : n_values(n_values), low_bits(0),
+          bin( std::max(n_values, 1), 0 ) {
+        int bits = 0;
+        while ( (offset_type(1) << bits) < n_values )
+          ++bits;
+
+        int max_bits = 0;
+        while ( (sizeof(offset_type) << (max_bits + 1)) <= max_histogram_bytes )
+          ++max_bits;
+
+        low_bits = std::min( bits, max_bits );
+      }
+
+      /** Get the number of bins/values used in this sort. */
+      inline const int & size() const { return n_values; }
+
+      /** Number of bits of the bucket index sorted in the second pass. */
+      inline const int & get_low_bits() const { return low_bits; }
+
+      /** Number of high-digit blocks sorted in the first pass. */
+      inline int get_n_high() const {
+        return n_values > 0 ? ((n_values - 1) >> low_bits) + 1 : 0;
+      }
+
+      /** Obtain the index of the end() element of the ith value.
+       * Note that i should conform to 0 <= i < n_values; there is no bound
+       * checking on the input i.
+       *
+       * Only valid after sort(...) has been called. */
+      inline const offset_type & end(const int & i) const { return bin[i]; }
+
+      /** Obtain the index of the begin() element of the ith value.
+       * Note that i should conform to 0 <= i < n_values; there is no bound
+       * checking on the input i.
+       *
+       * Only valid after sort(...) has been called. */
+      inline offset_type begin(const int & i) const {
+        if (i == 0) return 0;
+        else return bin[i-1];
+      }
+
+      /** Get the number of items for a particular value index.
+       * This function just computes <code>(end(i) - begin(i))</code>.
+       *
+       * Only valid after sort(...) has been called. */
+      inline offset_type size(const int & i) const { return end(i) - begin(i); }
+
+      /** Overload of sort for using default constructed value map and tweaker.
+       * This function subsequently calls the other overload of sort().
+       */
+      template <class Iter>
+      void sort(const Iter & Ai, const Iter & Af,
+                const val_map & map = val_map(),
+                const NSortTweaker & nsortTweaker = NSortTweaker()) {
+        val_map mapcopy = map;
+        NSortTweaker tweakcopy = nsortTweaker;
+        sort(Ai,Af,mapcopy,tweakcopy);
+      }
+
+      /** Sort the items within the range [Ai,Af) using the specified value map
+       * and NSort tweaker.  Temporary storage of one copy of each item and
+       * two 32-bit keys per item is used; this workspace is kept (and only
+       * grown) between calls. */
+      template <class Iter>
+      void sort(const Iter & Ai, const Iter & Af,
+                val_map & map, NSortTweaker & nsortTweaker ) {
+        typedef typename std::iterator_traits<Iter>::value_type T;
+
+        const offset_type n_items = Af - Ai;
+        const int n_high = get_n_high();
+        const int n_low = 1 << low_bits;
+
+        grow( keys, n_items + 1 );
+        grow( bkeys, n_items + 1 );
+        grow( ptr, std::max(n_high, n_low) + 1 );
+        grow( high_begin, n_high + 1 );
+        std::fill( ptr.begin(), ptr.begin() + n_high, offset_type(0) );
+
+        /* first pass:  compute the keys and count the high digits. */
+        xylose::nsort::map::detail::map_keys( map, Ai, Af, &keys[0] );
+        for (offset_type k = 0; k < n_items; ++k)
+          ++ptr[keys[k] >> low_bits];
+
+        {
+          offset_type cur_ptr = 0;
+          for (int h = 0; h < n_high; ++h) {
+            high_begin[h] = cur_ptr;
+            cur_ptr += ptr[h];
+            ptr[h] = high_begin[h];
+          }
+        }
+        high_begin[n_high] = n_items;
+
+        T * buffer = detail::aligned_buffer<T>( buffer_store, n_items );
+
+        for (offset_type k = 0; k < n_items; ++k) {
+          const offset_type d = ptr[keys[k] >> low_bits]++;
+          new (buffer + d) T( *(Ai + k) );
+          bkeys[d] = keys[k];
+        }
+
+        /* second pass:  count each block by the low digit directly into the
+         * (block-local) part of the global bucket array. */
+        std::fill( bin.begin(), bin.end(), offset_type(0) );
+        for (int h = 0; h < n_high; ++h)
+          for (offset_type d = high_begin[h]; d < high_begin[h+1]; ++d)
+            ++bin[bkeys[d]];
+
+        /* Allow user code to tweak the map according to the preliminary
+         * counting statistics. */
+        nsortTweaker.tweakNSort( map, static_cast<const offset_type*>(&bin[0]),
+                                 static_cast<const int&>(n_values) );
+
+        /* change the occurrences of each block to end positions and scatter
+         * the block back. */
+        offset_type cur_ptr = 0;
+        for (int h = 0; h < n_high; ++h) {
+          const int vi = h << low_bits;
+          const int vf = std::min( n_values, vi + n_low );
+          for (int i = vi; i < vf; ++i) {
+            ptr[i - vi] = cur_ptr;
+            cur_ptr += bin[i];
+            bin[i]   = cur_ptr;
+          }
+
+          for (offset_type d = high_begin[h]; d < high_begin[h+1]; ++d) {
+            T & t = buffer[d];
+            *(Ai + ptr[bkeys[d] - vi]++) = t;
+            t.~T();
+          }
+        }
+      }/*sort()*/
+
+    private:
+      /** Grow a workspace vector to at least n elements.  The vector is
+       * never shrunk, so that its capacity is reused by later calls. */
+      template <class V>
+      static void grow( V & v, const offset_type & n ) {
+        if ( v.size() < static_cast<std::size_t>(n) )
+          v.resize( n );
+      }
+
+    };/* RadixNSort class */
+
+  }/* namespace nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_RadixNSort_h
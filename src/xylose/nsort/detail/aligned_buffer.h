@@ -0,0 +1,58 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_detail_aligned_buffer_h
+#define xylose_nsort_detail_aligned_buffer_h
+
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <cstddef>
+
+namespace xylose {
+  namespace nsort {
+    namespace detail {
+
+      /** Raw storage for n items of type T taken from a reused workspace
+       * vector.  The vector is grown as necessary (never shrunk) and the
+       * returned address is aligned for T, also when T requires a stricter
+       * alignment than the elements of the vector (e.g. SIMD vectors or
+       * cache-line aligned structures).  The items must be constructed with
+       * placement new and destroyed by the caller.
+       */
+      template < typename T, typename V >
+      T * aligned_buffer( V & store, const std::size_t & n ) {
+        typedef typename V::value_type E;
+        const std::size_t align = boost::alignment_of<T>::value;
+        const std::size_t len =
+          ( n * sizeof(T) + align + sizeof(E) - 1 ) / sizeof(E);
+        if ( store.size() < len )
+          store.resize( len );
+
+        const std::size_t a = reinterpret_cast<std::size_t>( &store[0] );
+        return reinterpret_cast<T*>( ( a + align - 1 ) & ~( align - 1 ) );
+      }
+
+    }/* namespace xylose::nsort::detail */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_detail_aligned_buffer_h
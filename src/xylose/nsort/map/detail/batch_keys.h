@@ -0,0 +1,199 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_map_detail_batch_keys_h
+#define xylose_nsort_map_detail_batch_keys_h
+
+#include <xylose/Vector.h>
+#include <xylose/Dimensions.hpp>
+#include <xylose/ref_of.h>
+
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/remove_const.hpp>
+
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+    namespace map {
+      namespace detail {
+
+        /** Lists the directions of the given dimensions. */
+        template < typename dimensions >
+        struct dims_dirs;
+
+        template < unsigned int dir0 >
+        struct dims_dirs< Dimensions<dir0> > {
+          static const unsigned int ndims = 1u;
+          static void get( unsigned int * d ) { d[0] = dir0; }
+        };
+
+        template < unsigned int dir0,
+                   unsigned int dir1 >
+        struct dims_dirs< Dimensions<dir0,dir1> > {
+          static const unsigned int ndims = 2u;
+          static void get( unsigned int * d ) { d[0] = dir0; d[1] = dir1; }
+        };
+
+        template < unsigned int dir0,
+                   unsigned int dir1,
+                   unsigned int dir2 >
+        struct dims_dirs< Dimensions<dir0,dir1,dir2> > {
+          static const unsigned int ndims = 3u;
+          static void get( unsigned int * d ) {
+            d[0] = dir0; d[1] = dir1; d[2] = dir2;
+          }
+        };
+
+
+
+        /** Parameters of one direction of a uniform grid. */
+        struct grid_axis {
+          double x0;
+          double dx;
+          int max_val;
+          int stride;
+        };
+
+        /** Batch keys of [first,last) for a uniform_grid map.  The grid
+         * parameters are loaded once and the loop body is free of calls so
+         * that the compiler can vectorize it (e.g. AVX2/AVX-512 when enabled
+         * at compile time).  The cell size is divided by (rather than
+         * multiplied with its inverse) so that the keys are bit-identical to
+         * those of uniform_grid::operator() on cell boundaries. */
+        template < typename dims,
+                   typename Uniform,
+                   typename Iter,
+                   typename OIter >
+        void uniform_grid_keys( const Uniform & g,
+                                Iter first, const Iter & last, OIter out ) {
+          typedef dims_dirs<dims> D;
+          unsigned int dir[D::ndims];
+          D::get( dir );
+
+          grid_axis a[D::ndims];
+          for ( unsigned int d = 0u, stride = 1u; d < D::ndims; ++d ) {
+            a[d].x0      = g.x0()[dir[d]];
+            a[d].dx      = g.dx()[dir[d]];
+            a[d].max_val = static_cast<int>(g.size()[dir[d]]) - 1;
+            a[d].stride  = static_cast<int>(stride);
+            stride *= g.size()[dir[d]];
+          }
+
+          for ( ; first != last; ++first, ++out ) {
+            int k = 0;
+            for ( unsigned int d = 0u; d < D::ndims; ++d ) {
+              const int L = static_cast<int>(
+                ( position( ref_of(*first) )[dir[d]] - a[d].x0 ) / a[d].dx
+              );
+              k += std::max( 0, std::min( a[d].max_val, L ) ) * a[d].stride;
+            }
+            *out = k;
+          }
+        }
+
+        /** Batch keys of [first,last) for a pivot map (see
+         * uniform_grid_keys):  sum_d 2^d * ( x[dir[d]] >= point[dir[d]] ). */
+        template < typename dims,
+                   typename Iter,
+                   typename OIter >
+        void pivot_keys( const Vector<double,3u> & point,
+                         Iter first, const Iter & last, OIter out ) {
+          typedef dims_dirs<dims> D;
+          unsigned int dir[D::ndims];
+          D::get( dir );
+
+          double p[D::ndims];
+          for ( unsigned int d = 0u; d < D::ndims; ++d )
+            p[d] = point[dir[d]];
+
+          for ( ; first != last; ++first, ++out ) {
+            int k = 0;
+            for ( unsigned int d = 0u; d < D::ndims; ++d )
+              k += ( position( ref_of(*first) )[dir[d]] >= p[d] ) << d;
+            *out = k;
+          }
+        }
+
+
+
+        /** Detects whether a map provides its own batch keys(first,last,out)
+         * function.  A map announces this with a batch_keys_map typedef
+         * naming the map itself; wrappers that merely inherit a batch
+         * function (and would compute the wrong keys with it) are therefore
+         * not detected. */
+        template < typename Map >
+        struct has_batch_keys {
+        private:
+          typedef char yes;
+          typedef char (&no)[2];
+          template < typename U >
+          static yes test( typename U::batch_keys_map * );
+          template < typename U >
+          static no test( ... );
+
+          template < typename U, bool has_typedef >
+          struct check : boost::false_type { };
+
+          template < typename U >
+          struct check<U,true>
+            : boost::is_same< typename U::batch_keys_map, U > { };
+
+        public:
+          static const bool value =
+            check< Map, sizeof(test<Map>(0)) == sizeof(yes) >::value;
+        };
+
+        template < typename Map, typename Iter, typename OIter >
+        inline void map_keys( Map & map,
+                              Iter first, const Iter & last, OIter out,
+                              boost::true_type ) {
+          map.keys( first, last, out );
+        }
+
+        template < typename Map, typename Iter, typename OIter >
+        inline void map_keys( Map & map,
+                              Iter first, const Iter & last, OIter out,
+                              boost::false_type ) {
+          for ( ; first != last; ++first, ++out )
+            *out = map( ref_of(*first) );
+        }
+
+        /** Compute the keys of all items in [first,last) into out, using the
+         * batch keys(...) function of the map if it provides one. */
+        template < typename Map, typename Iter, typename OIter >
+        inline void map_keys( Map & map,
+                              const Iter & first, const Iter & last,
+                              OIter out ) {
+          typedef typename boost::remove_const<Map>::type M;
+          map_keys( map, first, last, out,
+                    boost::integral_constant<
+                      bool, has_batch_keys<M>::value >() );
+        }
+
+      }/* namespace xylose::nsort::map::detail */
+    }/* namespace xylose::nsort::map */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_map_detail_batch_keys_h
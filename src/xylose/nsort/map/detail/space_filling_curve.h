@@ -0,0 +1,239 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_map_detail_space_filling_curve_h
+#define xylose_nsort_map_detail_space_filling_curve_h
+
+#include <xylose/Dimensions.hpp>
+
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+    namespace map {
+      namespace detail {
+
+        /** Index of the cell of the Uniform grid along direction dir that
+         * contains the particle (clamped to the grid as in uniform_grid). */
+        template < unsigned int dir,
+                   typename Uniform,
+                   typename Particle >
+        inline unsigned int grid_cell( const Uniform & g, const Particle & p ) {
+          int L = static_cast<int>(
+                    ( position(p)[dir] - g.x0()[dir] ) / g.dx()[dir]
+                  );
+          int max_val = static_cast<int>(g.size()[dir]) - 1;
+          return static_cast<unsigned int>(
+            std::max( 0, std::min( max_val, L ) )
+          );
+        }
+
+        /** Number of bits needed to represent each of the integers [0,n). */
+        inline unsigned int bits_for( const unsigned int & n ) {
+          unsigned int b = 0u;
+          while ( (1u << b) < n )
+            ++b;
+          return b;
+        }
+
+
+
+        /** Extract the cell indices of a particle for the directions of the
+         * given dimensions. */
+        template < typename dimensions >
+        struct grid_cells;
+
+        /** One dimensional cell indices. */
+        template < unsigned int dir0 >
+        struct grid_cells< Dimensions<dir0> > {
+          static const unsigned int ndims = 1u;
+
+          template < typename Uniform >
+          static void size( const Uniform & g, unsigned int * c ) {
+            c[0] = g.size()[dir0];
+          }
+
+          template < typename Uniform, typename Particle >
+          static void get( const Uniform & g, const Particle & p,
+                           unsigned int * c ) {
+            c[0] = grid_cell<dir0>(g,p);
+          }
+        };
+
+        /** Two dimensional cell indices. */
+        template < unsigned int dir0,
+                   unsigned int dir1 >
+        struct grid_cells< Dimensions<dir0,dir1> > {
+          static const unsigned int ndims = 2u;
+
+          template < typename Uniform >
+          static void size( const Uniform & g, unsigned int * c ) {
+            c[0] = g.size()[dir0];
+            c[1] = g.size()[dir1];
+          }
+
+          template < typename Uniform, typename Particle >
+          static void get( const Uniform & g, const Particle & p,
+                           unsigned int * c ) {
+            c[0] = grid_cell<dir0>(g,p);
+            c[1] = grid_cell<dir1>(g,p);
+          }
+        };
+
+        /** Three dimensional cell indices. */
+        template < unsigned int dir0,
+                   unsigned int dir1,
+                   unsigned int dir2 >
+        struct grid_cells< Dimensions<dir0,dir1,dir2> > {
+          static const unsigned int ndims = 3u;
+
+          template < typename Uniform >
+          static void size( const Uniform & g, unsigned int * c ) {
+            c[0] = g.size()[dir0];
+            c[1] = g.size()[dir1];
+            c[2] = g.size()[dir2];
+          }
+
+          template < typename Uniform, typename Particle >
+          static void get( const Uniform & g, const Particle & p,
+                           unsigned int * c ) {
+            c[0] = grid_cell<dir0>(g,p);
+            c[1] = grid_cell<dir1>(g,p);
+            c[2] = grid_cell<dir2>(g,p);
+          }
+        };
+
+        /** Default maximum number of bits per direction of the space filling
+         * curve maps.  This keeps the compile-time number of values (and thus
+         * the table of remap) at 2^18 values:  up to 64^3, 512^2 or 2^18
+         * cells. */
+        template < typename dimensions >
+        struct default_max_bits {
+          static const unsigned int value =
+            18u / grid_cells<dimensions>::ndims;
+        };
+
+
+
+        /** Interleave the bits of ndims cell indices into a Morton (Z-order)
+         * code.  The bits of c[0] are the least significant of each group. */
+        template < unsigned int ndims >
+        struct interleave;
+
+        /** One dimension:  no interleaving. */
+        template <>
+        struct interleave<1u> {
+          static unsigned int apply( const unsigned int * c ) {
+            return c[0];
+          }
+        };
+
+        /** Two dimensions:  up to 16 bits per index. */
+        template <>
+        struct interleave<2u> {
+          static unsigned int part( unsigned int x ) {
+            x &= 0x0000ffffu;
+            x = ( x | (x << 8u) ) & 0x00ff00ffu;
+            x = ( x | (x << 4u) ) & 0x0f0f0f0fu;
+            x = ( x | (x << 2u) ) & 0x33333333u;
+            x = ( x | (x << 1u) ) & 0x55555555u;
+            return x;
+          }
+
+          static unsigned int apply( const unsigned int * c ) {
+            return part(c[0]) | (part(c[1]) << 1u);
+          }
+        };
+
+        /** Three dimensions:  up to 10 bits per index. */
+        template <>
+        struct interleave<3u> {
+          static unsigned int part( unsigned int x ) {
+            x &= 0x000003ffu;
+            x = ( x | (x << 16u) ) & 0x030000ffu;
+            x = ( x | (x <<  8u) ) & 0x0300f00fu;
+            x = ( x | (x <<  4u) ) & 0x030c30c3u;
+            x = ( x | (x <<  2u) ) & 0x09249249u;
+            return x;
+          }
+
+          static unsigned int apply( const unsigned int * c ) {
+            return part(c[0]) | (part(c[1]) << 1u) | (part(c[2]) << 2u);
+          }
+        };
+
+
+
+        /** Hilbert index of ndims cell indices each with the given number of
+         * bits.  This uses the transpose algorithm of J. Skilling ("Programming
+         * the Hilbert curve", AIP Conf. Proc. 707, 2004):  the coordinates are
+         * transformed in place into the transposed Hilbert index which is then
+         * read out from the most significant bit down.
+         */
+        template < unsigned int ndims >
+        inline unsigned int hilbert_index( const unsigned int * c,
+                                           const unsigned int & bits ) {
+          if ( bits == 0u )
+            return 0u;
+
+          unsigned int X[ndims];
+          std::copy( c, c + ndims, X );
+
+          const unsigned int M = 1u << (bits - 1u);
+
+          /* inverse undo */
+          for ( unsigned int Q = M; Q > 1u; Q >>= 1u ) {
+            const unsigned int P = Q - 1u;
+            for ( unsigned int i = 0u; i < ndims; ++i ) {
+              if ( X[i] & Q )
+                X[0] ^= P;                         /* invert */
+              else {
+                const unsigned int t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;                         /* exchange */
+                X[i] ^= t;
+              }
+            }
+          }
+
+          /* Gray encode */
+          for ( unsigned int i = 1u; i < ndims; ++i )
+            X[i] ^= X[i-1];
+          unsigned int t = 0u;
+          for ( unsigned int Q = M; Q > 1u; Q >>= 1u )
+            if ( X[ndims-1] & Q )
+              t ^= Q - 1u;
+          for ( unsigned int i = 0u; i < ndims; ++i )
+            X[i] ^= t;
+
+          unsigned int h = 0u;
+          for ( int b = static_cast<int>(bits) - 1; b >= 0; --b )
+            for ( unsigned int i = 0u; i < ndims; ++i )
+              h = (h << 1u) | ( (X[i] >> b) & 1u );
+          return h;
+        }
+
+      }/* namespace xylose::nsort::map::detail */
+    }/* namespace xylose::nsort::map */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_map_detail_space_filling_curve_h
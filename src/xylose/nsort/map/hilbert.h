@@ -0,0 +1,116 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+
+#ifndef xylose_nsort_map_hilbert_h
+#define xylose_nsort_map_hilbert_h
+
+#include <xylose/Dimensions.hpp>
+#include <xylose/nsort/map/detail/space_filling_curve.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace xylose {
+  namespace nsort {
+    namespace map {
+
+      /** Grid sorting map that numbers the cells of the Uniform grid along a
+       * Hilbert curve.  Unlike the Morton curve (see morton), consecutive
+       * cells of the Hilbert curve are always face neighbors, which gives
+       * somewhat better locality at a somewhat higher cost per evaluation.
+       *
+       * The curve covers the smallest power-of-two cube (square) that
+       * contains the grid; the number of bits per direction is determined
+       * from the grid size at construction.  For grid sizes that are not
+       * powers of two, some of the values in [0,getNumberValues()) are not
+       * used (their buckets remain empty).
+       *
+       * @tparam Uniform
+       *    The grid type (see uniform_grid).
+       * @tparam dims
+       *    The directions of the grid that are used. <br>
+       *    [Default Dimensions<0,1,2>]
+       * @tparam max_bits
+       *    Maximum number of bits of the cell index along each direction
+       *    (i.e. each grid size must be <= 2^max_bits).  This only sets the
+       *    compile-time number_values that is needed by remap, which stores
+       *    one int per value. <br>
+       *    [Default 18/ndims:  6 for 3D, 9 for 2D, 18 for 1D grids]
+       */
+      template < typename Uniform,
+                 typename dims = Dimensions<0u,1u,2u>,
+                 unsigned int max_bits =
+                   detail::default_max_bits<dims>::value >
+      struct hilbert {
+        typedef void super;
+        typedef dims dimensions;
+
+      private:
+        typedef detail::grid_cells<dims> cells;
+
+      public:
+        /** Maximum number of possible values. */
+        static const unsigned int number_values = 1u << (cells::ndims*max_bits);
+
+        const Uniform & g;
+
+        /** Number of bits per direction of the curve. */
+        const unsigned int bits;
+
+        hilbert( const Uniform & g ) : g(g), bits( curve_bits(g) ) { }
+
+        hilbert( const Uniform * g ) : g(*g), bits( curve_bits(*g) ) { }
+
+        int getNumberValues() const {
+          return 1 << (cells::ndims * bits);
+        }
+
+        template < typename Particle >
+        int operator() (const Particle & p) const {
+          unsigned int c[cells::ndims];
+          cells::get( g, p, c );
+          return static_cast<int>(
+            detail::hilbert_index<cells::ndims>( c, bits )
+          );
+        }
+
+      private:
+        static unsigned int curve_bits( const Uniform & g ) {
+          assert( cells::ndims * max_bits <= 30u );
+          unsigned int c[cells::ndims];
+          cells::size( g, c );
+          unsigned int b = 0u;
+          for ( unsigned int i = 0u; i < cells::ndims; ++i ) {
+            assert( c[i] > 0u );
+            b = std::max( b, detail::bits_for( c[i] ) );
+          }
+          assert( b <= max_bits );
+          return b;
+        }
+      };
+
+    }/* namespace xylose::nsort::map */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_map_hilbert_h
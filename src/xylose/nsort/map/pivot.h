@@ -27,6 +27,7 @@
 #include <xylose/Vector.h>
 #include <xylose/Dimensions.hpp>
 #include <xylose/nsort/map/detail/pivot_depth.h>
+#include <xylose/nsort/map/detail/batch_keys.h>
 
 namespace xylose {
   namespace nsort {
@@ -50,6 +51,7 @@ namespace xylose {
         /* TYPEDEFS */
         typedef Dimensions<_dir> dimensions;
         typedef map::tag::pivot< dimensions > tag;
+        typedef pivot batch_keys_map;
         typedef void super;
 
         /** Convert depth of pivot calculation to coordinate index.
@@ -80,6 +82,13 @@ namespace xylose {
         int operator()(const Particle & p) const {
           return position(p)[_dir] >= point[_dir];
         }
+
+        /** Compute the keys of all items in [first,last) into out with a loop
+         * that the compiler can vectorize. */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::pivot_keys< dimensions >( point, first, last, out );
+        }
       };
 
 
@@ -93,6 +102,7 @@ namespace xylose {
       public:
         typedef Dimensions<dir0,_dir> dimensions;
         typedef map::tag::pivot< dimensions > tag;
+        typedef pivot batch_keys_map;
 
         /** Convert depth of pivot calculation to coordinate index.
          * The higher dimension pivot classes inherit/call lower dimension
@@ -119,6 +129,12 @@ namespace xylose {
           return oneD::operator()(p)
                + 2 * ( position(p)[_dir] >= oneD::point[_dir] );
         }
+
+        /** Batch computation of keys (see the one dimensional version). */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::pivot_keys< dimensions >( this->point, first, last, out );
+        }
       };
 
 
@@ -134,6 +150,7 @@ namespace xylose {
       public:
         typedef Dimensions<dir0,dir1,_dir> dimensions;
         typedef map::tag::pivot< dimensions > tag;
+        typedef pivot batch_keys_map;
 
         /** Convert depth of pivot calculation to coordinate index.
          * The higher dimension pivot classes inherit/call lower dimension
@@ -160,6 +177,12 @@ namespace xylose {
           return twoD::operator()(p)
                + 4 * ( position(p)[_dir] >= twoD::point[_dir] );
         }
+
+        /** Batch computation of keys (see the one dimensional version). */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::pivot_keys< dimensions >( this->point, first, last, out );
+        }
       };
 
     }
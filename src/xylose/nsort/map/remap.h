@@ -24,7 +24,11 @@
 #ifndef xylose_nsort_map_remap_h
 #define xylose_nsort_map_remap_h
 
+#include <xylose/nsort/map/detail/batch_keys.h>
+
 #include <set>
+#include <vector>
+#include <algorithm>
 
 namespace xylose {
   namespace nsort {
@@ -39,12 +43,22 @@ namespace xylose {
        * An example use of this class is to remap a portion of the domain of the
        * underlying map function onto another portion of the map function's
        * domain.
+       *
+       * After the table has been changed by hand, getNumberValues() counts
+       * the unique values of the table on each call.  Calling update() once
+       * after the changes (tweak::merge_cells does this) records the number
+       * of values and the lookup from each remapped value back to the
+       * original values of the underlying map, so that getNumberValues() is
+       * O(1) until the next reset().  These records describe the table as of
+       * the last update():  change single entries with set() (which discards
+       * them), or call update() again after writing m_remap directly.
        * */
       template < typename T,
                  unsigned int _nval = T::number_values >
       struct remap : T {
         typedef map::tag::remap<T> tag;
         typedef T super;
+        typedef remap batch_keys_map;
 
         /** Maximum number of possible values. */
         static const unsigned int number_values = _nval;
@@ -53,6 +67,14 @@ namespace xylose {
 
         /** The remap map. */
         int m_remap[number_values];
+
+        /** Number of values as of the last update() (-1 if unknown). */
+        int m_n_values;
+
+        /** Original values of each remapped value v are
+         * m_values[ m_values_begin[v] .. m_values_begin[v+1] ). */
+        std::vector<int> m_values_begin;
+        std::vector<int> m_values;
       
 
         /* FUNCTION MEMBERS */
@@ -75,23 +97,86 @@ namespace xylose {
         void reset() {
           for ( unsigned int i = 0; i < number_values; ++i )
             m_remap[i] = i;
+          m_n_values = -1;
+          m_values_begin.clear();
+          m_values.clear();
+        }
+
+        /** Change the remapped value of the original value i.  The values
+         * recorded by update() are discarded. */
+        void set( const unsigned int & i, const int & v ) {
+          m_remap[i] = v;
+          m_n_values = -1;
+          m_values_begin.clear();
+          m_values.clear();
+        }
+
+        /** Record the number of values and the reverse lookup of the current
+         * table.  The table must map onto the dense range [0,n). */
+        void update() {
+          const int n = *std::max_element( m_remap, m_remap + number_values )
+                      + 1;
+          m_values_begin.assign( n + 1, 0 );
+          for ( unsigned int i = 0; i < number_values; ++i )
+            ++m_values_begin[ m_remap[i] + 1 ];
+          for ( int v = 0; v < n; ++v )
+            m_values_begin[v+1] += m_values_begin[v];
+
+          m_values.resize( number_values );
+          std::vector<int> pos( m_values_begin.begin(), m_values_begin.end() - 1 );
+          for ( unsigned int i = 0; i < number_values; ++i )
+            m_values[ pos[ m_remap[i] ]++ ] = i;
+
+          m_n_values = n;
         }
 
-        /** Returns the number of unique values.  This function cannot be
-         * optimized away during compilation because it relies on runtime
-         * calculations.
+        /** Returns the number of unique values.  This is O(1) after update();
+         * otherwise it cannot be optimized away during compilation because
+         * it relies on runtime calculations.
          * */
         inline int getNumberValues() const {
+          if ( m_n_values >= 0 )
+            return m_n_values;
+
           /** \todo Is there a way to make this not rely on heap allocation? */
           std::set<int> s( m_remap, m_remap + number_values );
           return s.size();
         }
 
+        /** First of the original values that are remapped onto v (only valid
+         * after update()). */
+        const int * valuesBegin( const int & v ) const {
+          return &m_values[0] + m_values_begin[v];
+        }
+
+        /** End of the original values that are remapped onto v (only valid
+         * after update()). */
+        const int * valuesEnd( const int & v ) const {
+          return &m_values[0] + m_values_begin[v+1];
+        }
+
         /** Actual remap operation used when performing sorting. */
         template < typename Particle >
         inline int operator()(const Particle & p) const {
           return m_remap[super::operator()(p)];
         }
+
+        /** Batch computation of keys.  The keys of the wrapped map are
+         * computed in blocks (using its own batch function if it has one). */
+        template < typename Iter, typename OIter >
+        void keys( Iter first, const Iter & last, OIter out ) const {
+          const int block = 256;
+          int k[block];
+          while ( first != last ) {
+            Iter bi = first;
+            int n = 0;
+            for ( ; n < block && first != last; ++n, ++first );
+
+            detail::map_keys( static_cast<const super&>(*this), bi, first, k );
+            for ( int j = 0; j < n; ++j, ++out )
+              *out = m_remap[ k[j] ];
+          }
+        }
       };
 
     }
@@ -0,0 +1,165 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#include <xylose/nsort/map/hilbert.h>
+#include <xylose/nsort/map/remap.h>
+#include <xylose/nsort/map/w_species.h>
+
+#include <xylose/Vector.h>
+#include <xylose/Dimensions.hpp>
+
+#define BOOST_TEST_MODULE  hilbert
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cstdlib>
+
+
+namespace {
+  using xylose::Vector;
+  using xylose::V3;
+  using xylose::Dimensions;
+
+  struct UniformGrid {
+    Vector<double,3u> m_x0;
+    Vector<double,3u> m_dx;
+    Vector<unsigned int,3u> m_size;
+
+    UniformGrid( const Vector<unsigned int,3u> & size )
+      : m_x0( 0.0 ), m_dx (1.0), m_size( size ) { }
+
+    const Vector<double,3u> & x0() const { return m_x0; }
+    const Vector<double,3u> & dx() const { return m_dx; }
+    const Vector<unsigned int,3u> & size() const { return m_size; }
+  };
+
+  struct Particle {
+    Vector<double, 3u> x;
+    unsigned int species;
+    Particle(const Vector<double,3u> & x = 0.0,
+             const unsigned int & species = 0  ) : x(x), species(species) {}
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  const unsigned int & species( const Particle & p ) {
+    return p.species;
+  }
+
+  Particle cell( const double & i, const double & j, const double & k ) {
+    return Particle( V3( i + 0.5, j + 0.5, k + 0.5 ) );
+  }
+
+  /** Check that the map numbers the n^3 (or n^2) cells uniquely and that
+   * consecutive cells along the curve are face neighbors. */
+  template < typename Map >
+  void check_curve( const Map & map, const int & n, const int & nk ) {
+    const int n_cells = n * n * nk;
+    BOOST_REQUIRE_EQUAL( map.getNumberValues(), n_cells );
+
+    std::vector< Vector<int,3u> > at( n_cells, Vector<int,3u>(-1) );
+    for ( int k = 0; k < nk; ++k )
+      for ( int j = 0; j < n; ++j )
+        for ( int i = 0; i < n; ++i ) {
+          const int h = map( cell( i, j, k ) );
+          BOOST_REQUIRE( 0 <= h && h < n_cells );
+          BOOST_REQUIRE_EQUAL( at[h][0], -1 );
+          at[h] = Vector<int,3u>( V3( i, j, k ) );
+        }
+
+    for ( int h = 1; h < n_cells; ++h ) {
+      const int d = std::abs( at[h][0] - at[h-1][0] )
+                  + std::abs( at[h][1] - at[h-1][1] )
+                  + std::abs( at[h][2] - at[h-1][2] );
+      BOOST_CHECK_EQUAL( d, 1 );
+    }
+  }
+
+}
+
+
+BOOST_AUTO_TEST_CASE( map_hilbert_1D ) {
+  using xylose::nsort::map::hilbert;
+  typedef Dimensions<0u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(5u) );
+  hilbert< UniformGrid, dims > map(grid);
+
+  BOOST_CHECK_EQUAL( map.getNumberValues(), 8 );
+  for ( int i = 0; i < 5; ++i )
+    BOOST_CHECK_EQUAL( map( cell( i, 0, 0 ) ), i );
+}
+
+BOOST_AUTO_TEST_CASE( map_hilbert_2D ) {
+  using xylose::nsort::map::hilbert;
+  typedef Dimensions<0u,1u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(8u) );
+  check_curve( hilbert< UniformGrid, dims >(grid), 8, 1 );
+
+  /* not a power of two:  the curve covers the enclosing square. */
+  grid.m_size = Vector<unsigned int,3u>( V3(10, 5, 1) );
+  BOOST_CHECK_EQUAL( (hilbert< UniformGrid, dims >(grid).getNumberValues()),
+                     256 );
+}
+
+BOOST_AUTO_TEST_CASE( map_hilbert_3D ) {
+  using xylose::nsort::map::hilbert;
+  typedef Dimensions<0u,1u,2u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(4u) );
+  check_curve( hilbert< UniformGrid, dims >(grid), 4, 4 );
+}
+
+BOOST_AUTO_TEST_CASE( map_hilbert_w_species ) {
+  using xylose::nsort::map::hilbert;
+  using xylose::nsort::map::remap;
+  using xylose::nsort::map::w_species;
+  typedef Dimensions<0u,1u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(4u) );
+  hilbert< UniformGrid, dims > base(grid);
+
+  typedef w_species< hilbert< UniformGrid, dims > > map_t;
+  map_t map( std::make_pair( 3u, grid ) );
+  BOOST_CHECK_EQUAL( map.getNumberValues(), 48 );
+  BOOST_CHECK_EQUAL( map( Particle( V3(2.5, 1.5, 0.), 2u ) ),
+                     3 * base( cell( 2, 1, 0 ) ) + 2 );
+
+  typedef remap< hilbert< UniformGrid, dims, 2u > > rmap_t;
+  BOOST_CHECK_EQUAL( static_cast<int>(rmap_t::number_values), 16 );
+  rmap_t rmap( grid );
+  rmap.m_remap[ base( cell( 3, 0, 0 ) ) ] = 0;
+  BOOST_CHECK_EQUAL( rmap( cell( 3, 0, 0 ) ), 0 );
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 15 );
+}
+
+BOOST_AUTO_TEST_CASE( remap_hilbert_default_bits ) {
+  using xylose::nsort::map::hilbert;
+  using xylose::nsort::map::remap;
+  UniformGrid grid( Vector<unsigned int,3u>( V3(64, 40, 64) ) );
+
+  typedef remap< hilbert< UniformGrid > > rmap_t;
+  BOOST_CHECK_EQUAL( static_cast<int>(rmap_t::number_values), 1 << 18 );
+
+  rmap_t rmap( grid );
+  BOOST_CHECK_EQUAL( rmap( cell( 63, 39, 63 ) ),
+                     hilbert< UniformGrid >( grid )( cell( 63, 39, 63 ) ) );
+}
@@ -0,0 +1,154 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#include <xylose/nsort/map/morton.h>
+#include <xylose/nsort/map/remap.h>
+#include <xylose/nsort/map/w_species.h>
+
+#include <xylose/Vector.h>
+#include <xylose/Dimensions.hpp>
+
+#define BOOST_TEST_MODULE  morton
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+
+
+namespace {
+  using xylose::Vector;
+  using xylose::V3;
+  using xylose::Dimensions;
+
+  struct UniformGrid {
+    Vector<double,3u> m_x0;
+    Vector<double,3u> m_dx;
+    Vector<unsigned int,3u> m_size;
+
+    UniformGrid( const Vector<unsigned int,3u> & size )
+      : m_x0( 0.0 ), m_dx (1.0), m_size( size ) { }
+
+    const Vector<double,3u> & x0() const { return m_x0; }
+    const Vector<double,3u> & dx() const { return m_dx; }
+    const Vector<unsigned int,3u> & size() const { return m_size; }
+  };
+
+  struct Particle {
+    Vector<double, 3u> x;
+    unsigned int species;
+    Particle(const Vector<double,3u> & x = 0.0,
+             const unsigned int & species = 0  ) : x(x), species(species) {}
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  const unsigned int & species( const Particle & p ) {
+    return p.species;
+  }
+
+  Particle cell( const double & i, const double & j, const double & k ) {
+    return Particle( V3( i + 0.5, j + 0.5, k + 0.5 ) );
+  }
+
+}
+
+
+BOOST_AUTO_TEST_CASE( map_morton_2D ) {
+  using xylose::nsort::map::morton;
+  typedef Dimensions<0u,1u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(4u) );
+  morton< UniformGrid, dims > map(grid);
+
+  BOOST_CHECK_EQUAL( map.getNumberValues(), 16 );
+  BOOST_CHECK_EQUAL( map( cell( 0, 0, 0 ) ),  0 );
+  BOOST_CHECK_EQUAL( map( cell( 1, 0, 0 ) ),  1 );
+  BOOST_CHECK_EQUAL( map( cell( 0, 1, 0 ) ),  2 );
+  BOOST_CHECK_EQUAL( map( cell( 1, 1, 0 ) ),  3 );
+  BOOST_CHECK_EQUAL( map( cell( 2, 0, 0 ) ),  4 );
+  BOOST_CHECK_EQUAL( map( cell( 3, 3, 0 ) ), 15 );
+
+  /* clamped to the grid as in uniform_grid */
+  BOOST_CHECK_EQUAL( map( cell( -3, 10, 0 ) ), 10 );
+
+  /* not a power of two:  the code of the last cell bounds the values */
+  grid.m_size = Vector<unsigned int,3u>( V3(10, 5, 1) );
+  BOOST_CHECK_EQUAL( map.getNumberValues(), 98 );
+}
+
+BOOST_AUTO_TEST_CASE( map_morton_3D ) {
+  using xylose::nsort::map::morton;
+  typedef Dimensions<0u,1u,2u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>( V3(8, 8, 6) ) );
+  morton< UniformGrid, dims > map(grid);
+
+  BOOST_CHECK_EQUAL( map( cell( 1, 1, 1 ) ), 7 );
+  BOOST_CHECK_EQUAL( map( cell( 2, 0, 0 ) ), 8 );
+
+  std::set<int> codes;
+  for ( int k = 0; k < 6; ++k )
+    for ( int j = 0; j < 8; ++j )
+      for ( int i = 0; i < 8; ++i ) {
+        const int c = map( cell( i, j, k ) );
+        BOOST_CHECK( 0 <= c && c < map.getNumberValues() );
+        codes.insert( c );
+      }
+  BOOST_CHECK_EQUAL( codes.size(), 8u * 8u * 6u );
+}
+
+BOOST_AUTO_TEST_CASE( map_morton_w_species ) {
+  using xylose::nsort::map::morton;
+  using xylose::nsort::map::remap;
+  using xylose::nsort::map::w_species;
+  typedef Dimensions<0u,1u> dims;
+  UniformGrid grid( Vector<unsigned int,3u>(4u) );
+
+  typedef w_species< morton< UniformGrid, dims > > map_t;
+  map_t map( std::make_pair( 2u, grid ) );
+  BOOST_CHECK_EQUAL( map.getNumberValues(), 32 );
+  BOOST_CHECK_EQUAL( map( Particle( V3(1.5, 1.5, 0.), 1u ) ), 7 );
+
+  typedef remap< morton< UniformGrid, dims, 2u > > rmap_t;
+  BOOST_CHECK_EQUAL( static_cast<int>(rmap_t::number_values), 16 );
+  rmap_t rmap( grid );
+  rmap.m_remap[3] = 0;
+  BOOST_CHECK_EQUAL( rmap( cell( 1, 1, 0 ) ), 0 );
+  BOOST_CHECK_EQUAL( rmap( cell( 2, 0, 0 ) ), 4 );
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 15 );
+}
+
+BOOST_AUTO_TEST_CASE( remap_morton_default_bits ) {
+  using xylose::nsort::map::morton;
+  using xylose::nsort::map::remap;
+  UniformGrid grid( Vector<unsigned int,3u>( V3(64, 40, 64) ) );
+
+  typedef remap< morton< UniformGrid > > rmap_t;
+  BOOST_CHECK_EQUAL( static_cast<int>(rmap_t::number_values), 1 << 18 );
+  BOOST_CHECK_EQUAL( static_cast<int>(
+    remap< morton< UniformGrid, Dimensions<0u,1u> > >::number_values ),
+    1 << 18 );
+
+  rmap_t rmap( grid );
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 1 << 18 );
+  BOOST_CHECK_EQUAL( rmap( cell( 63, 39, 63 ) ),
+                     morton< UniformGrid >( grid )( cell( 63, 39, 63 ) ) );
+}
@@ -29,6 +29,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <iostream>
+#include <vector>
 
 
 namespace {
@@ -142,3 +143,20 @@ BOOST_AUTO_TEST_CASE( pivot_3D ) {
   BOOST_CHECK_EQUAL( map(p), 7 );
 }
 
+
+BOOST_AUTO_TEST_CASE( pivot_batch_keys ) {
+  using xylose::nsort::map::pivot;
+  using xylose::nsort::map::detail::has_batch_keys;
+  typedef pivot< Dimensions<0u,1u,2u> > map_t;
+  BOOST_CHECK( has_batch_keys<map_t>::value );
+  map_t map(V3(0.1,-0.2,0.3));
+
+  std::vector<Particle> p;
+  for ( int i = 0; i < 21; ++i )
+    p.push_back( Particle( V3( (i % 3) - 1.0, (i % 5) - 2.0, (i % 7) - 3.0 ) ) );
+
+  std::vector<int> k( p.size() );
+  map.keys( p.begin(), p.end(), k.begin() );
+  for ( unsigned int i = 0; i < p.size(); ++i )
+    BOOST_CHECK_EQUAL( k[i], map( p[i] ) );
+}
@@ -206,3 +206,32 @@ BOOST_AUTO_TEST_CASE( remap_3D ) {
 
 }
 
+
+BOOST_AUTO_TEST_CASE( remap_update ) {
+  using xylose::nsort::map::remap;
+  using xylose::nsort::map::pivot;
+  typedef remap< pivot< Dimensions<0u,1u> > > map_t;
+  map_t rmap(V3(0,0,0));
+
+  rmap.m_remap[0] = 0; rmap.m_remap[1] = 1;
+  rmap.m_remap[2] = 0; rmap.m_remap[3] = 1;
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 2 );
+
+  rmap.update();
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 2 );
+  BOOST_CHECK_EQUAL( rmap.valuesEnd(0) - rmap.valuesBegin(0), 2 );
+  BOOST_CHECK_EQUAL( rmap.valuesBegin(0)[0], 0 );
+  BOOST_CHECK_EQUAL( rmap.valuesBegin(0)[1], 2 );
+  BOOST_CHECK_EQUAL( rmap.valuesBegin(1)[0], 1 );
+  BOOST_CHECK_EQUAL( rmap.valuesBegin(1)[1], 3 );
+
+  /* set() discards the recorded number of values. */
+  rmap.set( 3, 2 );
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 3 );
+  BOOST_CHECK_EQUAL( rmap(Particle(V3(1,1,0))), 2 );
+  rmap.update();
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 3 );
+
+  rmap.reset();
+  BOOST_CHECK_EQUAL( rmap.getNumberValues(), 4 );
+}
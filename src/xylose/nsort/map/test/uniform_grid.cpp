@@ -29,6 +29,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <iostream>
+#include <vector>
 
 
 namespace {
@@ -213,3 +214,51 @@ BOOST_AUTO_TEST_CASE( map_uniform_grid_3D ) {
   }
 }
 
+
+BOOST_AUTO_TEST_CASE( map_uniform_grid_batch_keys ) {
+  using xylose::nsort::map::uniform_grid;
+  using xylose::nsort::map::detail::has_batch_keys;
+
+  typedef Dimensions<0u,1u,2u> dims;
+  typedef uniform_grid< UniformGrid<dims>, dims > map_t;
+  BOOST_CHECK( has_batch_keys<map_t>::value );
+
+  UniformGrid< dims > grid;
+  grid.m_x0 = V3( -5.0, -2.5, -1.0 );
+  grid.m_dx = V3( 0.3, 0.7, 1.1 );
+  map_t map(grid);
+
+  /* include a partial batch and points outside of the grid */
+  std::vector<Particle> p;
+  for ( int i = 0; i < 1003; ++i )
+    p.push_back( Particle( V3( -7.0 + 0.0137 * i,
+                               -4.0 + 0.0091 * i,
+                               -2.0 + 0.0053 * i ) ) );
+
+  std::vector<int> k( p.size() );
+  map.keys( p.begin(), p.end(), k.begin() );
+  for ( unsigned int i = 0; i < p.size(); ++i )
+    BOOST_CHECK_EQUAL( k[i], map( p[i] ) );
+}
+
+BOOST_AUTO_TEST_CASE( map_uniform_grid_cell_boundaries ) {
+  using xylose::nsort::map::uniform_grid;
+
+  /* (0.3 - 0.0) / 0.1 rounds down to 2.9999...; multiplying with the inverse
+   * cell size would round up to 3 instead. */
+  typedef Dimensions<0u> dims;
+  typedef uniform_grid< UniformGrid<dims>, dims > map_t;
+  UniformGrid< dims > grid;
+  grid.m_dx = 0.1;
+  map_t map(grid);
+
+  std::vector<Particle> p;
+  for ( int i = 0; i < 10; ++i )
+    p.push_back( Particle( V3( i / 10.0, 0., 0. ) ) );
+  BOOST_CHECK_EQUAL( map( p[3] ), 2 );
+
+  std::vector<int> k( p.size() );
+  map.keys( p.begin(), p.end(), k.begin() );
+  for ( unsigned int i = 0; i < p.size(); ++i )
+    BOOST_CHECK_EQUAL( k[i], map( p[i] ) );
+}
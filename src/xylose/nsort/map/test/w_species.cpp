@@ -30,6 +30,7 @@
 #define BOOST_TEST_MODULE  map_species
 
 #include <boost/test/unit_test.hpp>
+#include <vector>
 
 namespace {
   using xylose::Vector;
@@ -51,6 +52,16 @@ namespace {
     return p.species;
   }
 
+  /** A wrapper that only inherits the batch function of its base must not be
+   * taken to provide one. */
+  template < typename T >
+  struct plus_one : T {
+    template <class TT> plus_one(const TT & tt) : T(tt) {}
+
+    template < typename P >
+    int operator()( const P & p ) const { return T::operator()(p) + 1; }
+  };
+
 }
 
 BOOST_AUTO_TEST_CASE( map_1D_w_species ) {
@@ -86,3 +97,32 @@ BOOST_AUTO_TEST_CASE( remap_1D_w_species ) {
   BOOST_CHECK_EQUAL( rmap(p), 1 );
 }
 
+
+BOOST_AUTO_TEST_CASE( batch_keys_w_species ) {
+  using xylose::nsort::map::remap;
+  using xylose::nsort::map::pivot;
+  using xylose::nsort::map::w_species;
+  using xylose::nsort::map::detail::has_batch_keys;
+  using xylose::nsort::map::detail::map_keys;
+  typedef w_species< remap< pivot< Dimensions<0u,1u> > > > map_t;
+  map_t map( std::make_pair(3u, V3(0,0,0)) );
+  map.m_remap[2] = 1;
+
+  BOOST_CHECK( has_batch_keys<map_t>::value );
+  BOOST_CHECK( !has_batch_keys< plus_one< pivot< Dimensions<0u> > > >::value );
+
+  std::vector<Particle> p;
+  for ( int i = 0; i < 600; ++i )
+    p.push_back( Particle( V3( (i % 3) - 1.0, (i % 5) - 2.0, 0. ), i % 3 ) );
+
+  std::vector<int> k( p.size() );
+  map_keys( map, p.begin(), p.end(), k.begin() );
+  for ( unsigned int i = 0; i < p.size(); ++i )
+    BOOST_CHECK_EQUAL( k[i], map( p[i] ) );
+
+  /* the fallback for maps without a batch function */
+  plus_one< pivot< Dimensions<0u> > > pmap( V3(0,0,0) );
+  map_keys( pmap, p.begin(), p.end(), k.begin() );
+  for ( unsigned int i = 0; i < p.size(); ++i )
+    BOOST_CHECK_EQUAL( k[i], pmap( p[i] ) );
+}
@@ -26,6 +26,7 @@
 
 #include <xylose/Dimensions.hpp>
 #include <xylose/nsort/map/w_species.h>
+#include <xylose/nsort/map/detail/batch_keys.h>
 
 #include <cassert>
 
@@ -47,6 +48,7 @@ namespace xylose {
                  unsigned int _dir >
       struct uniform_grid<Uniform, Dimensions<_dir> > {
         typedef void super;
+        typedef uniform_grid batch_keys_map;
 
         const Uniform & g;
 
@@ -70,6 +72,15 @@ namespace xylose {
           register int max_val = static_cast<int>(g.size()[_dir]) - 1;
           return std::max(0, std::min( max_val, L ) );
         }
+
+        /** Compute the keys of all items in [first,last) into out.  The grid
+         * parameters are loaded once for all items and the loop is laid out
+         * such that the compiler can vectorize it.  The keys are identical to
+         * those of operator(). */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::uniform_grid_keys< Dimensions<_dir> >( g, first, last, out );
+        }
       };
 
       /** Grid sorting map for 2 (two) dimensions that (by default) matches the
@@ -82,6 +93,7 @@ namespace xylose {
       private:
         typedef uniform_grid<Uniform, Dimensions<dir0> > oneD;
       public:
+        typedef uniform_grid batch_keys_map;
 
         uniform_grid( const Uniform & g ) : oneD( g ) {
           assert( g.size()[_dir] > 0 );
@@ -106,6 +118,13 @@ namespace xylose {
                + (  std::max(0, std::min( max_val, L ) )
                   * this->g.size()[dir0] );
         }
+
+        /** Batch computation of keys (see the one dimensional version). */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::uniform_grid_keys< Dimensions<dir0,_dir> >( this->g,
+                                                              first, last, out );
+        }
       };
 
       /** Grid sorting map for 3 (three) dimensions that (by default) matches
@@ -119,6 +138,7 @@ namespace xylose {
       private:
         typedef uniform_grid<Uniform, Dimensions<dir0,dir1> > twoD;
       public:
+        typedef uniform_grid batch_keys_map;
 
         uniform_grid( const Uniform & g ) : twoD( g ) {
           assert( g.size()[_dir] > 0 );
@@ -145,6 +165,14 @@ namespace xylose {
                + (  std::max(0, std::min( max_val, L ) )
                   * (this->g.size()[dir0] * this->g.size()[dir1]) );
         }
+
+        /** Batch computation of keys (see the one dimensional version). */
+        template < typename Iter, typename OIter >
+        void keys( const Iter & first, const Iter & last, OIter out ) const {
+          detail::uniform_grid_keys< Dimensions<dir0,dir1,_dir> >( this->g,
+                                                                   first, last,
+                                                                   out );
+        }
       };
 
     }/* namespace xylose::nsort::map */
@@ -25,6 +25,9 @@
 #ifndef xylose_nsort_map_w_species_h
 #define xylose_nsort_map_w_species_h
 
+#include <xylose/nsort/map/detail/batch_keys.h>
+#include <xylose/ref_of.h>
+
 #include <utility>
 
 namespace xylose {
@@ -45,6 +48,7 @@ namespace xylose {
       struct w_species : T {
         typedef map::tag::w_species tag;
         typedef T super;
+        typedef w_species batch_keys_map;
         const unsigned int n_species;
 
         w_species(const unsigned int & n_species) : n_species(n_species) {}
@@ -66,6 +70,23 @@ namespace xylose {
           return n_species * T::operator()(p) + species(p);
         }
 
+        /** Batch computation of keys.  The keys of the wrapped map are
+         * computed in blocks (using its own batch function if it has one). */
+        template < typename Iter, typename OIter >
+        void keys( Iter first, const Iter & last, OIter out ) const {
+          const int block = 256;
+          int k[block];
+          while ( first != last ) {
+            Iter bi = first;
+            int n = 0;
+            for ( ; n < block && first != last; ++n, ++first );
+
+            detail::map_keys( static_cast<const T&>(*this), bi, first, k );
+            for ( int j = 0; j < n; ++j, ++bi, ++out )
+              *out = n_species * k[j] + species( ref_of(*bi) );
+          }
+        }
+
       };/*struct w_species */
     }/*namespace map */
   }/*namespace nsort */
@@ -0,0 +1,285 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  CellPairs
+
+#include <xylose/nsort/utility/PCellPairs.h>
+#include <xylose/nsort/utility/CellPairs.h>
+#include <xylose/nsort/map/uniform_grid.h>
+#include <xylose/nsort/map/w_species.h>
+#include <xylose/nsort/map/args.h>
+#include <xylose/nsort/NSort.h>
+#include <xylose/random/Kiss.hpp>
+#include <xylose/Vector.h>
+#include <xylose/Dimensions.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+
+namespace {
+  using xylose::Vector;
+  using xylose::Dimensions;
+  using xylose::nsort::utility::CellPairs;
+  using xylose::nsort::utility::PCellPairs;
+
+  typedef CellPairs<3u> Pairs;
+
+  struct Grid {
+    Vector<double,3u> m_x0;
+    Vector<double,3u> m_dx;
+    Vector<unsigned int,3u> m_size;
+
+    Grid( const Vector<int,3u> & n ) : m_x0( 0.0 ), m_dx( 1.0 ), m_size( n ) { }
+
+    const Vector<double,3u> & x0() const { return m_x0; }
+    const Vector<double,3u> & dx() const { return m_dx; }
+    const Vector<unsigned int,3u> & size() const { return m_size; }
+  };
+
+  struct Particle {
+    Vector<double,3u> x;
+    unsigned int species;
+    int id;
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  inline const unsigned int & species( const Particle & p ) {
+    return p.species;
+  }
+
+  typedef xylose::nsort::map::w_species<
+    xylose::nsort::map::uniform_grid< Grid, Dimensions<0u,1u,2u> >
+  > map_t;
+
+  const int n_species = 2;
+
+  /** Particles sorted into the cells of the grid with 2 species. */
+  std::vector<Particle> makeSorted( const Vector<int,3u> & n,
+                                    const int & n_particles,
+                                    Pairs & pairs ) {
+    xylose::random::Kiss rng;
+    std::vector<Particle> p( n_particles );
+    for ( int i = 0; i < n_particles; ++i ) {
+      for ( int d = 0; d < 3; ++d )
+        p[i].x[d] = rng.randExc() * n[d];
+      p[i].species = static_cast<unsigned int>( rng.randExc() * n_species );
+      p[i].id = i;
+    }
+
+    Grid grid( n );
+    map_t m( xylose::nsort::map::make_arg( n_species, grid ) );
+    xylose::nsort::NSort<map_t> s( m.getNumberValues() );
+    s.sort( p.begin(), p.end(), m );
+    pairs.setRanges( s, n_species );
+    return p;
+  }
+
+  /** Brute force number of neighbors (in the same or any neighboring cell)
+   * of each particle. */
+  std::vector<int> bruteForce( const std::vector<Particle> & p,
+                               const Pairs & pairs ) {
+    const Vector<int,3u> & n = pairs.getNumberCells();
+    const int r = pairs.getRadius();
+    std::vector<int> count( p.size(), 0 );
+    for ( unsigned int i = 0u; i < p.size(); ++i )
+      for ( unsigned int j = i + 1u; j < p.size(); ++j ) {
+        bool nb = true;
+        for ( int d = 0; d < 3; ++d ) {
+          int dc = std::abs( static_cast<int>( p[i].x[d] )
+                           - static_cast<int>( p[j].x[d] ) );
+          if ( pairs.getBoundary(d) == Pairs::PERIODIC )
+            dc = std::min( dc, n[d] - dc );
+          nb = nb && dc <= r;
+        }
+        if ( nb ) {
+          ++count[ p[i].id ];
+          ++count[ p[j].id ];
+        }
+      }
+    return count;
+  }
+
+  /** Count the neighbors of the particles of both cells. */
+  struct HalfCounter {
+    std::vector<Particle> & p;
+    std::vector<int> count;
+    bool saw_empty;
+
+    HalfCounter( std::vector<Particle> & p )
+      : p(p), count( p.size(), 0 ), saw_empty( false ) { }
+
+    void operator()( const Pairs::Cell & a, const Pairs::Cell & b ) {
+      saw_empty = saw_empty || a.size() == 0 || b.size() == 0;
+      for ( int i = a.begin; i < a.end; ++i )
+        for ( int j = ( a.index == b.index ? i + 1 : b.begin ); j < b.end; ++j ) {
+          ++count[ p[i].id ];
+          ++count[ p[j].id ];
+        }
+    }
+  };
+
+  /** Count the neighbors of the particles of the first cell only. */
+  struct FullCounter {
+    std::vector<Particle> & p;
+    std::vector<int> count;
+
+    FullCounter( std::vector<Particle> & p ) : p(p), count( p.size(), 0 ) { }
+
+    void operator()( const Pairs::Cell & a, const Pairs::Cell & b ) {
+      for ( int i = a.begin; i < a.end; ++i )
+        for ( int j = b.begin; j < b.end; ++j )
+          if ( i != j )
+            ++count[ p[i].id ];
+    }
+  };
+
+  /** Records which block touched each cell. */
+  struct Owner {
+    std::vector<int> & owner;
+    int block;
+    bool conflict;
+
+    Owner( std::vector<int> & owner )
+      : owner(owner), block(0), conflict(false) { }
+
+    void mark( const int & c ) {
+      conflict = conflict || ( owner[c] >= 0 && owner[c] != block );
+      owner[c] = block;
+    }
+
+    void operator()( const Pairs::Cell & a, const Pairs::Cell & b ) {
+      mark( a.index );
+      mark( b.index );
+    }
+  };
+
+  Vector<int,3u> cells( const int & nx, const int & ny, const int & nz ) {
+    Vector<int,3u> n;
+    n[0] = nx;
+    n[1] = ny;
+    n[2] = nz;
+    return n;
+  }
+
+}
+
+BOOST_AUTO_TEST_SUITE( CellPairs_tests );
+
+BOOST_AUTO_TEST_CASE( stencil ) {
+  Pairs half( cells(5,5,5), 1 );
+  BOOST_CHECK_EQUAL( half.getStencil().size(), 14u );
+
+  Pairs full( cells(5,5,5), 2, Pairs::CLAMPED, false );
+  BOOST_CHECK_EQUAL( full.getStencil().size(), 125u );
+  for ( int d = 0; d < 3; ++d )
+    BOOST_CHECK_EQUAL( full.getStencil()[0][d], 0 );
+
+  Pairs p( cells(4,3,3), 1 );
+  p.setBoundary( 0u, Pairs::PERIODIC );
+  for ( int c = 0; c < p.size(); ++c )
+    BOOST_CHECK_EQUAL( p.index( p.position(c) ), c );
+
+  BOOST_CHECK_EQUAL( p.neighbor( cells(3,0,0), cells(1,0,0) ), 0 );
+  BOOST_CHECK_EQUAL( p.neighbor( cells(0,0,0), cells(-1,1,0) ), 7 );
+  BOOST_CHECK_EQUAL( p.neighbor( cells(0,0,0), cells(0,-1,0) ), -1 );
+  BOOST_CHECK_EQUAL( p.neighbor( cells(0,0,2), cells(0,0,1) ), -1 );
+}
+
+BOOST_AUTO_TEST_CASE( half_shell_clamped ) {
+  Pairs pairs( cells(10,7,5), 1 );
+  std::vector<Particle> p = makeSorted( cells(10,7,5), 300, pairs );
+
+  HalfCounter f( p );
+  pairs.for_each_pair( f );
+  BOOST_CHECK( !f.saw_empty );
+  BOOST_CHECK( f.count == bruteForce( p, pairs ) );
+}
+
+BOOST_AUTO_TEST_CASE( half_shell_periodic ) {
+  Pairs pairs( cells(10,7,5), 2, Pairs::PERIODIC );
+  std::vector<Particle> p = makeSorted( cells(10,7,5), 300, pairs );
+
+  HalfCounter f( p );
+  pairs.for_each_pair( f );
+  BOOST_CHECK( f.count == bruteForce( p, pairs ) );
+}
+
+BOOST_AUTO_TEST_CASE( full_shell ) {
+  Pairs pairs( cells(6,6,6), 1, Pairs::PERIODIC, false );
+  pairs.setBoundary( 2u, Pairs::CLAMPED );
+  std::vector<Particle> p = makeSorted( cells(6,6,6), 100, pairs );
+
+  FullCounter f( p );
+  pairs.for_each_pair( f );
+  BOOST_CHECK( f.count == bruteForce( p, pairs ) );
+}
+
+BOOST_AUTO_TEST_CASE( coloring ) {
+  for ( int periodic = 0; periodic < 2; ++periodic )
+    for ( int r = 1; r <= 2; ++r ) {
+      Pairs pairs( cells(11,10,7), r,
+                   periodic ? Pairs::PERIODIC : Pairs::CLAMPED );
+      /* every cell non-empty */
+      std::vector<Particle> p = makeSorted( cells(11,10,7), 20000, pairs );
+      BOOST_REQUIRE_EQUAL( static_cast<int>( pairs.getNonEmpty().size() ),
+                           pairs.size() );
+
+      int n_blocks = 0;
+      for ( int color = 0; color < pairs.getNumberColors(); ++color ) {
+        std::vector<Pairs::Block> blocks;
+        pairs.getBlocks( color, blocks );
+        n_blocks += blocks.size();
+
+        std::vector<int> owner( pairs.size(), -1 );
+        Owner f( owner );
+        for ( unsigned int b = 0u; b < blocks.size(); ++b ) {
+          f.block = b;
+          pairs.for_each_pair( blocks[b], f );
+        }
+        BOOST_CHECK( !f.conflict );
+      }
+
+      /* the blocks cover the grid */
+      int n = 1;
+      for ( int d = 0; d < 3; ++d )
+        n *= std::max( 1, pairs.getNumberCells()[d] / (2*r) );
+      BOOST_CHECK_EQUAL( n_blocks, n );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( parallel ) {
+  typedef PCellPairs<3u> PPairs;
+  PPairs pairs( cells(12,9,8), 1, PPairs::PERIODIC, true, 4 );
+  std::vector<Particle> p = makeSorted( cells(12,9,8), 2000, pairs );
+
+  HalfCounter f( p );
+  pairs.for_each_pair( f );
+  BOOST_CHECK( f.count == bruteForce( p, pairs ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
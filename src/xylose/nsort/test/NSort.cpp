@@ -26,6 +26,166 @@
 
 #include <boost/test/unit_test.hpp>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+
+
+namespace {
+
+  /** Number of allocations done through CountingAllocator. */
+  int n_allocations = 0;
+
+  /** Allocator that counts the number of allocations. */
+  template < typename T >
+  struct CountingAllocator : std::allocator<T> {
+    template < typename U >
+    struct rebind { typedef CountingAllocator<U> other; };
+
+    CountingAllocator() { }
+
+    template < typename U >
+    CountingAllocator( const CountingAllocator<U> & ) { }
+
+    T * allocate( std::size_t n, const void * = 0 ) {
+      ++n_allocations;
+      return std::allocator<T>::allocate( n );
+    }
+  };
+
+  /** Map that counts the number of times it is evaluated. */
+  struct CountingMap {
+    int * n_calls;
+    CountingMap( int * n_calls = NULL ) : n_calls(n_calls) { }
+
+    inline int operator()( const int & i ) const {
+      ++(*n_calls);
+      return i;
+    }
+  };
+
+  /** Sort a pseudo-random vector with n_values buckets using cached_sort and
+   * check against std::sort. */
+  void check_cached_sort( const int & len, const int & n_values ) {
+    std::vector<int> v( len );
+    for ( int i = 0; i < len; ++i )
+      v[i] = static_cast<int>( ( 2654435761u * i ) % n_values );
+    std::vector<int> ans( v );
+    std::sort( ans.begin(), ans.end() );
+
+    int n_calls = 0;
+    xylose::nsort::NSort< CountingMap > s( n_values );
+    s.cached_sort( v.begin(), v.end(), CountingMap(&n_calls) );
+
+    BOOST_CHECK_EQUAL( n_calls, len );
+    BOOST_CHECK( v == ans );
+    for ( int i = 0; i < n_values; ++i ) {
+      const int b = std::lower_bound( ans.begin(), ans.end(), i ) - ans.begin();
+      BOOST_CHECK_EQUAL( s.begin(i), b );
+    }
+  }
+
+  /** Value with an attached sequence number to test for stability. */
+  struct Item {
+    int value;
+    int seq;
+  };
+
+  struct ItemMap {
+    inline int operator()( const Item & i ) const { return i.value; }
+  };
+
+  /** Check that v is sorted by value and stable (by sequence). */
+  bool is_stable_sorted( const std::vector<Item> & v ) {
+    for ( unsigned int i = 1; i < v.size(); ++i ) {
+      if ( v[i-1].value > v[i].value ) return false;
+      if ( v[i-1].value == v[i].value && v[i-1].seq > v[i].seq ) return false;
+    }
+    return true;
+  }
+
+  /** Number of AlignedItem copies constructed at a misaligned address. */
+  int n_misaligned = 0;
+
+  /** Item that requires a stricter alignment than double. */
+  struct AlignedItem {
+    int value;
+    AlignedItem( const int & value = 0 ) : value(value) { }
+    AlignedItem( const AlignedItem & that ) : value(that.value) {
+      if ( reinterpret_cast<std::size_t>(this) % 32u != 0u )
+        ++n_misaligned;
+    }
+  } __attribute__((aligned(32)));
+
+  struct AlignedItemMap {
+    inline int operator()( const AlignedItem & i ) const { return i.value; }
+  };
+
+  /** Sort with stable_sort_copy and then ping-pong back for a second
+   * "timestep". */
+  void check_stable_sort_copy( const int & n_values, const bool & wc ) {
+    const int len = 20000;
+    std::vector<Item> a( len ), b( len );
+    for ( int i = 0; i < len; ++i ) {
+      a[i].value = static_cast<int>( ( 2654435761u * i ) % n_values );
+      a[i].seq   = i;
+    }
+
+    xylose::nsort::NSort< ItemMap > s( n_values );
+    s.set_write_combining( wc );
+    s.stable_sort_copy( a.begin(), a.end(), b.begin() );
+    BOOST_CHECK( is_stable_sorted( b ) );
+    for ( int i = 0; i < len; ++i ) {
+      BOOST_REQUIRE( s.begin( b[i].value ) <= i );
+      BOOST_REQUIRE( i < s.end( b[i].value ) );
+    }
+
+    /* next "timestep":  change the values and ping-pong back into a. */
+    for ( int i = 0; i < len; ++i ) {
+      b[i].value = ( b[i].value + i ) % n_values;
+      b[i].seq   = i;
+    }
+    s.stable_sort_copy( b.begin(), b.end(), a.begin() );
+    BOOST_CHECK( is_stable_sorted( a ) );
+  }
+
+  /** Sort, move a few items to new buckets, and resort incrementally.  Only a
+   * small fraction of the positions should change when the items only move
+   * to neighboring buckets. */
+  void check_resort( const int & n_values, const int & n_migrants ) {
+    const int len = 20000;
+    std::vector<Item> v( len );
+    for ( int i = 0; i < len; ++i ) {
+      v[i].value = static_cast<int>( ( 2654435761u * i ) % n_values );
+      v[i].seq   = i;
+    }
+
+    xylose::nsort::NSort< ItemMap > s( n_values );
+    s.resort( v.begin(), v.end() ); /* no previous sort:  full sort */
+    for ( int i = 1; i < len; ++i )
+      BOOST_REQUIRE( v[i-1].value <= v[i].value );
+
+    for ( int i = 0; i < n_migrants; ++i ) {
+      Item & it = v[ ( 7919u * i ) % len ];
+      it.value = ( it.value + 1 ) % n_values;
+    }
+    const std::vector<Item> before( v );
+    s.resort( v.begin(), v.end() );
+
+    int n_changed = 0;
+    for ( int i = 0; i < len; ++i ) {
+      if ( i > 0 )
+        BOOST_REQUIRE( v[i-1].value <= v[i].value );
+      BOOST_REQUIRE( s.begin( v[i].value ) <= i );
+      BOOST_REQUIRE( i < s.end( v[i].value ) );
+      if ( v[i].seq != before[i].seq )
+        ++n_changed;
+    }
+    BOOST_CHECK( n_changed < len / 10 );
+  }
+
+}
 
 
 BOOST_AUTO_TEST_SUITE( NSort );
@@ -55,5 +215,127 @@ BOOST_AUTO_TEST_CASE( std_vector ) {
     BOOST_CHECK_EQUAL( sv[i], ans[i] );
 }
 
+BOOST_AUTO_TEST_CASE( cached_c_array ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {0, 0, 1, 1, 1, 2, 2, 2, 3, 4};
+  xylose::nsort::NSort<> s(len);
+  s.cached_sort(static_cast<int*>(v), v+len);
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( v[i], ans[i] );
+}
+
+BOOST_AUTO_TEST_CASE( cached_key_widths ) {
+  check_cached_sort( 10000, 200 );    /* uint8_t keys  */
+  check_cached_sort( 10000, 3000 );   /* uint16_t keys */
+  check_cached_sort( 10000, 70000 );  /* uint32_t keys */
+}
+
+BOOST_AUTO_TEST_CASE( stable_copy ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {0, 0, 1, 1, 1, 2, 2, 2, 3, 4};
+  int out[len];
+  xylose::nsort::NSort<> s(len);
+  s.stable_sort_copy(static_cast<int*>(v), v+len, static_cast<int*>(out));
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( out[i], ans[i] );
+  BOOST_CHECK_EQUAL( s.begin(2), 5 );
+  BOOST_CHECK_EQUAL( s.end(2), 8 );
+}
+
+BOOST_AUTO_TEST_CASE( stable_copy_ping_pong ) {
+  check_stable_sort_copy( 13, false );
+  check_stable_sort_copy( 13, true );
+  check_stable_sort_copy( 1000, true );
+  check_stable_sort_copy( 70000, true ); /* too many buckets to stage */
+}
+
+BOOST_AUTO_TEST_CASE( stable_copy_aligned_staging ) {
+  const int len = 1000, n_values = 17;
+  std::vector<AlignedItem> a, b( len );
+  for ( int i = 0; i < len; ++i )
+    a.push_back( AlignedItem( ( 7 * i ) % n_values ) );
+
+  xylose::nsort::NSort< AlignedItemMap > s( n_values );
+  s.set_write_combining( true );
+  n_misaligned = 0;
+  s.stable_sort_copy( a.begin(), a.end(), b.begin() );
+  BOOST_CHECK_EQUAL( n_misaligned, 0 );
+  for ( int i = 1; i < len; ++i )
+    BOOST_REQUIRE( b[i-1].value <= b[i].value );
+}
+
+BOOST_AUTO_TEST_CASE( resort_c_array ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {0, 0, 0, 1, 1, 2, 2, 3, 4, 4};
+  xylose::nsort::NSort<> s(len);
+  s.sort(static_cast<int*>(v), v+len);
+
+  /* {0, 0, 1, 1, 1, 2, 2, 2, 3, 4} -> two migrants */
+  v[2] = 4;
+  v[7] = 0;
+  s.resort(static_cast<int*>(v), v+len);
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( v[i], ans[i] );
+  BOOST_CHECK_EQUAL( s.begin(1), 3 );
+  BOOST_CHECK_EQUAL( s.end(4), 10 );
+}
+
+BOOST_AUTO_TEST_CASE( resort_migrants ) {
+  check_resort( 13, 0 );
+  check_resort( 13, 50 );
+  check_resort( 1000, 200 );
+  check_resort( 70000, 200 );
+}
+
+BOOST_AUTO_TEST_CASE( workspace_reuse ) {
+  typedef xylose::nsort::NSort< ItemMap, xylose::nsort::tweak::Null,
+                                CountingAllocator<int> > sorter;
+  const int len = 5000;
+  std::vector<Item> a( len ), b( len );
+  std::vector<int> perm( len );
+  for ( int i = 0; i < len; ++i ) {
+    a[i].value = static_cast<int>( ( 2654435761u * i ) % 300 );
+    a[i].seq   = i;
+  }
+
+  sorter s( 300 );
+  s.set_write_combining( true );
+  s.reserve( len );
+  s.stable_sort_copy( a.begin(), a.end(), b.begin() );
+
+  /* steady state:  no allocations for any sort of no more items */
+  n_allocations = 0;
+  for ( int r = 0; r < 3; ++r ) {
+    s.sort( a.begin(), a.end() );
+    s.cached_sort( b.begin(), b.end() );
+    s.stable_sort_copy( a.begin(), a.end(), b.begin() );
+    s.permutation( a.begin(), a.begin() + len / 2, perm.begin() );
+    s.resort( b.begin(), b.end() );
+  }
+  BOOST_CHECK_EQUAL( n_allocations, 0 );
+
+  /* change the number of buckets */
+  s.resize( 1000 );
+  BOOST_CHECK_EQUAL( s.size(), 1000 );
+  for ( int i = 0; i < len; ++i ) {
+    a[i].value = static_cast<int>( ( 2654435761u * i ) % 1000 );
+    a[i].seq   = i;
+  }
+  s.stable_sort_copy( a.begin(), a.end(), b.begin() );
+  BOOST_CHECK( is_stable_sorted( b ) );
+  BOOST_CHECK_EQUAL( s.end( 999 ), len );
+
+  n_allocations = 0;
+  s.resize( 200 );
+  s.cached_sort( b.begin(), b.begin() + 100 );
+  BOOST_CHECK_EQUAL( n_allocations, 0 );
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
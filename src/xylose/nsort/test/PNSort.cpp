@@ -0,0 +1,174 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  PNSort
+
+#include <xylose/nsort/PNSort.h>
+#include <xylose/random/Kiss.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+
+namespace {
+
+  /** Value with an attached sequence number to test for stability. */
+  struct Item {
+    int value;
+    int seq;
+  };
+
+  struct ItemMap {
+    inline int operator()( const Item & i ) const { return i.value; }
+  };
+
+  std::vector<Item> makeItems( const int & len, const int & n_values ) {
+    xylose::random::Kiss rng;
+    std::vector<Item> v(len);
+    for ( int i = 0; i < len; ++i ) {
+      v[i].value = static_cast<int>( rng.randExc() * n_values );
+      v[i].seq   = i;
+    }
+    return v;
+  }
+
+  /** Counts live instances and throws on the n'th copy (if n > 0). */
+  struct Counted {
+    static int live;
+    static int copies_left;
+
+    int value;
+
+    Counted( const int & value = 0 ) : value(value) { ++live; }
+    Counted( const Counted & that ) : value(that.value) {
+      if ( copies_left > 0 && --copies_left == 0 )
+        throw std::runtime_error( "copy failed" );
+      ++live;
+    }
+    ~Counted() { --live; }
+  };
+
+  int Counted::live = 0;
+  int Counted::copies_left = 0;
+
+  struct CountedMap {
+    inline int operator()( const Counted & c ) const { return c.value; }
+  };
+
+}
+
+BOOST_AUTO_TEST_SUITE( PNSort );
+
+BOOST_AUTO_TEST_CASE( small_falls_back_to_serial ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {0, 0, 1, 1, 1, 2, 2, 2, 3, 4};
+  xylose::nsort::PNSort<> s(len, 4);
+  s.sort(static_cast<int*>(v), v+len);
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( v[i], ans[i] );
+}
+
+BOOST_AUTO_TEST_CASE( threaded_stable ) {
+  const int len = 100000;
+  const int n_values = 37;
+  std::vector<Item> v = makeItems( len, n_values );
+
+  std::vector<int> count( n_values, 0 );
+  for ( int i = 0; i < len; ++i )
+    ++count[ v[i].value ];
+
+  xylose::pthreadCache.set_max_threads(4);
+  xylose::nsort::PNSort< ItemMap > s( n_values, 4 );
+  s.sort( v.begin(), v.end() );
+
+  for ( int i = 0, b = 0; i < n_values; ++i ) {
+    BOOST_CHECK_EQUAL( s.begin(i), b );
+    BOOST_CHECK_EQUAL( s.size(i), count[i] );
+    b += count[i];
+  }
+
+  for ( int i = 1; i < len; ++i ) {
+    BOOST_REQUIRE( v[i-1].value <= v[i].value );
+    if ( v[i-1].value == v[i].value )
+      BOOST_REQUIRE( v[i-1].seq < v[i].seq );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( thread_counts_agree ) {
+  const int len = 50000;
+  const int n_values = 1000;
+  const std::vector<Item> orig = makeItems( len, n_values );
+
+  xylose::pthreadCache.set_max_threads(8);
+  std::vector<Item> ref = orig;
+  xylose::nsort::PNSort< ItemMap > s1( n_values, 1 );
+  s1.sort( ref.begin(), ref.end() );
+
+  for ( int n = 2; n <= 8; ++n ) {
+    std::vector<Item> v = orig;
+    xylose::nsort::PNSort< ItemMap > s( n_values, n );
+    s.sort( v.begin(), v.end() );
+
+    for ( int i = 0; i < n_values; ++i ) {
+      BOOST_CHECK_EQUAL( s.begin(i), s1.begin(i) );
+      BOOST_CHECK_EQUAL( s.end(i), s1.end(i) );
+    }
+
+    for ( int i = 0; i < len; ++i )
+      BOOST_REQUIRE_EQUAL( v[i].value, ref[i].value );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( failed_copy_destroys_buffer ) {
+  const int len = 40000;
+  const int n_values = 13;
+
+  xylose::pthreadCache.set_max_threads(4);
+  xylose::nsort::PNSort< CountedMap > s( n_values, 4 );
+
+  {
+    std::vector<Counted> v;
+    v.reserve( len );
+    for ( int i = 0; i < len; ++i )
+      v.push_back( Counted( (i * 7) % n_values ) );
+    BOOST_CHECK_EQUAL( Counted::live, len );
+
+    Counted::copies_left = len / 2;
+    BOOST_CHECK_THROW( s.sort( v.begin(), v.end() ), std::runtime_error );
+    BOOST_CHECK_EQUAL( Counted::live, len );
+
+    /* the workspace is still usable afterwards. */
+    Counted::copies_left = 0;
+    s.sort( v.begin(), v.end() );
+    BOOST_CHECK_EQUAL( Counted::live, len );
+    for ( int i = 1; i < len; ++i )
+      BOOST_REQUIRE( v[i-1].value <= v[i].value );
+  }
+
+  BOOST_CHECK_EQUAL( Counted::live, 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,181 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  PivotTree
+
+#include <xylose/nsort/utility/PivotTree.h>
+#include <xylose/nsort/tweak/median.h>
+#include <xylose/nsort/map/pivot.h>
+#include <xylose/nsort/NSort.h>
+#include <xylose/Vector.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+
+namespace {
+  using xylose::Vector;
+  using xylose::V3;
+  using xylose::Dimensions;
+
+  struct Particle {
+    Vector<double,3u> x;
+    Particle( const Vector<double,3u> & x = 0.0 ) : x(x) { }
+  };
+
+  inline const Vector<double,3u> & position( const Particle & p ) {
+    return p.x;
+  }
+
+  /** Skewed (but independent) distribution in each direction. */
+  std::vector<Particle> makeParticles( const int & n ) {
+    std::vector<Particle> p( n );
+    unsigned int s = 12345u;
+    for ( int i = 0; i < n; ++i )
+      for ( int d = 0; d < 3; ++d ) {
+        s = 1664525u * s + 1013904223u;
+        const double u = (s >> 8) / 16777216.0;
+        p[i].x[d] = std::pow( u, 3.0 + d ) * (d + 1);
+      }
+    return p;
+  }
+
+  /** Check the structure of the tree and that each particle of each child is
+   * on the correct side of the split of its parent. */
+  template < typename Tree >
+  void check_tree( const Tree & tree, const std::vector<Particle> & p,
+                   const int & leaf_size, const int & max_children ) {
+    typedef typename Tree::Node Node;
+    typedef typename Tree::pivot_map pivot_map;
+    const std::vector<Node> & nodes = tree.getNodes();
+
+    BOOST_CHECK_EQUAL( tree.root().begin, 0 );
+    BOOST_CHECK_EQUAL( tree.root().end, static_cast<int>(p.size()) );
+
+    for ( unsigned int n = 0u; n < nodes.size(); ++n ) {
+      const Node & node = nodes[n];
+      if ( node.isLeaf() ) {
+        BOOST_CHECK( node.size() <= leaf_size );
+        continue;
+      }
+
+      BOOST_REQUIRE( node.n_children >= 2 );
+      BOOST_REQUIRE( node.n_children <= max_children );
+      pivot_map map( node.point );
+      int cur = node.begin;
+      for ( int c = 0; c < node.n_children; ++c ) {
+        const Node & child = tree.child( node, c );
+        BOOST_REQUIRE_EQUAL( child.begin, cur );
+        BOOST_REQUIRE_EQUAL( child.depth, node.depth + 1 );
+        cur = child.end;
+        for ( int i = child.begin + 1; i < child.end; ++i )
+          BOOST_REQUIRE_EQUAL( map( p[i] ), map( p[child.begin] ) );
+      }
+      BOOST_REQUIRE_EQUAL( cur, node.end );
+    }
+  }
+
+}
+
+
+BOOST_AUTO_TEST_SUITE( PivotTree );
+
+BOOST_AUTO_TEST_CASE( median_balances_pivot ) {
+  using xylose::nsort::NSort;
+  using xylose::nsort::map::pivot;
+  using xylose::nsort::tweak::median;
+  const int n = 20000;
+
+  {
+    std::vector<Particle> p = makeParticles( n );
+    pivot< Dimensions<1u> > map;
+    median<> m;
+    m.measure( p.begin(), p.end(), map );
+    NSort< pivot< Dimensions<1u> >, median<> > s( 2 );
+    s.cached_sort( p.begin(), p.end(), map, m );
+
+    BOOST_CHECK( std::abs( s.size(0) - n / 2 ) <= n / 1000 );
+    BOOST_CHECK( m.max_count() - m.min_count() <= n / 500 );
+  }
+
+  {
+    /* independent directions:  each octant has about n/8 particles */
+    std::vector<Particle> p = makeParticles( n );
+    pivot< Dimensions<0u,1u,2u> > map;
+    median<> m;
+    m.measure( p.begin(), p.end(), map );
+    NSort< pivot< Dimensions<0u,1u,2u> >, median<> > s( 8 );
+    s.cached_sort( p.begin(), p.end(), map, m );
+
+    for ( int i = 0; i < 8; ++i )
+      BOOST_CHECK( std::abs( s.size(i) - n / 8 ) < n / 40 );
+  }
+
+  {
+    /* inactive directions fall on the upper side */
+    std::vector<Particle> p = makeParticles( 100 );
+    pivot< Dimensions<0u,1u> > map;
+    median<> m;
+    m.measure( p.begin(), p.end(), map, 2u );
+    BOOST_CHECK_EQUAL( map.point[0], -std::numeric_limits<double>::infinity() );
+    BOOST_CHECK( m.lower()[1] < map.point[1] && map.point[1] < m.upper()[1] );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( octree ) {
+  const int n = 20000, leaf_size = 50;
+  std::vector<Particle> p = makeParticles( n );
+  xylose::nsort::utility::PivotTree<> tree;
+  tree.build( p.begin(), p.end(), leaf_size );
+
+  check_tree( tree, p, leaf_size, 8 );
+  BOOST_CHECK_EQUAL( tree.root().n_children, 8 );
+}
+
+BOOST_AUTO_TEST_CASE( kd_tree ) {
+  const int n = 20000, leaf_size = 50;
+  std::vector<Particle> p = makeParticles( n );
+  xylose::nsort::utility::PivotTree<> tree;
+  tree.build( p.begin(), p.end(), leaf_size, true );
+
+  check_tree( tree, p, leaf_size, 2 );
+
+  /* balanced:  depth close to log2(n/leaf_size) */
+  int max_depth = 0;
+  for ( unsigned int i = 0u; i < tree.getNodes().size(); ++i )
+    max_depth = std::max( max_depth, tree.getNodes()[i].depth );
+  BOOST_CHECK( max_depth <= 10 );
+}
+
+BOOST_AUTO_TEST_CASE( degenerate ) {
+  /* particles at one position cannot be split */
+  std::vector<Particle> p( 100, Particle( V3( 1., 2., 3. ) ) );
+  xylose::nsort::utility::PivotTree<> tree;
+  tree.build( p.begin(), p.end(), 10 );
+  BOOST_CHECK_EQUAL( tree.getNodes().size(), 1u );
+  BOOST_CHECK( tree.root().isLeaf() );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,159 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  RadixNSort
+
+#include <xylose/nsort/RadixNSort.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <algorithm>
+
+
+namespace {
+
+  /** Value with an attached sequence number to test for stability. */
+  struct Item {
+    int value;
+    int seq;
+  };
+
+  struct ItemMap {
+    inline int operator()( const Item & i ) const { return i.value; }
+  };
+
+  /** Sort len pseudo-random items with n_values buckets and check the order,
+   * the stability, and the bucket boundaries. */
+  void check_radix_sort( xylose::nsort::RadixNSort< ItemMap > & s,
+                         const int & len ) {
+    const int n_values = s.size();
+    std::vector<Item> v( len );
+    for ( int i = 0; i < len; ++i ) {
+      v[i].value = static_cast<int>( ( 2654435761u * i ) % n_values );
+      v[i].seq   = i;
+    }
+
+    s.sort( v.begin(), v.end() );
+
+    for ( int i = 1; i < len; ++i ) {
+      BOOST_REQUIRE( v[i-1].value <= v[i].value );
+      if ( v[i-1].value == v[i].value )
+        BOOST_REQUIRE( v[i-1].seq < v[i].seq );
+    }
+
+    for ( int i = 0; i < len; ++i ) {
+      BOOST_REQUIRE( s.begin( v[i].value ) <= i );
+      BOOST_REQUIRE( i < s.end( v[i].value ) );
+    }
+    BOOST_CHECK_EQUAL( s.end( n_values - 1 ), len );
+  }
+
+  void check_radix_sort( const int & len, const int & n_values ) {
+    xylose::nsort::RadixNSort< ItemMap > s( n_values );
+    check_radix_sort( s, len );
+  }
+
+  /** Number of AlignedItem copies constructed at a misaligned address. */
+  int n_misaligned = 0;
+
+  /** Item that requires a stricter alignment than double. */
+  struct AlignedItem {
+    int value;
+    AlignedItem( const int & value = 0 ) : value(value) { }
+    AlignedItem( const AlignedItem & that ) : value(that.value) {
+      if ( reinterpret_cast<std::size_t>(this) % 32u != 0u )
+        ++n_misaligned;
+    }
+  } __attribute__((aligned(32)));
+
+  struct AlignedItemMap {
+    inline int operator()( const AlignedItem & i ) const { return i.value; }
+  };
+
+}
+
+
+BOOST_AUTO_TEST_SUITE( RadixNSort );
+
+BOOST_AUTO_TEST_CASE( c_array ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {0, 0, 1, 1, 1, 2, 2, 2, 3, 4};
+  xylose::nsort::RadixNSort<> s(len);
+  s.sort(static_cast<int*>(v), v+len);
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( v[i], ans[i] );
+  BOOST_CHECK_EQUAL( s.begin(2), 5 );
+  BOOST_CHECK_EQUAL( s.end(2), 8 );
+}
+
+BOOST_AUTO_TEST_CASE( digits ) {
+  BOOST_CHECK_EQUAL( sizeof(xylose::nsort::RadixNSort<>::offset_type), 8u );
+
+  xylose::nsort::RadixNSort<> small( 13 );
+  BOOST_CHECK_EQUAL( small.get_low_bits(), 4 );
+  BOOST_CHECK_EQUAL( small.get_n_high(), 1 );
+
+  xylose::nsort::RadixNSort<> large( 1 << 20 );
+  BOOST_CHECK_EQUAL( large.get_low_bits(), 15 );
+  BOOST_CHECK_EQUAL( large.get_n_high(), 32 );
+}
+
+BOOST_AUTO_TEST_CASE( two_pass ) {
+  check_radix_sort( 20000, 13 );
+  check_radix_sort( 100000, 100000 );    /* partial last block */
+  check_radix_sort( 100000, 1 << 20 );   /* more buckets than items */
+}
+
+BOOST_AUTO_TEST_CASE( reuse_and_copy ) {
+  /* the workspace is reused by smaller and larger later sorts. */
+  xylose::nsort::RadixNSort< ItemMap > s( 1 << 18 );
+  check_radix_sort( s, 50000 );
+  check_radix_sort( s, 1000 );
+  check_radix_sort( s, 80000 );
+
+  /* copies own their buckets and workspace. */
+  xylose::nsort::RadixNSort< ItemMap > t( s );
+  xylose::nsort::RadixNSort< ItemMap > u( 7 );
+  u = s;
+  check_radix_sort( t, 30000 );
+  check_radix_sort( u, 20000 );
+  check_radix_sort( s, 10000 );
+}
+
+BOOST_AUTO_TEST_CASE( over_aligned_items ) {
+  const int len = 1000;
+  const int n_values = 1 << 17;
+  std::vector<AlignedItem> v;
+  for ( int i = 0; i < len; ++i )
+    v.push_back( AlignedItem( ( 2654435761u * i ) % n_values ) );
+
+  xylose::nsort::RadixNSort< AlignedItemMap > s( n_values );
+  n_misaligned = 0;
+  s.sort( v.begin(), v.end() );
+  BOOST_CHECK_EQUAL( n_misaligned, 0 );
+  for ( int i = 1; i < len; ++i )
+    BOOST_REQUIRE( v[i-1].value <= v[i].value );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,175 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  merge_cells
+
+#include <xylose/nsort/tweak/merge_cells.h>
+#include <xylose/nsort/map/remap.h>
+#include <xylose/nsort/map/w_species.h>
+#include <xylose/nsort/NSort.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+
+namespace {
+
+  struct Particle {
+    int cell;
+    unsigned int species;
+  };
+
+  inline const unsigned int & species( const Particle & p ) {
+    return p.species;
+  }
+
+  /** Map directly onto one of 64 cells. */
+  struct CellMap {
+    static const unsigned int number_values = 64u;
+
+    int getNumberValues() const { return number_values; }
+
+    inline int operator()( const Particle & p ) const { return p.cell; }
+  };
+
+  /** Only a few of the cells are populated (with 100, 200, ... items). */
+  std::vector<Particle> makeSparse() {
+    const int cells[] = { 3, 10, 11, 40, 41, 63 };
+    std::vector<Particle> p;
+    for ( int i = 0; i < 6; ++i )
+      for ( int j = 0; j < 100 * (i+1); ++j ) {
+        Particle pi;
+        pi.cell = cells[i];
+        pi.species = j % 2;
+        p.push_back( pi );
+      }
+    /* shuffle */
+    for ( unsigned int i = 0; i < p.size(); ++i )
+      std::swap( p[i], p[ ( 2654435761u * i ) % p.size() ] );
+    return p;
+  }
+
+  /** Check that the particles are sorted by bucket according to map. */
+  template < typename Map, typename Sort >
+  void check_sorted( const std::vector<Particle> & p, const Map & map,
+                     const Sort & s ) {
+    for ( int b = 0; b < s.size(); ++b )
+      for ( int i = s.begin(b); i < s.end(b); ++i )
+        BOOST_CHECK_EQUAL( map( p[i] ), b );
+    BOOST_CHECK_EQUAL( s.end( s.size() - 1 ), static_cast<int>( p.size() ) );
+  }
+
+}
+
+BOOST_AUTO_TEST_SUITE( merge_cells_tests );
+
+BOOST_AUTO_TEST_CASE( drop_empty ) {
+  using xylose::nsort::map::remap;
+  using xylose::nsort::tweak::merge_cells;
+  typedef remap< CellMap > map_t;
+
+  std::vector<Particle> p = makeSparse();
+  map_t m;
+  merge_cells t;
+  xylose::nsort::NSort< map_t, merge_cells > s( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  BOOST_CHECK_EQUAL( t.size(), 6 );
+
+  t.apply( m );
+  BOOST_CHECK_EQUAL( m.getNumberValues(), 6 );
+
+  /* each populated cell is a bucket of its own, in order; the buckets
+   * partition all cells. */
+  const int cells[] = { 3, 10, 11, 40, 41, 63 };
+  int n = 0;
+  for ( int b = 0; b < 6; ++b ) {
+    BOOST_CHECK_EQUAL( m.m_remap[ cells[b] ], b );
+    for ( const int * v = m.valuesBegin(b); v != m.valuesEnd(b); ++v, ++n )
+      BOOST_CHECK_EQUAL( *v, n );
+  }
+  BOOST_CHECK_EQUAL( n, 64 );
+
+  s.resize( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  check_sorted( p, m, s );
+  for ( int b = 0; b < 6; ++b )
+    BOOST_CHECK_EQUAL( s.size(b), 100 * (b+1) );
+}
+
+BOOST_AUTO_TEST_CASE( min_count ) {
+  using xylose::nsort::map::remap;
+  using xylose::nsort::tweak::merge_cells;
+  typedef remap< CellMap > map_t;
+
+  std::vector<Particle> p = makeSparse();
+  map_t m;
+  merge_cells t( 250 );
+  xylose::nsort::NSort< map_t, merge_cells > s( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  t.apply( m );
+
+  /* 100+200 | 300 | 400 | 500 | 600 */
+  BOOST_CHECK_EQUAL( m.getNumberValues(), 5 );
+  s.resize( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  check_sorted( p, m, s );
+  for ( int b = 0; b < s.size(); ++b )
+    BOOST_CHECK( s.size(b) >= 250 );
+
+  /* merging again composes with the current table */
+  merge_cells t2( 1000 );
+  s.sort( p.begin(), p.end(), m, t2 );
+  t2.apply( m );
+  BOOST_CHECK_EQUAL( m.getNumberValues(), 2 );
+  BOOST_CHECK_EQUAL( m.m_remap[11], 0 );
+  BOOST_CHECK_EQUAL( m.m_remap[40], 0 );
+  BOOST_CHECK_EQUAL( m.m_remap[41], 1 );
+
+  /* and a reset restores the original cells */
+  m.reset();
+  BOOST_CHECK_EQUAL( m.getNumberValues(), 64 );
+}
+
+BOOST_AUTO_TEST_CASE( w_species ) {
+  using xylose::nsort::map::remap;
+  using xylose::nsort::map::w_species;
+  using xylose::nsort::tweak::merge_cells;
+  typedef w_species< remap< CellMap > > map_t;
+
+  std::vector<Particle> p = makeSparse();
+  map_t m( 2u );
+  merge_cells t;
+  xylose::nsort::NSort< map_t, merge_cells > s( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  t.apply( m );
+
+  BOOST_CHECK_EQUAL( m.getNumberValues(), 12 );
+  s.resize( m.getNumberValues() );
+  s.sort( p.begin(), p.end(), m, t );
+  check_sorted( p, m, s );
+  for ( int b = 0; b < 6; ++b ) {
+    BOOST_CHECK_EQUAL( s.size( 2*b     ), 50 * (b+1) );
+    BOOST_CHECK_EQUAL( s.size( 2*b + 1 ), 50 * (b+1) );
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,145 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  permutation
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/nsort/utility/apply_permutation.h>
+#include <xylose/nsort/utility/PGather.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+
+namespace {
+
+  /** Map that sorts an index by a separately stored cell array. */
+  struct CellMap {
+    const std::vector<int> * cell;
+    CellMap( const std::vector<int> * cell = NULL ) : cell(cell) { }
+
+    inline int operator()( const int & i ) const { return (*cell)[i]; }
+  };
+
+  /** Structure of arrays particle storage. */
+  struct Particles {
+    std::vector<int>    cell;
+    std::vector<double> x;
+    std::vector<float>  w;
+    std::vector<int>    id;
+
+    Particles( const int & n, const int & n_cells )
+      : cell(n), x(n), w(n), id(n) {
+      for ( int i = 0; i < n; ++i ) {
+        cell[i] = static_cast<int>( ( 2654435761u * i ) % n_cells );
+        x[i]    = 0.5 * i;
+        w[i]    = 0.25f * i;
+        id[i]   = i;
+      }
+    }
+
+    /** Check that the fields are consistent and sorted stably by cell. */
+    void check() const {
+      for ( unsigned int i = 0; i < id.size(); ++i ) {
+        BOOST_REQUIRE_EQUAL( x[i], 0.5 * id[i] );
+        BOOST_REQUIRE_EQUAL( w[i], 0.25f * id[i] );
+        if ( i > 0 ) {
+          BOOST_REQUIRE( cell[i-1] <= cell[i] );
+          if ( cell[i-1] == cell[i] )
+            BOOST_REQUIRE( id[i-1] < id[i] );
+        }
+      }
+    }
+  };
+
+}
+
+BOOST_AUTO_TEST_SUITE( permutation );
+
+BOOST_AUTO_TEST_CASE( gather_list ) {
+  const int len = 10;
+  int v[len] = {1, 2, 0, 1, 2, 3, 0, 1, 2, 4};
+  int ans[len] = {2, 6, 0, 3, 7, 1, 4, 8, 5, 9};
+  int perm[len];
+  xylose::nsort::NSort<> s(5);
+  s.permutation(static_cast<int*>(v), v+len, static_cast<int*>(perm));
+
+  for (int i = 0; i < len; ++i)
+    BOOST_CHECK_EQUAL( perm[i], ans[i] );
+
+  BOOST_CHECK_EQUAL( s.begin(1), 2 );
+  BOOST_CHECK_EQUAL( s.end(1), 5 );
+
+  /* items are not moved. */
+  BOOST_CHECK_EQUAL( v[0], 1 );
+  BOOST_CHECK_EQUAL( v[9], 4 );
+}
+
+BOOST_AUTO_TEST_CASE( serial_apply ) {
+  const int len = 20000, n_cells = 97;
+  Particles p( len, n_cells );
+
+  std::vector<int> index( len ), perm( len );
+  for ( int i = 0; i < len; ++i )
+    index[i] = i;
+
+  xylose::nsort::NSort< CellMap > s( n_cells );
+  s.permutation( index.begin(), index.end(), perm.begin(), CellMap(&p.cell) );
+
+  using xylose::nsort::utility::apply_permutation;
+  apply_permutation( perm.begin(), perm.end(), p.cell, p.x, p.w, p.id );
+  p.check();
+}
+
+BOOST_AUTO_TEST_CASE( threaded_apply ) {
+  const int len = 50000, n_cells = 1000;
+  Particles p( len, n_cells );
+
+  std::vector<int> index( len ), perm( len );
+  for ( int i = 0; i < len; ++i )
+    index[i] = i;
+
+  xylose::nsort::NSort< CellMap > s( n_cells );
+  s.permutation( index.begin(), index.end(), perm.begin(), CellMap(&p.cell) );
+
+  xylose::pthreadCache.set_max_threads(4);
+  typedef xylose::nsort::utility::PGather< std::vector<int>::iterator > G;
+
+  /* hot fields first. */
+  {
+    G g( perm.begin(), perm.end() );
+    g.apply( p.cell ).apply( p.x ).apply( p.id );
+    g.join();
+  }
+
+  /* cold field later, out-of-place. */
+  std::vector<float> w( len );
+  {
+    G g( perm.begin(), perm.end(), 3 );
+    g.copy( p.w.begin(), w.begin() );
+  }
+  p.w.swap( w );
+
+  p.check();
+}
+
+BOOST_AUTO_TEST_SUITE_END();
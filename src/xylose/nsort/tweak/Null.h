@@ -26,11 +26,12 @@
 namespace xylose {
   namespace nsort {
     namespace tweak {
-      /** Default NSort tweaker does nothing. */
+      /** Default NSort tweaker does nothing.  The type of the bucket counts
+       * is a template parameter since RadixNSort uses 64-bit counts. */
       struct Null {
-        template < typename Map >
+        template < typename Map, typename Offset >
         inline void tweakNSort( Map & map,
-                                const int * const bin,
+                                const Offset * const bin,
                                 const int & n_values ) const {}
       };
     }/* namespace tweak */
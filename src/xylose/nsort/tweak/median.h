@@ -0,0 +1,183 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_tweak_median_h
+#define xylose_nsort_tweak_median_h
+
+#include <xylose/Vector.h>
+#include <xylose/nsort/map/detail/batch_keys.h>
+#include <xylose/ref_of.h>
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+    namespace tweak {
+
+      /** NSort tweaker that balances the split of a map::pivot.
+       * The split point of a pivot must be chosen before the items are
+       * counted (NSort evaluates the map before the tweaker is called), so
+       * this class finds the point with a coarse pre-histogram:
+       * measure(Ai,Af,pivot) histograms the coordinates of the items along
+       * each (active) direction of the pivot into n_bins bins over their
+       * bounding box, refines the bin that contains the median n_refine
+       * times, and interpolates the median inside the final bin.  With the
+       * resulting point, the 2-way, 4-way or 8-way split of the pivot is
+       * balanced along each direction.
+       *
+       * The subsequent NSort pass calls tweakNSort with the actual counts of
+       * the split, which are kept for inspection (see min_count and
+       * max_count).  The map is not changed at that point.
+       * <pre>
+       *    pivot< Dimensions<0,1,2> > p;
+       *    tweak::median<> m;
+       *    m.measure( Ai, Af, p );
+       *    NSort< pivot< Dimensions<0,1,2> >, tweak::median<> > s( 8 );
+       *    s.cached_sort( Ai, Af, p, m );
+       * </pre>
+       *
+       * @tparam n_bins
+       *    Number of bins of each pre-histogram. [Default 64]
+       * @tparam n_refine
+       *    Number of times the median bin is refined. [Default 1]
+       */
+      template < unsigned int n_bins = 64u,
+                 unsigned int n_refine = 1u >
+      class median {
+        /* MEMBER STORAGE */
+      private:
+        Vector<double,3u> lo;
+        Vector<double,3u> hi;
+        int n_min;
+        int n_max;
+
+        /* MEMBER FUNCTIONS */
+      public:
+        median() : lo(0.0), hi(0.0), n_min(0), n_max(0) { }
+
+        /** Lower corner of the bounding box found by the last measure(). */
+        const Vector<double,3u> & lower() const { return lo; }
+
+        /** Upper corner of the bounding box found by the last measure(). */
+        const Vector<double,3u> & upper() const { return hi; }
+
+        /** Smallest bucket count seen by the last tweakNSort(). */
+        const int & min_count() const { return n_min; }
+
+        /** Largest bucket count seen by the last tweakNSort(). */
+        const int & max_count() const { return n_max; }
+
+        /** Set the point of the pivot map to the median of the items in
+         * [Ai,Af) along each active direction.  Bit d of active selects the
+         * dth direction of the pivot's dimensions; the point of inactive
+         * directions is set to -infinity (all items fall on the upper side)
+         * so that a pivot can also be used for e.g. a one-directional kd-tree
+         * split. */
+        template < typename Iter, typename Pivot >
+        void measure( const Iter & Ai, const Iter & Af, Pivot & map,
+                      const unsigned int & active = ~0u ) {
+          typedef map::detail::dims_dirs< typename Pivot::dimensions > D;
+          unsigned int dir[D::ndims];
+          D::get( dir );
+
+          /* bounding box */
+          lo = std::numeric_limits<double>::max();
+          hi = -std::numeric_limits<double>::max();
+          for ( Iter i = Ai; i != Af; ++i )
+            for ( unsigned int d = 0u; d < D::ndims; ++d ) {
+              const double x = position( ref_of(*i) )[dir[d]];
+              lo[dir[d]] = std::min( lo[dir[d]], x );
+              hi[dir[d]] = std::max( hi[dir[d]], x );
+            }
+
+          const int half = static_cast<int>( (Af - Ai) / 2 );
+          for ( unsigned int d = 0u; d < D::ndims; ++d ) {
+            if ( !( active & (1u << d) ) ) {
+              map.point[dir[d]] = -std::numeric_limits<double>::infinity();
+              continue;
+            }
+
+            if ( Ai == Af ) {
+              map.point[dir[d]] = 0.0;
+              continue;
+            }
+
+            /* [a,b) holds the median; below items are less than a. */
+            double a = lo[dir[d]];
+            double b = hi[dir[d]];
+            int below = 0;
+            for ( unsigned int r = 0u; r <= n_refine && a < b; ++r ) {
+              const double w = (b - a) / n_bins;
+              const double inv_w = 1.0 / w;
+              std::vector<int> h( n_bins, 0 );
+              for ( Iter i = Ai; i != Af; ++i ) {
+                const double x = position( ref_of(*i) )[dir[d]];
+                if ( x < a || ( x >= b && b < hi[dir[d]] ) ) continue;
+                const int bin = std::min( static_cast<int>( (x - a) * inv_w ),
+                                          static_cast<int>(n_bins) - 1 );
+                ++h[bin];
+              }
+
+              unsigned int m = 0u;
+              for ( ; m < n_bins - 1u && below + h[m] <= half; ++m )
+                below += h[m];
+
+              const double bin_a = a + m * w;
+              if ( h[m] == 0 ) {
+                a = b = bin_a;
+              } else if ( r == n_refine ) {
+                /* interpolate within the final bin */
+                a = bin_a + w * ( static_cast<double>(half - below) / h[m] );
+                b = a;
+              } else {
+                a = bin_a;
+                b = (m == n_bins - 1u) ? hi[dir[d]] : bin_a + w;
+              }
+            }
+            map.point[dir[d]] = a;
+          }
+        }
+
+        /** Record the balance of the split; the map is not changed. */
+        template < typename Map, typename Offset >
+        void tweakNSort( Map & map,
+                         const Offset * const bin,
+                         const int & n_values ) {
+          n_min = std::numeric_limits<int>::max();
+          n_max = 0;
+          for ( int i = 0; i < n_values; ++i ) {
+            if ( bin[i] == 0 ) continue; /* inactive directions */
+            n_min = std::min( n_min, static_cast<int>(bin[i]) );
+            n_max = std::max( n_max, static_cast<int>(bin[i]) );
+          }
+          if ( n_max == 0 )
+            n_min = 0;
+        }
+      };
+
+    }/* namespace tweak */
+  }/* namespace nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_tweak_median_h
@@ -0,0 +1,173 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_tweak_merge_cells_h
+#define xylose_nsort_tweak_merge_cells_h
+
+#include <xylose/nsort/map/remap.h>
+#include <xylose/nsort/map/w_species.h>
+
+#include <vector>
+#include <cassert>
+
+namespace xylose {
+  namespace nsort {
+    namespace tweak {
+
+      /** NSort tweaker that merges sparsely populated cells of a map::remap
+       * into a dense numbering of buckets.
+       * The counts of one sort are walked in the order of the map's values;
+       * consecutive values are merged into one bucket until the bucket holds
+       * at least min_count items.  Empty values are thereby folded into a
+       * neighboring bucket (they still map onto a valid bucket should items
+       * move into them later).  With a space-filling-curve map (map::morton
+       * or map::hilbert) consecutive values are also close in space.
+       *
+       * NSort evaluates the map again after the tweaker is called, so the
+       * merge is only recorded by tweakNSort and is applied to the map with
+       * apply() after the sort.  Subsequent sorts then use the compact
+       * numbering (which is also the bucket count of the NSort instance).
+       * The table of the remap holds one int for each possible value of the
+       * wrapped map, so a grid of at most 32^3 cells is given here:
+       * <pre>
+       *    typedef remap< morton< Grid, Dimensions<0u,1u,2u>, 5u > > map_t;
+       *    map_t m( grid );
+       *    tweak::merge_cells t( 32 );
+       *    NSort< map_t, tweak::merge_cells > s( m.getNumberValues() );
+       *    s.sort( Ai, Af, m, t );
+       *    t.apply( m );
+       *    s.resize( m.getNumberValues() );
+       * </pre>
+       * Since a merge is composed with the current table of the remap,
+       * buckets can later be merged further; to split buckets again, reset()
+       * the remap (and resize the NSort) and let it be re-tuned.
+       *
+       * A map::w_species wrapper is supported:  the counts of all species of
+       * each cell are added before merging.
+       */
+      class merge_cells {
+        /* MEMBER STORAGE */
+      private:
+        int n_min;
+
+        /** Bucket of each value of the map during the last sort. */
+        std::vector<int> merge;
+
+        /** Number of buckets after merging. */
+        int n_merged;
+
+
+        /* MEMBER FUNCTIONS */
+      public:
+        /** Constructor.
+         * @param min_count
+         *    Minimum number of items per merged bucket.  With min_count == 1
+         *    only the empty values are merged away. [Default 1]
+         */
+        merge_cells( const int & min_count = 1 )
+          : n_min( min_count ), n_merged( 0 ) { }
+
+        const int & min_count() const { return n_min; }
+
+        /** Number of buckets after merging (as found by the last
+         * tweakNSort()). */
+        const int & size() const { return n_merged; }
+
+        /** Bucket of value v after merging (as found by the last
+         * tweakNSort()). */
+        const int & bucket( const int & v ) const { return merge[v]; }
+
+        /** Record the merge of the n_values values of map. */
+        template < typename Map, typename Offset >
+        void tweakNSort( Map & map,
+                         const Offset * const bin,
+                         const int & n_values ) {
+          merge.resize( n_values );
+          mergeCounts( bin, n_values, 1 );
+        }
+
+        /** Record the merge of the cells of a w_species map (the species of
+         * each cell are counted together). */
+        template < typename T, typename Offset >
+        void tweakNSort( map::w_species<T> & map,
+                         const Offset * const bin,
+                         const int & n_values ) {
+          merge.resize( n_values / map.n_species );
+          mergeCounts( bin, n_values / map.n_species, map.n_species );
+        }
+
+        /** Apply the merge found by the last sort to the table of the remap
+         * and update it. */
+        template < typename T, unsigned int nval >
+        void apply( map::remap<T,nval> & map ) const {
+          if ( merge.empty() )
+            return;
+
+          for ( unsigned int i = 0; i < nval; ++i ) {
+            assert( map.m_remap[i] < static_cast<int>( merge.size() ) );
+            map.m_remap[i] = merge[ map.m_remap[i] ];
+          }
+          map.update();
+        }
+
+        /** Apply the merge to the remap wrapped by w_species. */
+        template < typename T >
+        void apply( map::w_species<T> & map ) const {
+          apply( static_cast<T&>( map ) );
+        }
+
+      private:
+        /** Merge the counts of n cells, where the count of cell c is the sum
+         * of bin[c*stride .. (c+1)*stride). */
+        template < typename Offset >
+        void mergeCounts( const Offset * const bin, const int & n,
+                          const int & stride ) {
+          int b = 0;
+          Offset count = 0;
+          for ( int c = 0; c < n; ++c ) {
+            merge[c] = b;
+            for ( int s = 0; s < stride; ++s )
+              count += bin[ c * stride + s ];
+            if ( count >= n_min ) {
+              ++b;
+              count = 0;
+            }
+          }
+
+          /* the cells after the last full bucket join that bucket */
+          if ( n > 0 && merge[n-1] == b ) {
+            if ( b > 0 )
+              for ( int c = n - 1; c >= 0 && merge[c] == b; --c )
+                merge[c] = b - 1;
+            else
+              b = 1;
+          }
+
+          n_merged = b;
+        }
+      };
+
+    }/* namespace tweak */
+  }/* namespace nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_tweak_merge_cells_h
@@ -0,0 +1,422 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_utility_CellPairs_h
+#define xylose_nsort_utility_CellPairs_h
+
+#include <xylose/Vector.h>
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace xylose {
+  namespace nsort {
+    namespace utility {
+
+      /** Cell-list engine that iterates over all pairs of neighboring cells of
+       * a regular grid after the particles have been sorted into the cells
+       * with NSort (and map::uniform_grid, optionally wrapped in
+       * map::w_species).  The neighbors of a cell are all cells within
+       * <code>radius</code> cells in each direction (a cube of
+       * \f$ (2r+1)^{ndims} \f$ cells).  Empty cells are skipped.
+       *
+       * The cells are numbered as map::uniform_grid numbers them:
+       * \f$ i_0 + n_0 ( i_1 + n_1 i_2 ) \f$, where n_cells[0] must be the
+       * number of cells along the first direction of the map's Dimensions.
+       * A typical use is:
+       * <pre>
+       *    CellPairs<3> pairs( n_cells, 1, CellPairs<3>::PERIODIC );
+       *    nsort.sort( p.begin(), p.end(), map );
+       *    pairs.setRanges( nsort, n_species );
+       *    pairs.for_each_pair( kernel );
+       * </pre>
+       * where <code>kernel(a,b)</code> is called with two Cell instances,
+       * giving [begin,end) of the particles of each cell (relative to the
+       * first particle).  When <code>a.index == b.index</code>, both
+       * arguments are the same cell.
+       *
+       * With the half-shell stencil (the default) each unordered pair of
+       * cells is visited exactly once, which is appropriate for symmetric
+       * interactions that update the particles of both cells.  With the full
+       * stencil, each cell is visited with each of its neighbors (and so
+       * each pair twice, once from each side).
+       *
+       * For the multi-threaded version, see PCellPairs.
+       *
+       * @tparam ndims
+       *    Number of grid dimensions (1, 2, or 3).
+       */
+      template < unsigned int ndims >
+      class CellPairs {
+        /* TYPEDEFS */
+      public:
+        /** Treatment of neighbors beyond the edge of the grid. */
+        enum Boundary {
+          /** Cells beyond the edge do not exist. */
+          CLAMPED,
+          /** Cells beyond the edge wrap around to the opposite side. */
+          PERIODIC
+        };
+
+        typedef Vector<int,ndims> Index;
+
+        /** The particles of one cell. */
+        struct Cell {
+          int index;
+          int begin;
+          int end;
+
+          int size() const { return end - begin; }
+        };
+
+        /** A rectangular block of cells:  [lo,hi) in each direction. */
+        struct Block {
+          Index lo;
+          Index hi;
+        };
+
+
+        /* MEMBER STORAGE */
+      protected:
+        Index n;
+        Index stride;
+        int radius;
+        bool half_shell;
+        Boundary boundary[ndims];
+
+        /** Offsets of the stencil (the zero offset first). */
+        std::vector<Index> stencil;
+
+        /** begin(c) and end(c) of each cell c. */
+        std::vector<int> cell_begin;
+        std::vector<int> cell_end;
+
+        /** Indices of all non-empty cells. */
+        std::vector<int> non_empty;
+
+        /** Edges of the blocks along each direction. */
+        std::vector<int> block_edges[ndims];
+
+        /** Color of each block along each direction. */
+        std::vector<int> block_color[ndims];
+
+        /** Number of colors along each direction. */
+        int n_dir_colors[ndims];
+
+
+        /* MEMBER FUNCTIONS */
+      public:
+        /** Constructor.
+         * @param n_cells
+         *    Number of cells along each direction.
+         * @param radius
+         *    Number of neighbor cells in each direction. [Default 1]
+         * @param b
+         *    Boundary treatment of all directions. [Default CLAMPED]
+         * @param half_shell
+         *    Visit each unordered pair of cells once (true) or each ordered
+         *    pair (false). [Default true]
+         */
+        CellPairs( const Index & n_cells,
+                   const int & radius = 1,
+                   const Boundary & b = CLAMPED,
+                   const bool & half_shell = true )
+          : n( n_cells ), radius( radius ), half_shell( half_shell ) {
+          assert( radius >= 0 );
+          int s = 1;
+          for ( unsigned int d = 0u; d < ndims; ++d ) {
+            assert( n[d] > 0 );
+            stride[d] = s;
+            s *= n[d];
+          }
+
+          cell_begin.resize( s, 0 );
+          cell_end.resize( s, 0 );
+
+          makeStencil();
+          for ( unsigned int d = 0u; d < ndims; ++d )
+            setBoundary( d, b );
+        }
+
+        /** Change the boundary treatment of one direction.
+         * A periodic direction must have at least 2*radius+1 cells so that
+         * no pair of cells is visited more than once. */
+        void setBoundary( const unsigned int & d, const Boundary & b ) {
+          assert( d < ndims );
+          assert( b == CLAMPED || n[d] >= 2*radius + 1 );
+          boundary[d] = b;
+          makeBlocks( d );
+        }
+
+        const Boundary & getBoundary( const unsigned int & d ) const {
+          return boundary[d];
+        }
+
+        const Index & getNumberCells() const { return n; }
+
+        int size() const { return static_cast<int>( cell_begin.size() ); }
+
+        const int & getRadius() const { return radius; }
+
+        bool isHalfShell() const { return half_shell; }
+
+        /** The neighbor offsets (the zero offset first). */
+        const std::vector<Index> & getStencil() const { return stencil; }
+
+        /** Set the particle range of each cell from the result of a sort.
+         * @param s
+         *    The NSort instance after sort (or resort, cached_sort, ...)
+         *    with the map::uniform_grid map, possibly wrapped by w_species.
+         * @param n_species
+         *    The number of species of the w_species map (species are
+         *    numbered within each cell, such that all species of one cell
+         *    are contiguous). [Default 1]
+         */
+        template < typename NSort >
+        void setRanges( const NSort & s, const int & n_species = 1 ) {
+          non_empty.clear();
+          for ( int c = 0, nc = size(); c < nc; ++c ) {
+            const int b = s.begin( c * n_species );
+            const int e = s.end( c * n_species + n_species - 1 );
+            cell_begin[c] = b;
+            cell_end[c] = e;
+            if ( e > b )
+              non_empty.push_back( c );
+          }
+        }
+
+        /** The particles of cell c. */
+        Cell cell( const int & c ) const {
+          Cell r;
+          r.index = c;
+          r.begin = cell_begin[c];
+          r.end = cell_end[c];
+          return r;
+        }
+
+        /** Indices of all non-empty cells (as of the last setRanges). */
+        const std::vector<int> & getNonEmpty() const { return non_empty; }
+
+        /** Index of the cell at grid position i. */
+        int index( const Index & i ) const {
+          int c = 0;
+          for ( unsigned int d = 0u; d < ndims; ++d )
+            c += i[d] * stride[d];
+          return c;
+        }
+
+        /** Grid position of cell c. */
+        Index position( int c ) const {
+          Index i;
+          for ( int d = ndims - 1; d >= 0; --d ) {
+            i[d] = c / stride[d];
+            c -= i[d] * stride[d];
+          }
+          return i;
+        }
+
+        /** Index of the neighbor of the cell at i with the given offset.
+         * @return -1 if the neighbor is beyond a CLAMPED boundary.
+         */
+        int neighbor( const Index & i, const Index & offset ) const {
+          int c = 0;
+          for ( unsigned int d = 0u; d < ndims; ++d ) {
+            int j = i[d] + offset[d];
+            if ( j < 0 || j >= n[d] ) {
+              if ( boundary[d] == CLAMPED )
+                return -1;
+              j = ( j + n[d] ) % n[d];
+            }
+            c += j * stride[d];
+          }
+          return c;
+        }
+
+        /** Call f(a,b) for each pair of non-empty neighboring cells. */
+        template < typename F >
+        void for_each_pair( F & f ) const {
+          for ( std::vector<int>::const_iterator c = non_empty.begin();
+                c != non_empty.end(); ++c )
+            visit( *c, f );
+        }
+
+        /** Call f(a,b) for each pair of non-empty neighboring cells where
+         * cell a is in the given block. */
+        template < typename F >
+        void for_each_pair( const Block & block, F & f ) const {
+          Index i = block.lo;
+          for ( unsigned int d = 0u; d < ndims; ++d )
+            if ( block.lo[d] >= block.hi[d] )
+              return;
+
+          while ( true ) {
+            const int c = index( i );
+            if ( cell_end[c] > cell_begin[c] )
+              visit( c, i, f );
+
+            unsigned int d = 0u;
+            for ( ; d < ndims; ++d ) {
+              if ( ++i[d] < block.hi[d] )
+                break;
+              i[d] = block.lo[d];
+            }
+            if ( d == ndims )
+              break;
+          }
+        }
+
+        /** Number of colors of the blocks.  All blocks of one color can be
+         * processed concurrently:  any two blocks of the same color are
+         * separated by at least 2*radius cells in some direction, so the
+         * cells touched by the pairs of one are never touched by the pairs
+         * of the other. */
+        int getNumberColors() const {
+          int c = 1;
+          for ( unsigned int d = 0u; d < ndims; ++d )
+            c *= n_dir_colors[d];
+          return c;
+        }
+
+        /** Append all blocks of the given color to blocks. */
+        void getBlocks( const int & color, std::vector<Block> & blocks ) const {
+          Index dir_color;
+          int k = color;
+          for ( unsigned int d = 0u; d < ndims; ++d ) {
+            dir_color[d] = k % n_dir_colors[d];
+            k /= n_dir_colors[d];
+          }
+
+          /* blocks along each direction that have the requested color */
+          std::vector<int> bl[ndims];
+          for ( unsigned int d = 0u; d < ndims; ++d ) {
+            for ( unsigned int b = 0u; b < block_color[d].size(); ++b )
+              if ( block_color[d][b] == dir_color[d] )
+                bl[d].push_back( b );
+            if ( bl[d].empty() )
+              return;
+          }
+
+          Index j( 0 );
+          while ( true ) {
+            Block block;
+            for ( unsigned int d = 0u; d < ndims; ++d ) {
+              block.lo[d] = block_edges[d][ bl[d][j[d]]     ];
+              block.hi[d] = block_edges[d][ bl[d][j[d]] + 1 ];
+            }
+            blocks.push_back( block );
+
+            unsigned int d = 0u;
+            for ( ; d < ndims; ++d ) {
+              if ( ++j[d] < static_cast<int>( bl[d].size() ) )
+                break;
+              j[d] = 0;
+            }
+            if ( d == ndims )
+              break;
+          }
+        }
+
+      protected:
+        template < typename F >
+        void visit( const int & c, F & f ) const {
+          visit( c, position( c ), f );
+        }
+
+        /** Call f for cell c (at grid position i) and each of its non-empty
+         * neighbors. */
+        template < typename F >
+        void visit( const int & c, const Index & i, F & f ) const {
+          const Cell a = cell( c );
+          f( a, a );
+          for ( unsigned int s = 1u; s < stencil.size(); ++s ) {
+            const int nb = neighbor( i, stencil[s] );
+            if ( nb < 0 || cell_end[nb] == cell_begin[nb] )
+              continue;
+            f( a, cell( nb ) );
+          }
+        }
+
+        /** Fill the stencil with all offsets within radius; for the
+         * half-shell, only those offsets whose last non-zero component is
+         * positive are kept. */
+        void makeStencil() {
+          stencil.clear();
+          stencil.push_back( Index( 0 ) );
+
+          Index o( -radius );
+          while ( true ) {
+            int last = 0;
+            for ( unsigned int d = 0u; d < ndims; ++d )
+              if ( o[d] != 0 )
+                last = o[d];
+
+            if ( last > 0 || ( last < 0 && !half_shell ) )
+              stencil.push_back( o );
+
+            unsigned int d = 0u;
+            for ( ; d < ndims; ++d ) {
+              if ( ++o[d] <= radius )
+                break;
+              o[d] = -radius;
+            }
+            if ( d == ndims )
+              break;
+          }
+        }
+
+        /** Split direction d into blocks of at least 2*radius cells and
+         * color them such that blocks of the same color are never
+         * adjacent.  For periodic directions with an odd number of blocks,
+         * the last block gets a third color, since it is adjacent to the
+         * first. */
+        void makeBlocks( const unsigned int & d ) {
+          const int min_width = std::max( 1, 2 * radius );
+          const int n_blocks = std::max( 1, n[d] / min_width );
+
+          block_edges[d].resize( n_blocks + 1 );
+          block_color[d].resize( n_blocks );
+          for ( int b = 0; b <= n_blocks; ++b )
+            block_edges[d][b] = ( n[d] * b ) / n_blocks;
+
+          if ( radius == 0 || n_blocks == 1 ) {
+            n_dir_colors[d] = 1;
+            std::fill( block_color[d].begin(), block_color[d].end(), 0 );
+            return;
+          }
+
+          n_dir_colors[d] = 2;
+          for ( int b = 0; b < n_blocks; ++b )
+            block_color[d][b] = b % 2;
+
+          if ( boundary[d] == PERIODIC && ( n_blocks % 2 ) == 1 ) {
+            n_dir_colors[d] = 3;
+            block_color[d][n_blocks-1] = 2;
+          }
+        }
+      };
+
+    }/* namespace xylose::nsort::utility */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_utility_CellPairs_h
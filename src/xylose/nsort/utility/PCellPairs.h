@@ -0,0 +1,162 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_utility_PCellPairs_h
+#define xylose_nsort_utility_PCellPairs_h
+
+#include <xylose/nsort/utility/CellPairs.h>
+#include <xylose/PThreadCache.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+    namespace utility {
+
+      /** Multi-threaded version of CellPairs.
+       * The grid is split into blocks of cells that are colored such that
+       * the pairs of any two blocks of the same color never share a cell
+       * (see CellPairs::getNumberColors).  The colors are processed one
+       * after the other; the blocks of each color are distributed over the
+       * threads of the thread cache.  Thus, the pair function may modify the
+       * particles of both of its cells without any locking.  It must not
+       * modify any other shared state without synchronization.
+       *
+       * @tparam ndims
+       *    Number of grid dimensions (1, 2, or 3).
+       */
+      template < unsigned int ndims >
+      class PCellPairs : public CellPairs<ndims> {
+        /* TYPEDEFS */
+      private:
+        typedef CellPairs<ndims> super;
+        typedef typename super::Block Block;
+        typedef typename std::vector<Block>::const_iterator BIter;
+
+        /** Process a contiguous set of blocks of one color. */
+        template < typename F >
+        struct Task : PThreadTask {
+          const super & pairs;
+          F & f;
+          BIter bi;
+          BIter bf;
+
+          Task( const super & pairs, F & f, const BIter & bi, const BIter & bf )
+            : pairs(pairs), f(f), bi(bi), bf(bf) { }
+
+          virtual ~Task() { }
+
+          virtual void exec() {
+            for ( BIter b = bi; b != bf; ++b )
+              pairs.for_each_pair( *b, f );
+          }
+        };
+
+
+        /* MEMBER STORAGE */
+      private:
+        int n_threads;
+        PThreadCache & cache;
+
+
+        /* MEMBER FUNCTIONS */
+      public:
+        /** Constructor.
+         * @param n_cells
+         *    Number of cells along each direction.
+         * @param radius
+         *    Number of neighbor cells in each direction. [Default 1]
+         * @param b
+         *    Boundary treatment of all directions. [Default CLAMPED]
+         * @param half_shell
+         *    Visit each unordered pair of cells once (true) or each ordered
+         *    pair (false). [Default true]
+         * @param n_threads
+         *    Number of tasks to split each color into.  If n_threads <= 0,
+         *    the value of PThreadCache::get_max_threads() is used. [Default 0]
+         * @param cache
+         *    Specify the cache instance to use [Default xylose::pthreadCache].
+         */
+        PCellPairs( const typename super::Index & n_cells,
+                    const int & radius = 1,
+                    const typename super::Boundary & b = super::CLAMPED,
+                    const bool & half_shell = true,
+                    const int & n_threads = 0,
+                    PThreadCache & cache = xylose::pthreadCache )
+          : super( n_cells, radius, b, half_shell ),
+            n_threads( n_threads > 0 ? n_threads : cache.get_max_threads() ),
+            cache( cache ) { }
+
+        /** Call f(a,b) for each pair of non-empty neighboring cells.  The
+         * calls for different blocks are made concurrently. */
+        template < typename F >
+        void for_each_pair( F & f ) const {
+          if ( n_threads <= 1 ) {
+            super::for_each_pair( f );
+            return;
+          }
+
+          std::vector<Block> blocks;
+          for ( int color = 0, nc = this->getNumberColors();
+                color < nc; ++color ) {
+            blocks.clear();
+            this->getBlocks( color, blocks );
+
+            const int n_blocks = static_cast<int>( blocks.size() );
+            const int n_chunks = std::min( n_threads, n_blocks );
+            if ( n_chunks <= 1 ) {
+              for ( BIter b = blocks.begin(); b != blocks.end(); ++b )
+                super::for_each_pair( *b, f );
+              continue;
+            }
+
+            std::vector<PThreadTask *> color_tasks;
+            for ( int t = 0; t < n_chunks; ++t )
+              color_tasks.push_back(
+                new Task<F>( *this, f,
+                             blocks.begin() + ( n_blocks *  t    ) / n_chunks,
+                             blocks.begin() + ( n_blocks * (t+1) ) / n_chunks )
+              );
+
+            PThreadTaskGroup tasks( cache );
+            tasks.addTasks( color_tasks.begin(), color_tasks.end() );
+
+            PThreadTask * task;
+            while ( ( task = tasks.waitAny() ) != NULL )
+              delete task;
+          }
+        }
+
+        /** Call f(a,b) for each pair of non-empty neighboring cells where
+         * cell a is in the given block (in the calling thread). */
+        template < typename F >
+        void for_each_pair( const Block & block, F & f ) const {
+          super::for_each_pair( block, f );
+        }
+      };
+
+    }/* namespace xylose::nsort::utility */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_utility_PCellPairs_h
@@ -0,0 +1,196 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_utility_PGather_h
+#define xylose_nsort_utility_PGather_h
+
+#include <xylose/PThreadCache.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace xylose {
+  namespace nsort {
+    namespace utility {
+
+      /** Multi-threaded application of a gather list (as computed by
+       * NSort::permutation) to any number of parallel arrays.
+       * Each array is gathered in one pass that is split into contiguous
+       * chunks; the chunks of all arrays given to one PGather instance are
+       * queued on the thread cache together, so that the arrays are also
+       * reordered concurrently.  A typical use is:
+       * <pre>
+       *    nsort.permutation( x.begin(), x.end(), perm.begin(), map );
+       *    PGather< std::vector<int>::iterator > g( perm.begin(), perm.end() );
+       *    g.apply( x ).apply( v ).apply( species );
+       *    g.join();
+       * </pre>
+       * Cold fields can simply be gathered later (with another PGather
+       * instance) as long as the gather list is kept around.
+       *
+       * @tparam PIter
+       *    Random access iterator type of the gather list.
+       */
+      template < typename PIter >
+      class PGather {
+        /* TYPEDEFS */
+      private:
+        /** Gather one chunk of one array. */
+        template < typename SIter, typename DIter >
+        struct Task : PThreadTask {
+          /* MEMBER STORAGE */
+          PIter Pi;
+          PIter Pf;
+          SIter Si;
+          DIter Di;
+
+          /* MEMBER FUNCTIONS */
+          Task( const PIter & Pi, const PIter & Pf,
+                const SIter & Si, const DIter & Di )
+            : Pi(Pi), Pf(Pf), Si(Si), Di(Di) { }
+
+          virtual ~Task() { }
+
+          virtual void exec() {
+            DIter d = Di;
+            for ( PIter p = Pi; p != Pf; ++p, ++d )
+              *d = *(Si + *p);
+          }
+        };
+
+        /** An array that must be finalized once all its chunks are done. */
+        struct Array {
+          virtual ~Array() { }
+          virtual void finish() = 0;
+        };
+
+        /** Gathers a std::vector into a temporary that is swapped in when
+         * finished. */
+        template < typename T, typename A >
+        struct VectorArray : Array {
+          std::vector<T,A> & v;
+          std::vector<T,A> tmp;
+
+          VectorArray( std::vector<T,A> & v, const int & n )
+            : v(v), tmp( n, T(), v.get_allocator() ) { }
+
+          virtual void finish() { v.swap( tmp ); }
+        };
+
+
+        /* STATIC STORAGE */
+      public:
+        /** Chunks smaller than this are not worth handing to another thread. */
+        static const int min_chunk_size = 4096;
+
+
+        /* MEMBER STORAGE */
+      private:
+        PIter Pi;
+        int n_items;
+        int n_chunks;
+        PThreadCache & cache;
+        PThreadTaskGroup tasks;
+        std::vector<Array *> arrays;
+
+
+        /* MEMBER FUNCTIONS */
+      public:
+        /** Constructor.
+         * @param Pi
+         *    Beginning of the gather list.
+         * @param Pf
+         *    End of the gather list.
+         * @param n_threads
+         *    Number of chunks to split each array into.  If n_threads <= 0,
+         *    the value of PThreadCache::get_max_threads() is used. [Default 0]
+         * @param cache
+         *    Specify the cache instance to use [Default xylose::pthreadCache].
+         */
+        PGather( const PIter & Pi, const PIter & Pf,
+                 const int & n_threads = 0,
+                 PThreadCache & cache = xylose::pthreadCache )
+          : Pi(Pi),
+            n_items( static_cast<int>(Pf - Pi) ),
+            n_chunks( n_threads > 0 ? n_threads : cache.get_max_threads() ),
+            cache(cache), tasks(cache) {
+          n_chunks = std::max( 1,
+                               std::min( n_chunks, n_items / min_chunk_size ) );
+        }
+
+        /** Destructor waits for all queued gathers to finish. */
+        ~PGather() { join(); }
+
+        /** Queue the gather of [Si, Si + n) into [Di, Di + n), where n is the
+         * length of the gather list.  The ranges must not overlap. */
+        template < typename SIter, typename DIter >
+        PGather & copy( const SIter & Si, const DIter & Di ) {
+          std::vector<PThreadTask *> chunks( n_chunks );
+          for ( int t = 0; t < n_chunks; ++t ) {
+            const int b = chunkBegin(t);
+            const int e = chunkBegin(t+1);
+            chunks[t] = new Task<SIter,DIter>( Pi + b, Pi + e, Si, Di + b );
+          }
+          tasks.addTasks( chunks.begin(), chunks.end() );
+          return *this;
+        }
+
+        /** Queue the in-place reordering of vector v.  The vector is replaced
+         * by its reordered copy during join(). */
+        template < typename T, typename A >
+        PGather & apply( std::vector<T,A> & v ) {
+          VectorArray<T,A> * a = new VectorArray<T,A>( v, n_items );
+          arrays.push_back( a );
+          return copy( v.begin(), a->tmp.begin() );
+        }
+
+        /** Wait for all queued gathers to finish. */
+        void join() {
+          PThreadTask * task;
+          while ( ( task = tasks.waitAny() ) != NULL )
+            delete task;
+
+          for ( unsigned int i = 0; i < arrays.size(); ++i ) {
+            arrays[i]->finish();
+            delete arrays[i];
+          }
+          arrays.clear();
+        }
+
+      private:
+        /** Copying is not allowed (the queued tasks are owned). */
+        PGather( const PGather & );
+        PGather & operator= ( const PGather & );
+
+        /** Index of first item of the t'th chunk of items. */
+        int chunkBegin( const int & t ) const {
+          return static_cast<int>(
+            ( static_cast<long long>(n_items) * t ) / n_chunks
+          );
+        }
+      };
+
+    }/* namespace xylose::nsort::utility */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_utility_PGather_h
@@ -0,0 +1,181 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_utility_PivotTree_h
+#define xylose_nsort_utility_PivotTree_h
+
+#include <xylose/nsort/NSort.h>
+#include <xylose/nsort/map/pivot.h>
+#include <xylose/nsort/tweak/median.h>
+#include <xylose/Vector.h>
+#include <xylose/Dimensions.hpp>
+
+#include <vector>
+
+namespace xylose {
+  namespace nsort {
+    namespace utility {
+
+      /** Balanced space-partitioning tree built by recursively applying
+       * NSort< map::pivot<dimensions> > to the particles.
+       * At each node, the split point is found with tweak::median and the
+       * node's particles are sorted into the children (in place) with
+       * NSort::cached_sort.  Each level of the tree therefore costs
+       * \f$ O(N) \f$ and the whole build \f$ O(N \log N) \f$.  After the build,
+       * the particles of each node are contiguous: [begin,end) relative to
+       * the first particle.
+       *
+       * Two kinds of splits are supported:
+       *   - all directions of the pivot at once:  a binary tree, quadtree, or
+       *     octree for one, two, or three dimensions.
+       *   - kd:  only the direction (of the pivot's dimensions) along which
+       *     the node's bounding box is widest is split, giving a kd-tree.
+       *
+       * A node becomes a leaf when it holds no more than leaf_size particles
+       * or when the split does not separate its particles (e.g. all
+       * particles at the same position).
+       *
+       * @tparam dimensions
+       *    Directions over which to split. [Default Dimensions<0,1,2>]
+       * @tparam n_bins
+       *    Number of bins of the median pre-histograms. [Default 64]
+       */
+      template < typename dimensions = Dimensions<0u,1u,2u>,
+                 unsigned int n_bins = 64u >
+      class PivotTree {
+        /* TYPEDEFS */
+      public:
+        typedef map::pivot< dimensions > pivot_map;
+        typedef tweak::median< n_bins > median_tweak;
+
+        /** A single node of the tree. */
+        struct Node {
+          /** Index of the first particle of this node. */
+          int begin;
+          /** Index one past the last particle of this node. */
+          int end;
+          /** Depth of this node (the root is at depth zero). */
+          int depth;
+          /** Split point (only meaningful for internal nodes).  Directions
+           * that were not split are at -infinity. */
+          Vector<double,3u> point;
+          /** Index of the first child node (children are contiguous);
+           * -1 for leaves. */
+          int first_child;
+          /** Number of (non-empty) children. */
+          int n_children;
+
+          Node( const int & begin = 0, const int & end = 0,
+                const int & depth = 0 )
+            : begin(begin), end(end), depth(depth), point(0.0),
+              first_child(-1), n_children(0) { }
+
+          int size() const { return end - begin; }
+          bool isLeaf() const { return n_children == 0; }
+        };
+
+        /* MEMBER STORAGE */
+      private:
+        std::vector<Node> nodes;
+        NSort< pivot_map, median_tweak > nsort;
+
+        /* MEMBER FUNCTIONS */
+      public:
+        PivotTree() : nsort( pivot_map::number_values ) { }
+
+        /** Build the tree over the particles in [Ai,Af), which are reordered.
+         * @param leaf_size
+         *    Maximum number of particles in a leaf.
+         * @param kd
+         *    Split only the widest direction of each node (kd-tree) instead
+         *    of all directions of the pivot.
+         */
+        template < typename Iter >
+        void build( const Iter & Ai, const Iter & Af,
+                    const int & leaf_size, const bool & kd = false ) {
+          typedef map::detail::dims_dirs<dimensions> D;
+          unsigned int dir[D::ndims];
+          D::get( dir );
+
+          nodes.clear();
+          nodes.push_back( Node( 0, static_cast<int>(Af - Ai), 0 ) );
+
+          /* nodes are processed in the order in which they are created
+           * (breadth first). */
+          for ( unsigned int n = 0u; n < nodes.size(); ++n ) {
+            const Node node = nodes[n];
+            if ( node.size() <= leaf_size )
+              continue;
+
+            const Iter first = Ai + node.begin;
+            const Iter last  = Ai + node.end;
+
+            pivot_map p;
+            median_tweak m;
+            unsigned int active = ~0u;
+            if ( kd ) {
+              /* find the bounding box only and split the widest direction. */
+              m.measure( first, last, p, 0u );
+              unsigned int widest = 0u;
+              for ( unsigned int d = 1u; d < D::ndims; ++d )
+                if ( ( m.upper()[dir[d]] - m.lower()[dir[d]] ) >
+                     ( m.upper()[dir[widest]] - m.lower()[dir[widest]] ) )
+                  widest = d;
+              active = 1u << widest;
+            }
+            m.measure( first, last, p, active );
+            nsort.cached_sort( first, last, p, m );
+
+            int n_nonempty = 0;
+            for ( int c = 0; c < nsort.size(); ++c )
+              n_nonempty += ( nsort.size(c) > 0 );
+            if ( n_nonempty < 2 )
+              continue;
+
+            nodes[n].point = p.point;
+            nodes[n].first_child = static_cast<int>(nodes.size());
+            nodes[n].n_children = n_nonempty;
+            for ( int c = 0; c < nsort.size(); ++c )
+              if ( nsort.size(c) > 0 )
+                nodes.push_back( Node( node.begin + nsort.begin(c),
+                                       node.begin + nsort.end(c),
+                                       node.depth + 1 ) );
+          }
+        }
+
+        /** All nodes of the tree; the root is the first node. */
+        const std::vector<Node> & getNodes() const { return nodes; }
+
+        /** The root node (only valid after build(...)). */
+        const Node & root() const { return nodes.front(); }
+
+        /** The ith child of the given (internal) node. */
+        const Node & child( const Node & node, const int & i ) const {
+          return nodes[ node.first_child + i ];
+        }
+      };
+
+    }/* namespace xylose::nsort::utility */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_utility_PivotTree_h
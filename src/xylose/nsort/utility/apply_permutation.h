@@ -0,0 +1,108 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#ifndef xylose_nsort_utility_apply_permutation_h
+#define xylose_nsort_utility_apply_permutation_h
+
+#include <vector>
+
+namespace xylose {
+  namespace nsort {
+    namespace utility {
+
+      /** Gather the items of the source range into the destination range
+       * according to the gather list [Pi,Pf) (as computed by
+       * NSort::permutation):
+       * <code>*(Di + j) = *(Si + *(Pi + j))</code>.
+       * The source and destination ranges must not overlap.
+       */
+      template < typename PIter, typename SIter, typename DIter >
+      inline void apply_permutation_copy( PIter Pi, const PIter & Pf,
+                                          const SIter & Si, DIter Di ) {
+        for ( ; Pi != Pf; ++Pi, ++Di )
+          *Di = *(Si + *Pi);
+      }
+
+      /** Reorder the vector v according to the gather list [Pi,Pf).
+       * The items are gathered in one pass into a new vector which is then
+       * swapped with v.
+       */
+      template < typename PIter, typename T, typename A >
+      inline void apply_permutation( const PIter & Pi, const PIter & Pf,
+                                     std::vector<T,A> & v ) {
+        std::vector<T,A> tmp( v.get_allocator() );
+        tmp.reserve( v.size() );
+        for ( PIter p = Pi; p != Pf; ++p )
+          tmp.push_back( v[*p] );
+        v.swap( tmp );
+      }
+
+      /** Reorder two parallel vectors according to the gather list [Pi,Pf).
+       * @see apply_permutation(const PIter&, const PIter&, std::vector<T,A>&)
+       */
+      template < typename PIter,
+                 typename T0, typename A0,
+                 typename T1, typename A1 >
+      inline void apply_permutation( const PIter & Pi, const PIter & Pf,
+                                     std::vector<T0,A0> & v0,
+                                     std::vector<T1,A1> & v1 ) {
+        apply_permutation( Pi, Pf, v0 );
+        apply_permutation( Pi, Pf, v1 );
+      }
+
+      /** Reorder three parallel vectors according to the gather list [Pi,Pf).
+       * @see apply_permutation(const PIter&, const PIter&, std::vector<T,A>&)
+       */
+      template < typename PIter,
+                 typename T0, typename A0,
+                 typename T1, typename A1,
+                 typename T2, typename A2 >
+      inline void apply_permutation( const PIter & Pi, const PIter & Pf,
+                                     std::vector<T0,A0> & v0,
+                                     std::vector<T1,A1> & v1,
+                                     std::vector<T2,A2> & v2 ) {
+        apply_permutation( Pi, Pf, v0, v1 );
+        apply_permutation( Pi, Pf, v2 );
+      }
+
+      /** Reorder four parallel vectors according to the gather list [Pi,Pf).
+       * @see apply_permutation(const PIter&, const PIter&, std::vector<T,A>&)
+       */
+      template < typename PIter,
+                 typename T0, typename A0,
+                 typename T1, typename A1,
+                 typename T2, typename A2,
+                 typename T3, typename A3 >
+      inline void apply_permutation( const PIter & Pi, const PIter & Pf,
+                                     std::vector<T0,A0> & v0,
+                                     std::vector<T1,A1> & v1,
+                                     std::vector<T2,A2> & v2,
+                                     std::vector<T3,A3> & v3 ) {
+        apply_permutation( Pi, Pf, v0, v1, v2 );
+        apply_permutation( Pi, Pf, v3 );
+      }
+
+    }/* namespace xylose::nsort::utility */
+  }/* namespace xylose::nsort */
+}/* namespace xylose */
+
+#endif // xylose_nsort_utility_apply_permutation_h
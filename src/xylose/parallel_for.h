@@ -0,0 +1,331 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+/** \file
+ * Loop-level parallelism on top of the xylose::PThreadCache facility:
+ * xylose::parallel_for and xylose::parallel_reduce.
+ */
+
+#ifndef xylose_parallel_for_h
+#define xylose_parallel_for_h
+
+#include <xylose/PThreadCache.h>
+#include <xylose/IteratorRange.h>
+#include <xylose/detail/atomic.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace xylose {
+
+  /** How the chunks of a range are distributed over the threads of the
+   * cache by parallel_for and parallel_reduce. */
+  enum ParallelSchedule {
+    /** Recursively split the chunks in halves; one half is handed to the
+     * cache as a new task while the other half is split further.  Nested
+     * halves land on the deque of the splitting worker such that idle
+     * workers balance the load by stealing the large (old) halves. */
+    RECURSIVE,
+
+    /** One contiguous block of chunks for each thread. */
+    STATIC,
+
+    /** Each thread repeatedly takes the next unprocessed chunk from a shared
+     * atomic counter. */
+    DYNAMIC
+  };
+
+  namespace detail {
+
+    /** Distributes the chunk indices [0, n) over the threads of a cache.
+     * The functor is called as f(c0, c1) for disjoint, contiguous subsets
+     * [c0, c1) of the chunks; every chunk is passed exactly once.
+     */
+    template < typename F >
+    class ParallelChunks {
+      /* TYPEDEFS */
+    private:
+      /** Task that processes a contiguous block of chunks. */
+      struct BlockTask : PThreadTask {
+        ParallelChunks * p;
+        std::size_t c0, c1;
+        BlockTask( ParallelChunks * p, std::size_t c0, std::size_t c1 )
+          : p(p), c0(c0), c1(c1) { }
+        virtual void exec() { p->f( c0, c1 ); }
+      };
+
+      /** Task that splits a block of chunks further. */
+      struct SplitTask : BlockTask {
+        SplitTask( ParallelChunks * p, std::size_t c0, std::size_t c1 )
+          : BlockTask( p, c0, c1 ) { }
+        virtual void exec() { this->p->split( this->c0, this->c1 ); }
+      };
+
+      /** Task that takes chunks from the shared counter. */
+      struct DynamicTask : BlockTask {
+        DynamicTask( ParallelChunks * p ) : BlockTask( p, 0, 0 ) { }
+        virtual void exec() { this->p->dynamic(); }
+      };
+
+
+      /* MEMBER STORAGE */
+    private:
+      const F & f;
+      const std::size_t n;
+      std::size_t next;   /**< atomic counter for the DYNAMIC schedule. */
+      PThreadTaskGroup tasks;
+
+
+      /* MEMBER FUNCTIONS */
+    public:
+      ParallelChunks( const F & f, const std::size_t & n, PThreadCache & cache )
+        : f(f), n(n), next(0), tasks(cache) { }
+
+      /** Process all chunks and return after all of them are done. */
+      void run( const ParallelSchedule & schedule, const int & n_threads ) {
+        if ( n_threads <= 1 || n <= 1 ) {
+          f( 0, n );
+          return;
+        }
+
+        const std::size_t n_tasks =
+          std::min( static_cast<std::size_t>(n_threads), n );
+        std::vector<PThreadTask *> others;
+
+        switch ( schedule ) {
+          case STATIC:
+            /* the calling thread takes the first block itself. */
+            for ( std::size_t t = 1; t < n_tasks; ++t )
+              others.push_back( new BlockTask( this, n * t / n_tasks,
+                                                     n * (t+1) / n_tasks ) );
+            tasks.addTasks( others.begin(), others.end() );
+            f( 0, n / n_tasks );
+            break;
+
+          case DYNAMIC:
+            for ( std::size_t t = 1; t < n_tasks; ++t )
+              others.push_back( new DynamicTask( this ) );
+            tasks.addTasks( others.begin(), others.end() );
+            dynamic();
+            break;
+
+          case RECURSIVE:
+          default:
+            split( 0, n );
+            break;
+        }
+
+        PThreadTask * task;
+        while ( ( task = tasks.waitAny() ) != NULL )
+          delete task;
+      }
+
+    private:
+      /** Copying is not allowed. */
+      ParallelChunks( const ParallelChunks & );
+      ParallelChunks & operator= ( const ParallelChunks & );
+
+      void split( std::size_t c0, std::size_t c1 ) {
+        while ( c1 - c0 > 1 ) {
+          const std::size_t mid = c0 + (c1 - c0) / 2;
+          tasks.add( new SplitTask( this, mid, c1 ) );
+          c1 = mid;
+        }
+        f( c0, c1 );
+      }
+
+      void dynamic() {
+        std::size_t c;
+        while ( ( c = atomic::add( &next, std::size_t(1) ) - 1 ) < n )
+          f( c, c+1 );
+      }
+    };
+
+    /** Boundary of chunk c when the n elements are split into n_chunks
+     * chunks of (nearly) equal size. */
+    inline std::size_t chunkBoundary( const std::size_t & n,
+                                      const std::size_t & n_chunks,
+                                      const std::size_t & c ) {
+      return n * c / n_chunks;
+    }
+
+    /** Calls the parallel_for body on the union of a block of chunks. */
+    template < typename Iter, typename Body >
+    struct ForChunks {
+      const Iter first;
+      const std::size_t n, n_chunks;
+      const Body & body;
+
+      ForChunks( const Iter & first, const std::size_t & n,
+                 const std::size_t & n_chunks, const Body & body )
+        : first(first), n(n), n_chunks(n_chunks), body(body) { }
+
+      void operator() ( const std::size_t & c0, const std::size_t & c1 ) const {
+        if ( c0 == c1 )
+          return;
+        body( IteratorRange<Iter>( first + chunkBoundary( n, n_chunks, c0 ),
+                                   first + chunkBoundary( n, n_chunks, c1 ) ) );
+      }
+    };
+
+    /** Computes the partial result of each chunk separately for
+     * parallel_reduce. */
+    template < typename Iter, typename T, typename Body >
+    struct ReduceChunks {
+      const Iter first;
+      const std::size_t n, n_chunks;
+      const T & identity;
+      const Body & body;
+      std::vector<T> & partials;
+
+      ReduceChunks( const Iter & first, const std::size_t & n,
+                    const std::size_t & n_chunks, const T & identity,
+                    const Body & body, std::vector<T> & partials )
+        : first(first), n(n), n_chunks(n_chunks), identity(identity),
+          body(body), partials(partials) { }
+
+      void operator() ( const std::size_t & c0, const std::size_t & c1 ) const {
+        for ( std::size_t c = c0; c < c1; ++c )
+          partials[c] =
+            body( IteratorRange<Iter>( first + chunkBoundary( n, n_chunks, c ),
+                                       first + chunkBoundary( n, n_chunks, c+1 )),
+                  identity );
+      }
+    };
+
+  } /* namespace detail */
+
+  /** Apply a body to all elements of a range in parallel.
+   *
+   * The range is cut into chunks of at most grain elements which are
+   * distributed over the threads of the cache according to the schedule.
+   * The body is called as body(subrange) with an IteratorRange<Iter> that
+   * covers one or more (contiguous) chunks; it is shared by all threads and
+   * therefore called concurrently for disjoint subranges.  The call returns
+   * after the whole range is processed.  When called from within a task of
+   * the cache, the calling worker executes other tasks while it waits.
+   *
+   * @param range
+   *    The elements to process.  Iter must be a random-access iterator or
+   *    an integral type (e.g. IteratorRange<int>(0,n) for plain indices).
+   * @param grain
+   *    Maximum number of elements per chunk.  Zero chooses about eight
+   *    chunks per thread.
+   * @param body
+   *    Functor called as body(const IteratorRange<Iter> &) const.
+   * @param schedule
+   *    How chunks are distributed [Default RECURSIVE].
+   * @param cache
+   *    Specify the cache instance to use [default xylose::pthreadCache].
+   */
+  template < typename Iter, typename Body >
+  inline void parallel_for( const IteratorRange<Iter> & range,
+                            std::size_t grain,
+                            const Body & body,
+                            const ParallelSchedule & schedule = RECURSIVE,
+                            PThreadCache & cache = pthreadCache ) {
+    const std::size_t n = range.size();
+    if ( n == 0 )
+      return;
+
+    const int n_threads = cache.get_max_threads();
+    if ( grain == 0 )
+      grain = std::max( std::size_t(1),
+                        n / ( 8 * std::max(1, n_threads) ) );
+
+    const std::size_t n_chunks = ( n + grain - 1 ) / grain;
+    detail::ForChunks<Iter,Body> f( range.begin(), n, n_chunks, body );
+    detail::ParallelChunks< detail::ForChunks<Iter,Body> >( f, n_chunks, cache )
+      .run( schedule, n_threads );
+  }
+
+  /** Reduce a range in parallel with a result that does not depend on the
+   * number of threads or on the schedule.
+   *
+   * The range is cut into a fixed set of chunks of at most grain elements.
+   * Each chunk is reduced separately as body(chunk, identity); the partial
+   * results are then combined in a fixed pairwise tree in the order of the
+   * chunks:  combine(p0,p1), combine(p2,p3), ... and so on up the tree.
+   * Since neither the chunks nor the order of combination depend on how the
+   * chunks were distributed, floating point sums are bit-reproducible for
+   * any number of threads as long as the grain is kept the same.
+   *
+   * @param range
+   *    The elements to reduce (see parallel_for).
+   * @param grain
+   *    Maximum number of elements per chunk.  Zero chooses at most 256
+   *    chunks (independent of the number of threads).
+   * @param identity
+   *    Identity element of combine; also the initial value of each chunk.
+   * @param body
+   *    Functor called as T body(const IteratorRange<Iter> &, const T & init)
+   *    const that returns init reduced with all the elements of the range.
+   * @param combine
+   *    Functor called as T combine(const T & left, const T & right) const.
+   * @param schedule
+   *    How chunks are distributed [Default RECURSIVE].
+   * @param cache
+   *    Specify the cache instance to use [default xylose::pthreadCache].
+   */
+  template < typename Iter, typename T, typename Body, typename Combine >
+  inline T parallel_reduce( const IteratorRange<Iter> & range,
+                            std::size_t grain,
+                            const T & identity,
+                            const Body & body,
+                            const Combine & combine,
+                            const ParallelSchedule & schedule = RECURSIVE,
+                            PThreadCache & cache = pthreadCache ) {
+    const std::size_t n = range.size();
+    if ( n == 0 )
+      return identity;
+
+    if ( grain == 0 )
+      grain = ( n + 255 ) / 256;
+
+    const std::size_t n_chunks = ( n + grain - 1 ) / grain;
+    std::vector<T> partials( n_chunks, identity );
+
+    typedef detail::ReduceChunks<Iter,T,Body> RC;
+    RC f( range.begin(), n, n_chunks, identity, body, partials );
+    detail::ParallelChunks<RC>( f, n_chunks, cache )
+      .run( schedule, cache.get_max_threads() );
+
+    for ( std::size_t stride = 1; stride < n_chunks; stride *= 2 )
+      for ( std::size_t i = 0; i + stride < n_chunks; i += 2 * stride )
+        partials[i] = combine( partials[i], partials[i + stride] );
+
+    return partials[0];
+  }
+
+  /** parallel_reduce with the default grain and schedule on the default
+   * cache. */
+  template < typename Iter, typename T, typename Body, typename Combine >
+  inline T parallel_reduce( const IteratorRange<Iter> & range,
+                            const T & identity,
+                            const Body & body,
+                            const Combine & combine ) {
+    return parallel_reduce( range, 0, identity, body, combine );
+  }
+
+} /* namespace xylose */
+
+#endif // xylose_parallel_for_h
@@ -26,10 +26,16 @@
 #include <xylose/segmented_vector.hpp>
 #include <xylose/logger.h>
 #include <xylose/SyncLock.h>
-#include <xylose/bits.hpp>
 
 #include <vector>
-#include <cassert>
+
+/* Per-thread magazines are only used with the pthread thread system (the
+ * other thread systems fall back to the shared pool for every call).  Define
+ * NO_POOL_MAGAZINES to disable them. */
+#if defined(USE_PTHREAD) && !defined(_OPENMP) && !defined(NO_POOL_MAGAZINES)
+#  include <pthread.h>
+#  define XYLOSE_POOL_MAGAZINES
+#endif
 
 namespace xylose {
 
@@ -45,7 +51,17 @@ namespace xylose {
   /** Pooled memory allocator for allocating one item at a time. 
    * By default, the segmented_vector is used for the source of memory to
    * allocate.  Using a segmented_vector helps this class allocate mostly
-   * contiguous chunks in memory.  */
+   * contiguous chunks in memory.
+   *
+   * Free items are kept on an intrusive (LIFO) free list that is threaded
+   * through the freed items themselves, so allocate and deallocate are O(1)
+   * regardless of the order in which items are freed.  Like std::allocator,
+   * deallocate does not validate the pointers it is given.
+   *
+   * When compiled with USE_PTHREAD, each thread keeps a small magazine of free
+   * items so that most allocate/deallocate calls do not touch the shared pool
+   * (or its lock) at all.  Magazines are refilled from, and drained back to,
+   * the shared pool Impl::refill_size items at a time.  */
   template < typename T,
              template <typename,typename> class Container =
                detail::DefaultPoolContainerT::type,
@@ -63,9 +79,9 @@ namespace xylose {
     typedef std::ptrdiff_t    difference_type;
 
     /** Meta function to calculate the size of an item in the pool.  This
-     * calculation ensures that at least sizeof(int) number of bytes exist so
-     * that the union between 'int next_offset' and 'long bytes[]' will always
-     * have enough memory to support the 'int next_offset' union member. 
+     * rounds sizeof(T) up to a whole number of longs.  The union between
+     * 'PoolItem * next_free' and 'long bytes[]' further ensures that each item
+     * has room for the free list link.
      */
     struct chunk_size {
       static const unsigned int value =
@@ -94,39 +110,96 @@ namespace xylose {
 
   private:
     union PoolItem {
-      int next_offset;
+      /** Next item on the free list (only meaningful while free). */
+      PoolItem * next_free;
       long bytes[chunk_size::value / sizeof(long)];
 
-      /** Constructor sets the next_offset to default to this+1 */
-      PoolItem() : next_offset(1) {}
+      PoolItem() : next_free(NULL) {}
     };
 
     typedef Container<PoolItem,ContainerAlloc> Pool;
     typedef typename Pool::iterator PoolIter;
     typedef xylose::SyncKey MemKey;
 
-
     struct Impl {
     /* TYPEDEFS */
-      /** oh, the evil of using std::vector<bool> !  */
-      typedef std::vector<unsigned char> UsedBits;
+      /** Capacity of a per-thread magazine and the number of items moved
+       * between a magazine and the shared pool at once. */
+      enum {
+        magazine_size = 64,
+        refill_size   = magazine_size / 2
+      };
+
+#ifdef XYLOSE_POOL_MAGAZINES
+      /** Per-thread cache of free pool items.  Only the owning thread touches
+       * it, except for reset() which requires the pool to be quiescent. */
+      struct Magazine {
+        Impl * impl;
+        /** Next magazine in the list of live magazines of impl. */
+        Magazine * next;
+        /** Number of free items in items[]. */
+        int n;
+        /** Number of items deallocated by this thread while noOPDealloc is
+         * set.  These are not given back to the pool (until reset()). */
+        int n_discarded;
+        pointer items[magazine_size];
+
+        Magazine( Impl * impl )
+          : impl(impl), next(NULL), n(0), n_discarded(0) { }
+      };
+#endif
 
     /* MEMBER STORAGE */
     private:
-      /** The used vector should be the same length as the Pool container
-       * divided by 8. */
-      UsedBits used;
       Pool pool;
+      /** First pool item that has never been handed out. */
       PoolIter next;
-      /** A counter to tell how many items are currently allocated. */
+      /** Head of the list of freed items (reused before next). */
+      PoolItem * free_list;
+      /** A counter to tell how many items are currently allocated.  Items
+       * cached in per-thread magazines are counted as allocated. */
       int number_allocated;
       /** A resource lock for the memory pool. */
       xylose::SyncLock memLock;
+#ifdef XYLOSE_POOL_MAGAZINES
+      /** List of all live magazines (protected by memLock). */
+      Magazine * magazines;
+      /** Key used only to hand a magazine back when its thread exits. */
+      pthread_key_t magazine_key;
+      bool have_magazine_key;
+#endif
 
       /* MEMBER FUNCTIONS */
     public:
       /** Constructor; sets next allocation to beginning of pool. */
-      Impl() : used(), pool(), next(pool.begin()), number_allocated(0) { }
+      Impl()
+        : pool(), next(pool.begin()), free_list(NULL), number_allocated(0) {
+#ifdef XYLOSE_POOL_MAGAZINES
+        magazines = NULL;
+        have_magazine_key = false;
+#endif
+      }
+
+#ifdef XYLOSE_POOL_MAGAZINES
+      /** Destructor frees the magazines of all threads.  The thread-exit key
+       * is deleted first, so threads that exit later (e.g. the workers of a
+       * static PThreadCache that are joined during static destruction) no
+       * longer retire their magazines into this pool. */
+      ~Impl() {
+        MemKey memKey( memLock );/* RAII type synchronization */
+        if ( have_magazine_key ) {
+          pthread_key_delete( magazine_key );
+          have_magazine_key = false;
+        }
+
+        while ( magazines ) {
+          Magazine * m = magazines;
+          magazines = m->next;
+          delete m;
+        }
+        localMagazine() = NULL;
+      }
+#endif
 
       pointer allocate(size_type n, const_pointer p = NULL) {
         if (n != 1) {
@@ -135,30 +208,46 @@ namespace xylose {
           throw std::bad_alloc();
         }
 
+#ifdef XYLOSE_POOL_MAGAZINES
+        Magazine & m = magazine();
+        if ( m.n == 0 ) {
+          MemKey memKey( memLock );/* RAII type synchronization */
+          while ( m.n < refill_size )
+            m.items[m.n++] = allocateLocked();
+        }
+
+        return m.items[--m.n];
+#else
         MemKey memKey( memLock );/* RAII type synchronization */
+        return allocateLocked();
+#endif
+      }
 
-        if (next == pool.end()) {
-          /* need to expand the allocation pool */
-          pool.push_back( PoolItem() );
-          next = pool.end();
-          --next;
+    private:
+      /** Take the next free item from the shared pool (memLock held). */
+      pointer allocateLocked() {
+        PoolItem * pi = free_list;
+        if ( pi ) {
+          free_list = pi->next_free;
+        } else {
+          if (next == pool.end()) {
+            /* need to expand the allocation pool */
+            pool.push_back( PoolItem() );
+            next = pool.end();
+            --next;
+          }
 
-          /* push a new blank byte if necessary. */
-          bits::resize( used, pool.size() );
+          pi = &(*next);
+          ++next;
         }
 
-        PoolIter pi = next;
-        next += next->next_offset;
-
-        /* mark the item as used and give the memory to the caller */
-        bits::set( used, pi - pool.begin() );
-
         ++number_allocated;
         std::allocator<void>::pointer retval = pi->bytes;
         return reinterpret_cast<pointer>(retval);
       }
 
-      /** Resets the allocator so that 1) all used[] items are false, and 2)
+    public:
+      /** Resets the allocator so that 1) all pool items are free, and 2)
        * only rsz number of pool items are left in the pool.  This reserve
        * operation essentially resizes all appropriate vectors/containers so
        * that only rsz items are left.
@@ -171,7 +260,15 @@ namespace xylose {
        */
       void reset( int rsz = -1 ) {
         MemKey memKey( memLock );/* RAII type synchronization */
-        if ( number_allocated != 0 ) {
+
+        /* items sitting in magazines are free as far as the caller cares. */
+        int cached = 0;
+#ifdef XYLOSE_POOL_MAGAZINES
+        for ( Magazine * m = magazines; m; m = m->next )
+          cached += m->n + m->n_discarded;
+#endif
+
+        if ( number_allocated != cached ) {
           logger::log_severe("pool allocator reset only valid if no "
                              "objects are allocated ");
           throw std::bad_alloc();
@@ -179,24 +276,27 @@ namespace xylose {
 
         if ( rsz < 0 ) {
           /* no efforts to release memory */
-          used.clear();
           pool.clear();
         } else {
           /* trying to release memory */
-          UsedBits tmpU;
           Pool tmpP;
-          used.swap( tmpU );
           pool.swap( tmpP );
-
         }
 
         /* we'll go ahead and initialize each of the pool items right now so
          * that allocate doesn't have to. */
         rsz = pool.capacity();
-        bits::resize( used, rsz );
         pool.resize( rsz );
 
         next = pool.begin();
+        free_list = NULL;
+        number_allocated = 0;
+
+#ifdef XYLOSE_POOL_MAGAZINES
+        /* the cached items went away with the old pool. */
+        for ( Magazine * m = magazines; m; m = m->next )
+          m->n = m->n_discarded = 0;
+#endif
       }
 
       void deallocate(pointer p, size_type n) {
@@ -206,87 +306,87 @@ namespace xylose {
           throw std::bad_alloc();
         }
 
+#ifdef XYLOSE_POOL_MAGAZINES
+        Magazine & m = magazine();
+        if ( noOPDealloc ) {
+          ++m.n_discarded;
+          return;
+        }
+
+        if ( m.n == magazine_size ) {
+          MemKey memKey( memLock );/* RAII type synchronization */
+          while ( m.n > magazine_size - refill_size )
+            deallocateLocked( m.items[--m.n] );
+        }
+
+        m.items[m.n++] = p;
+#else
         MemKey memKey( memLock );/* RAII type synchronization */
+        deallocateLocked( p );
+#endif
+      }
+
+    private:
+      /** Return an item to the shared pool (memLock held). */
+      void deallocateLocked( pointer p ) {
         --number_allocated;
 
         if ( noOPDealloc )
           /* This should be dead code for when noOPDealloc is false */
           return;
 
-        PoolIter pi = pool.getIterator(reinterpret_cast<PoolItem*>(p));
+        /* push the item onto the free list */
+        PoolItem * pi = reinterpret_cast<PoolItem*>(p);
+        pi->next_free = free_list;
+        free_list = pi;
+      }
 
-        if ( pi < next ) {
-          if (pi < pool.begin()) {
-            logger::log_severe("tried to free an item not in pool allocator");
-            ++number_allocated; /* Need to correct the number allocated. */
-            throw std::bad_alloc();
-          }
+#ifdef XYLOSE_POOL_MAGAZINES
+      /** The calling thread's magazine for this pool. */
+      static Magazine *& localMagazine() {
+        static __thread Magazine * m = NULL;
+        return m;
+      }
 
-          /* We're in luck.  This deallocation is really easy. */
-          pi->next_offset = (next - pi);
-          next = pi;
-
-          bits::unset( used, pi - pool.begin() );
-        } else if ( pi < pool.end() ) {
-          int pi_idx = pi - pool.begin();
-          int used_byte_idx  = pi_idx / 8u;
-          int used_bit_idx   = pi_idx % 8u;
-
-          assert( used.size() == ( (pool.size() + 7u) / 8u ) );
-          int used_byte_ridx = ((pool.size()-1u) / 8u) - used_byte_idx;
-
-          /* we have to search for unused items lower in index. */
-          UsedBits::reverse_iterator bi = used.rbegin() + used_byte_ridx;
-
-          if (!(*bi & ( 1 << used_bit_idx ))) {
-            logger::log_severe(
-              "tried to free an item that was already freed:  "
-              "%lu of %lu items", pi - pool.begin(), pool.size()
-            );
-            ++number_allocated; /* Need to correct the number allocated. */
-            throw std::bad_alloc();
-          }
+      Magazine & magazine() {
+        Magazine *& m = localMagazine();
+        if ( !m ) {
+          m = new Magazine( this );
 
-          /* first search for any unused items within the same byte. */
-          int unused_bit = used_bit_idx-1;
-          {
-            const UsedBits::value_type & mixed_byte = *bi;
-            while ( unused_bit >= 0 && mixed_byte & (1 << unused_bit) )
-              --unused_bit;
+          MemKey memKey( memLock );/* RAII type synchronization */
+          if ( !have_magazine_key ) {
+            pthread_key_create( &magazine_key, &Impl::retireMagazine );
+            have_magazine_key = true;
           }
+          pthread_setspecific( magazine_key, m );
 
-          if ( unused_bit < 0 ) {
-            /* now search for the next byte with an item not allocated. */
-            for (++bi; bi != used.rend() && (*bi) == 0xff; ++bi);
-
-            if ( bi == used.rend() ) {
-              logger::log_severe("could not find previous freed item in allocator pool");
-              ++number_allocated; /* Need to correct the number allocated. */
-              throw std::bad_alloc();
-            }
-
-            /* now search for the particular unused bit. */
-            unused_bit = 7;
-            {
-              const UsedBits::value_type & mixed_byte = *bi;
-              while ( unused_bit >= 0 && mixed_byte & (1 << unused_bit) )
-                --unused_bit;
-            }
-          }
+          m->next = magazines;
+          magazines = m;
+        }
 
-          assert( unused_bit >= 0 );
+        return *m;
+      }
 
-          PoolIter i = pool.begin() + (used.rend() - bi - 1 + unused_bit);
-          int pi_minus_i = (pi - i);
-          pi->next_offset = i->next_offset - pi_minus_i;
-          i->next_offset = pi_minus_i;
-          bits::unset( used, pi - pool.begin() );
-        } else {
-          logger::log_severe("tried to free an item not in pool allocator");
-          ++number_allocated; /* Need to correct the number allocated. */
-          throw std::bad_alloc();
-        }
+      /** Thread-exit hook:  gives the cached items back to the pool. */
+      static void retireMagazine( void * vm ) {
+        Magazine * m = static_cast<Magazine*>( vm );
+        m->impl->retire( m );
+        localMagazine() = NULL;
+        delete m;
+      }
+
+      void retire( Magazine * m ) {
+        MemKey memKey( memLock );/* RAII type synchronization */
+        while ( m->n > 0 )
+          deallocateLocked( m->items[--m->n] );
+        number_allocated -= m->n_discarded;
+
+        Magazine ** i = &magazines;
+        while ( *i != m )
+          i = &(*i)->next;
+        *i = m->next;
       }
+#endif
 
     };/* struct Impl */
 
@@ -332,7 +432,7 @@ namespace xylose {
       return impl.allocate(n, reinterpret_cast<const_pointer>(p));
     }
 
-    /** Resets the allocator so that 1) all used[] items are false, and 2)
+    /** Resets the allocator so that 1) all pool items are free, and 2)
      * only rsz number of pool items are left in the pool.  This reserve
      * operation essentially resizes all appropriate vectors/containers so
      * that only rsz items are left.
@@ -0,0 +1,506 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE  PThreadCache
+
+#include <xylose/PThreadCache.h>
+#include <xylose/PThreadTaskPool.h>
+#include <xylose/detail/WorkStealingDeque.h>
+#include <xylose/detail/atomic.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <algorithm>
+
+namespace {
+  namespace atomic = xylose::detail::atomic;
+  using xylose::PThreadTask;
+  using xylose::PThreadTaskSet;
+  using xylose::PThreadCache;
+  using xylose::PThreadTaskGroup;
+
+  typedef xylose::detail::WorkStealingDeque<int *> Deque;
+
+  /** Steal from the deque until told to stop and count the stolen items. */
+  struct Thief {
+    Deque * deque;
+    std::vector<int> * taken;
+    bool * stop;
+    pthread_t id;
+
+    static void * run( void * arg ) {
+      Thief * t = static_cast<Thief *>( arg );
+      while ( !atomic::load( t->stop ) || !t->deque->empty() ) {
+        int * x = t->deque->steal();
+        if ( x )
+          atomic::add( &(*t->taken)[*x], 1 );
+      }
+      return NULL;
+    }
+  };
+
+  /** Increment a counter. */
+  struct Increment : PThreadTask {
+    int * counter;
+    Increment( int * counter ) : counter(counter) { }
+    virtual void exec() { atomic::add( counter, 1 ); }
+  };
+
+  /** Record the worker index and the cpu that the task ran on. */
+  struct WhereAmI : PThreadTask {
+    PThreadCache * cache;
+    int worker, cpu;
+    WhereAmI( PThreadCache * cache = NULL )
+      : cache(cache), worker(-2), cpu(-2) { }
+    virtual void exec() {
+      worker = cache->get_worker_index();
+      cpu = sched_getcpu();
+    }
+  };
+
+  /** Add a batch of Increment tasks from within a worker and wait for
+   * them. */
+  struct Batch : PThreadTask {
+    PThreadCache * cache;
+    int * counter;
+    Batch( PThreadCache * cache = NULL, int * counter = NULL )
+      : cache(cache), counter(counter) { }
+    virtual void exec() {
+      std::vector<Increment> tasks( 100, Increment( counter ) );
+      std::vector<PThreadTask *> ptrs;
+      for ( unsigned int i = 0u; i < tasks.size(); ++i )
+        ptrs.push_back( &tasks[i] );
+      PThreadTaskGroup group( *cache );
+      group.addTasks( ptrs.begin(), ptrs.end() );
+      group.wait();
+    }
+  };
+
+  /** Wait for all tasks of the set and delete them. */
+  void join( PThreadCache & cache, PThreadTaskSet & tasks ) {
+    while ( tasks.size() > 0 ) {
+      PThreadTaskSet finished = cache.waitForTasks( tasks );
+      for ( PThreadTaskSet::iterator i = finished.begin();
+            i != finished.end(); ++i ) {
+        tasks.erase( *i );
+        delete *i;
+      }
+    }
+  }
+
+  /** Count the leaves of a binary tree of the given depth by adding
+   * (nested) tasks for both subtrees and waiting for them. */
+  struct Tree : PThreadTask {
+    PThreadCache & cache;
+    int depth;
+    int * leaves;
+
+    Tree( PThreadCache & cache, const int & depth, int * leaves )
+      : cache(cache), depth(depth), leaves(leaves) { }
+
+    virtual void exec() {
+      if ( depth == 0 ) {
+        atomic::add( leaves, 1 );
+        return;
+      }
+
+      PThreadTaskSet tasks;
+      for ( int i = 0; i < 2; ++i ) {
+        PThreadTask * t = new Tree( cache, depth - 1, leaves );
+        tasks.insert( t );
+        cache.addTask( t );
+      }
+      join( cache, tasks );
+    }
+  };
+
+  /** The same tree, using task groups. */
+  struct GroupTree : PThreadTask {
+    PThreadCache & cache;
+    int depth;
+    int * leaves;
+
+    GroupTree( PThreadCache & cache, const int & depth, int * leaves )
+      : cache(cache), depth(depth), leaves(leaves) { }
+
+    virtual void exec() {
+      if ( depth == 0 ) {
+        atomic::add( leaves, 1 );
+        return;
+      }
+
+      GroupTree a( cache, depth - 1, leaves ), b( cache, depth - 1, leaves );
+      PThreadTaskGroup group( cache );
+      group.add( &a );
+      group.add( &b );
+      group.wait();
+    }
+  };
+
+  /** An owner thread that adds and waits for its own group of tasks. */
+  struct Owner {
+    PThreadCache * cache;
+    int counter;
+    int n_returned;
+    pthread_t id;
+
+    static void * run( void * arg ) {
+      Owner * o = static_cast<Owner *>( arg );
+      PThreadTaskGroup group( *o->cache );
+      for ( int i = 0; i < 1000; ++i )
+        group.add( new Increment( &o->counter ) );
+
+      PThreadTask * t;
+      while ( ( t = group.waitAny() ) != NULL ) {
+        ++o->n_returned;
+        delete t;
+      }
+      return NULL;
+    }
+  };
+
+}
+
+BOOST_AUTO_TEST_SUITE( PThreadCache_tests );
+
+BOOST_AUTO_TEST_CASE( deque_owner ) {
+  const int n = 1000; /* more than the initial capacity */
+  std::vector<int> v( n );
+  Deque d;
+  BOOST_CHECK( d.empty() );
+  BOOST_CHECK( d.pop() == NULL );
+  BOOST_CHECK( d.steal() == NULL );
+
+  for ( int i = 0; i < n; ++i ) {
+    v[i] = i;
+    d.push( &v[i] );
+  }
+  BOOST_CHECK_EQUAL( d.size(), n );
+
+  /* the owner pops LIFO, thieves steal FIFO */
+  BOOST_CHECK_EQUAL( *d.pop(), n - 1 );
+  BOOST_CHECK_EQUAL( *d.steal(), 0 );
+  BOOST_CHECK_EQUAL( *d.steal(), 1 );
+  BOOST_CHECK_EQUAL( *d.pop(), n - 2 );
+
+  int count = 4;
+  while ( d.pop() )
+    ++count;
+  BOOST_CHECK_EQUAL( count, n );
+  BOOST_CHECK( d.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( deque_thieves ) {
+  const int n = 100000;
+  const int n_thieves = 3;
+  std::vector<int> v( n ), taken( n, 0 );
+  Deque d( 16 );
+  bool stop = false;
+
+  Thief thieves[n_thieves];
+  for ( int t = 0; t < n_thieves; ++t ) {
+    thieves[t].deque = &d;
+    thieves[t].taken = &taken;
+    thieves[t].stop = &stop;
+    pthread_create( &thieves[t].id, NULL, Thief::run, &thieves[t] );
+  }
+
+  for ( int i = 0; i < n; ++i ) {
+    v[i] = i;
+    d.push( &v[i] );
+    if ( i % 3 == 0 ) {
+      int * x = d.pop();
+      if ( x )
+        atomic::add( &taken[*x], 1 );
+    }
+  }
+  atomic::store( &stop, true );
+
+  for ( int t = 0; t < n_thieves; ++t )
+    pthread_join( thieves[t].id, NULL );
+
+  /* every item was taken exactly once */
+  int n_wrong = 0;
+  for ( int i = 0; i < n; ++i )
+    if ( taken[i] != 1 )
+      ++n_wrong;
+  BOOST_CHECK_EQUAL( n_wrong, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( many_tasks ) {
+  PThreadCache cache;
+  for ( int nt = 1; nt <= 4; nt *= 2 ) {
+    cache.set_max_threads( nt );
+
+    int counter = 0;
+    PThreadTaskSet tasks;
+    for ( int i = 0; i < 10000; ++i ) {
+      PThreadTask * t = new Increment( &counter );
+      tasks.insert( t );
+      cache.addTask( t );
+    }
+    join( cache, tasks );
+    BOOST_CHECK_EQUAL( counter, 10000 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( nested_tasks ) {
+  PThreadCache cache;
+  cache.set_max_threads( 4 );
+
+  int leaves = 0;
+  PThreadTaskSet tasks;
+  PThreadTask * t = new Tree( cache, 10, &leaves );
+  tasks.insert( t );
+  cache.addTask( t );
+  join( cache, tasks );
+  BOOST_CHECK_EQUAL( leaves, 1024 );
+}
+
+BOOST_AUTO_TEST_CASE( group_wait ) {
+  PThreadCache cache;
+  for ( int nt = 1; nt <= 4; nt *= 2 ) {
+    cache.set_max_threads( nt );
+
+    int counter = 0;
+    std::vector<Increment> tasks( 1000, Increment( &counter ) );
+    PThreadTaskGroup group( cache );
+    for ( unsigned int i = 0u; i < tasks.size(); ++i )
+      group.add( &tasks[i] );
+    group.wait();
+    BOOST_CHECK_EQUAL( counter, 1000 );
+    BOOST_CHECK_EQUAL( group.outstanding(), 0 );
+    BOOST_CHECK( group.waitAny() == NULL );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( group_wait_any ) {
+  PThreadCache cache;
+  cache.set_max_threads( 3 );
+
+  const int n_owners = 4;
+  Owner owners[n_owners];
+  for ( int o = 0; o < n_owners; ++o ) {
+    owners[o].cache = &cache;
+    owners[o].counter = 0;
+    owners[o].n_returned = 0;
+    pthread_create( &owners[o].id, NULL, Owner::run, &owners[o] );
+  }
+
+  for ( int o = 0; o < n_owners; ++o ) {
+    pthread_join( owners[o].id, NULL );
+    BOOST_CHECK_EQUAL( owners[o].counter, 1000 );
+    BOOST_CHECK_EQUAL( owners[o].n_returned, 1000 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( nested_groups ) {
+  PThreadCache cache;
+  cache.set_max_threads( 4 );
+
+  int leaves = 0;
+  GroupTree root( cache, 10, &leaves );
+  PThreadTaskGroup group( cache );
+  group.add( &root );
+  group.wait();
+  BOOST_CHECK_EQUAL( leaves, 1024 );
+}
+
+BOOST_AUTO_TEST_CASE( bulk_tasks ) {
+  PThreadCache cache;
+  for ( int nt = 1; nt <= 4; nt *= 2 ) {
+    cache.set_max_threads( nt );
+
+    int counter = 0;
+    std::vector<Batch> batches( 20, Batch( &cache, &counter ) );
+    std::vector<PThreadTask *> ptrs;
+    for ( unsigned int i = 0u; i < batches.size(); ++i )
+      ptrs.push_back( &batches[i] );
+
+    PThreadTaskGroup group( cache );
+    group.addTasks( ptrs.begin(), ptrs.end() );
+    group.addTasks( ptrs.end(), ptrs.end() );
+    BOOST_CHECK( group.outstanding() <= 20 );
+    group.wait();
+    BOOST_CHECK_EQUAL( counter, 20 * 100 );
+
+    /* without a group, through waitForTasks. */
+    counter = 0;
+    PThreadTaskSet set;
+    for ( int i = 0; i < 50; ++i )
+      set.insert( new Increment( &counter ) );
+    cache.addTasks( set.begin(), set.end() );
+    join( cache, set );
+    BOOST_CHECK_EQUAL( counter, 50 );
+  }
+}
+
+/* Submit tasks from a thread that is not a worker of the cache. */
+struct Submitter {
+  PThreadCache * cache;
+  std::vector<Increment> * tasks;
+
+  static void * run( void * vs ) {
+    Submitter & s = *static_cast<Submitter*>( vs );
+    PThreadTaskGroup group( *s.cache );
+    for ( unsigned int i = 0u; i < s.tasks->size(); ++i )
+      group.add( &(*s.tasks)[i] );
+    group.wait();
+    return NULL;
+  }
+};
+
+BOOST_AUTO_TEST_CASE( resize_while_adding ) {
+  PThreadCache cache;
+  cache.set_max_threads( 2 );
+
+  int counter = 0;
+  std::vector<Increment> tasks( 20000, Increment( &counter ) );
+  Submitter s = { &cache, &tasks };
+  pthread_t submitter;
+  BOOST_REQUIRE_EQUAL(
+    pthread_create( &submitter, NULL, &Submitter::run, &s ), 0 );
+
+  for ( int i = 0; i < 50; ++i )
+    cache.set_max_threads( 2 + i % 3 );
+
+  pthread_join( submitter, NULL );
+  BOOST_CHECK_EQUAL( counter, 20000 );
+}
+
+BOOST_AUTO_TEST_CASE( task_pool ) {
+  PThreadCache cache;
+  cache.set_max_threads( 3 );
+
+  int counter = 0;
+  xylose::PThreadTaskPool<Increment> pool;
+  PThreadTaskGroup group( cache );
+  std::vector<PThreadTask *> first;
+  for ( int i = 0; i < 10; ++i ) {
+    first.push_back( pool.get( &counter ) );
+    group.add( first.back() );
+  }
+  PThreadTask * t;
+  while ( ( t = group.waitAny() ) != NULL )
+    pool.put( t );
+  BOOST_CHECK_EQUAL( pool.available(), 10u );
+
+  /* the steady state only recycles the same objects. */
+  std::sort( first.begin(), first.end() );
+  int n_new = 0;
+  for ( int step = 0; step < 10; ++step ) {
+    for ( int i = 0; i < 10; ++i ) {
+      Increment * inc = pool.get( &counter );
+      n_new += !std::binary_search( first.begin(), first.end(), inc );
+      group.add( inc );
+    }
+    while ( ( t = group.waitAny() ) != NULL )
+      pool.put( t );
+  }
+  BOOST_CHECK_EQUAL( n_new, 0 );
+  BOOST_CHECK_EQUAL( counter, 110 );
+
+  /* a recycled group task can be added without a group. */
+  Increment * inc = pool.get( &counter );
+  BOOST_CHECK( inc->group == NULL );
+  group.add( inc );
+  group.wait();
+  BOOST_CHECK( inc->group == &group );
+  PThreadTaskSet set;
+  set.insert( inc );
+  cache.addTask( inc );
+  BOOST_CHECK( inc->group == NULL );
+  join( cache, set );
+  BOOST_CHECK( group.waitAny() == NULL );
+  BOOST_CHECK_EQUAL( counter, 112 );
+
+  pool.clear();
+  BOOST_CHECK_EQUAL( pool.available(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( affinity_orders ) {
+  namespace aff = xylose::detail::affinity;
+
+  const int list[] = { 0, 1, 2, 3, 8, 10, 11 };
+  const std::vector<int> parsed = aff::parseCpuList( "0-3,8,10-11" );
+  BOOST_CHECK_EQUAL_COLLECTIONS( parsed.begin(), parsed.end(),
+                                 list, list + 7 );
+  BOOST_CHECK( aff::parseCpuList( "3-1" ).empty() );
+  BOOST_CHECK( aff::parseCpuList( "compact" ).empty() );
+
+  /* two packages (= nodes) with two cores of two hardware threads each,
+   * numbered as linux usually does:  the second threads come last. */
+  std::vector<aff::Cpu> cpus;
+  for ( int id = 0; id < 8; ++id )
+    cpus.push_back( aff::Cpu( id, (id / 2) % 2, id % 2, (id / 2) % 2 ) );
+
+  const int compact[] = { 0, 4, 1, 5, 2, 6, 3, 7 };
+  const std::vector<int> c = aff::compactOrder( cpus );
+  BOOST_CHECK_EQUAL_COLLECTIONS( c.begin(), c.end(), compact, compact + 8 );
+
+  const int scatter[] = { 0, 2, 1, 3, 4, 6, 5, 7 };
+  const std::vector<int> s = aff::scatterOrder( cpus );
+  BOOST_CHECK_EQUAL_COLLECTIONS( s.begin(), s.end(), scatter, scatter + 8 );
+
+  BOOST_CHECK_EQUAL( aff::nodeOf( cpus, 6 ), 1 );
+  BOOST_CHECK_EQUAL( aff::nodeOf( cpus, 9 ), -1 );
+}
+
+BOOST_AUTO_TEST_CASE( worker_placement ) {
+  const std::vector<xylose::detail::affinity::Cpu> cpus =
+    xylose::detail::affinity::getCpus();
+  BOOST_REQUIRE( !cpus.empty() );
+
+  PThreadCache cache;
+  cache.set_affinity( PThreadCache::AFFINITY_LIST,
+                      std::vector<int>( 1, cpus.back().id ) );
+  cache.set_max_threads( 2 );
+  BOOST_CHECK_EQUAL( cache.get_affinity(), PThreadCache::AFFINITY_LIST );
+  BOOST_CHECK_EQUAL( cache.get_worker_cpu( 1 ), cpus.back().id );
+  BOOST_CHECK_EQUAL( cache.get_worker_node( 1 ), cpus.back().node );
+  BOOST_CHECK_EQUAL( cache.get_worker_index(), -1 );
+
+  std::vector<WhereAmI> tasks( 100, WhereAmI( &cache ) );
+  {
+    PThreadTaskGroup group( cache );
+    for ( unsigned int i = 0u; i < tasks.size(); ++i )
+      group.add( &tasks[i] );
+  }
+
+  int n_wrong = 0;
+  for ( unsigned int i = 0u; i < tasks.size(); ++i )
+    if ( tasks[i].worker < 0 || tasks[i].worker >= 2 ||
+         tasks[i].cpu != cpus.back().id )
+      ++n_wrong;
+  BOOST_CHECK_EQUAL( n_wrong, 0 );
+
+  /* compact placement of the live threads. */
+  cache.set_affinity( PThreadCache::AFFINITY_COMPACT );
+  BOOST_CHECK_EQUAL( cache.get_worker_cpu( 0 ),
+                     xylose::detail::affinity::compactOrder( cpus )[0] );
+
+  cache.set_affinity( PThreadCache::AFFINITY_NONE );
+  BOOST_CHECK_EQUAL( cache.get_worker_cpu( 0 ), -1 );
+  BOOST_CHECK_EQUAL( cache.get_worker_node( 0 ), -1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
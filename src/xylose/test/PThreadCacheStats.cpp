@@ -0,0 +1,134 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+#define BOOST_TEST_MODULE  PThreadCacheStats
+#define USE_PTHREAD_STATS
+
+#include <xylose/PThreadCache.h>
+
+#include <boost/test/unit_test.hpp>
+#include <unistd.h>
+#include <sstream>
+#include <vector>
+
+namespace {
+  using xylose::PThreadTask;
+  using xylose::PThreadCache;
+  using xylose::PThreadCacheStats;
+  using xylose::PThreadTaskGroup;
+
+  /** Some work that takes a few microseconds. */
+  struct Work : PThreadTask {
+    double x;
+    Work() : x(0) { }
+    virtual void exec() {
+      for ( int i = 0; i < 1000; ++i )
+        x += 1.0 / ( i + x + 1.0 );
+    }
+  };
+}
+
+BOOST_AUTO_TEST_SUITE( PThreadCacheStats_tests );
+
+  BOOST_AUTO_TEST_CASE( latency_histogram ) {
+    xylose::PThreadLatencyHistogram h;
+    for ( int i = 0; i < 99; ++i )
+      h.add( 1000 );      /* 1 us */
+    h.add( 100000000 );   /* 100 ms */
+    BOOST_CHECK_EQUAL( h.count(), 100 );
+    BOOST_CHECK_GE( h.quantile( 0.5 ), 1e-6 );
+    BOOST_CHECK_LE( h.quantile( 0.5 ), 1.34e-6 );
+    BOOST_CHECK_GE( h.quantile( 1.0 ), 0.1 );
+    BOOST_CHECK_LE( h.quantile( 1.0 ), 0.134 );
+
+    h.add( 0 );
+    h.add( 1000000000000LL );
+    BOOST_CHECK_EQUAL( h.count(), 102 );
+  }
+
+  BOOST_AUTO_TEST_CASE( counters ) {
+    PThreadCache cache;
+    cache.set_max_threads( 3 );
+    cache.reset_stats( 0.0 );
+
+    std::vector<Work> tasks( 1000 );
+    {
+      PThreadTaskGroup group( cache );
+      for ( unsigned int i = 0u; i < tasks.size(); ++i )
+        group.add( &tasks[i] );
+    }
+
+    /* let the workers run out of work and park. */
+    usleep( 100000 );
+
+    PThreadCacheStats s = cache.get_stats();
+    BOOST_CHECK( s.enabled );
+    BOOST_CHECK_EQUAL( s.workers.size(), 3u );
+    BOOST_CHECK_EQUAL( s.total().n_tasks, 1000 );
+    BOOST_CHECK_EQUAL( s.total().n_injected + s.total().n_steals, 1000 );
+    BOOST_CHECK_GT( s.total().n_parks, 0 );
+    BOOST_CHECK_GT( s.total().busy_time, 0.0 );
+    BOOST_CHECK_GT( s.total().idle_time, 0.0 );
+    BOOST_CHECK_EQUAL( s.wait_time.count(), 1000 );
+    BOOST_CHECK_EQUAL( s.run_time.count(), 1000 );
+    BOOST_CHECK_GT( s.max_queue_depth, 0 );
+    BOOST_CHECK( !s.queue_depth.empty() );
+    BOOST_CHECK_GT( s.elapsed, 0.1 );
+
+    std::ostringstream out;
+    out << s;
+    BOOST_CHECK( out.str().find( "worker 2" ) != std::string::npos );
+
+    /* the counts of stopped workers are kept. */
+    cache.set_max_threads( 1 );
+    s = cache.get_stats();
+    BOOST_CHECK_EQUAL( s.workers.size(), 0u );
+    BOOST_CHECK_EQUAL( s.retired.n_tasks, 1000 );
+    BOOST_CHECK_EQUAL( s.run_time.count(), 1000 );
+
+    cache.reset_stats();
+    s = cache.get_stats();
+    BOOST_CHECK_EQUAL( s.total().n_tasks, 0 );
+    BOOST_CHECK_EQUAL( s.run_time.count(), 0 );
+    BOOST_CHECK_EQUAL( s.max_queue_depth, 0 );
+    BOOST_CHECK( s.queue_depth.empty() );
+  }
+
+  BOOST_AUTO_TEST_CASE( depth_samples_bounded ) {
+    PThreadCache cache;
+    cache.set_max_threads( 2 );
+    /* sample at every submission to fill the samples. */
+    cache.reset_stats( 1e-9 );
+
+    std::vector<Work> tasks( 10000 );
+    PThreadTaskGroup group( cache );
+    for ( unsigned int i = 0u; i < tasks.size(); ++i )
+      group.add( &tasks[i] );
+    group.wait();
+
+    const PThreadCacheStats s = cache.get_stats();
+    BOOST_CHECK_LE( s.queue_depth.size(), 4096u );
+    BOOST_CHECK_GT( s.sample_interval, 1e-9 );
+    for ( unsigned int i = 1u; i < s.queue_depth.size(); ++i )
+      BOOST_REQUIRE_LE( s.queue_depth[i-1].first, s.queue_depth[i].first );
+  }
+
+BOOST_AUTO_TEST_SUITE_END();
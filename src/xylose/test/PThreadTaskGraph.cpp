@@ -0,0 +1,145 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+#define BOOST_TEST_MODULE  PThreadTaskGraph
+
+#include <xylose/PThreadTaskGraph.h>
+#include <xylose/detail/atomic.h>
+
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <vector>
+#include <utility>
+
+namespace {
+  namespace atomic = xylose::detail::atomic;
+  using xylose::PThreadTask;
+  using xylose::PThreadCache;
+  using xylose::PThreadTaskGraph;
+
+  /** Record the (global) order in which the task finished. */
+  struct Stamp : PThreadTask {
+    int * clock;
+    int stamp;
+    Stamp( int * clock = NULL ) : clock(clock), stamp(-1) { }
+    virtual void exec() { stamp = atomic::add( clock, 1 ); }
+  };
+
+  typedef std::vector< std::pair<int,int> > Edges;
+
+  /** Chains of three phases for a number of blocks, all followed by a
+   * final task. */
+  void buildPhases( PThreadTaskGraph & graph, std::vector<Stamp> & tasks,
+                    Edges & edges, const int & n_blocks ) {
+    for ( int b = 0; b < n_blocks; ++b ) {
+      for ( int p = 0; p < 3; ++p ) {
+        graph.add( &tasks[3*b + p] );
+        if ( p > 0 ) {
+          graph.precede( 3*b + p - 1, 3*b + p );
+          edges.push_back( std::make_pair( 3*b + p - 1, 3*b + p ) );
+        }
+      }
+    }
+
+    const int last = graph.add( &tasks[3*n_blocks] );
+    for ( int b = 0; b < n_blocks; ++b ) {
+      graph.precede( 3*b + 2, last );
+      edges.push_back( std::make_pair( 3*b + 2, last ) );
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE( PThreadTaskGraph_tests );
+
+  BOOST_AUTO_TEST_CASE( order_and_relaunch ) {
+    const int n_blocks = 200;
+    PThreadCache cache;
+
+    for ( int nt = 1; nt <= 4; nt *= 2 ) {
+      cache.set_max_threads( nt );
+
+      int clock = 0;
+      std::vector<Stamp> tasks( 3*n_blocks + 1, Stamp( &clock ) );
+      Edges edges;
+      PThreadTaskGraph graph( cache );
+      buildPhases( graph, tasks, edges, n_blocks );
+      BOOST_CHECK_EQUAL( graph.size(), 3*n_blocks + 1 );
+
+      for ( int step = 0; step < 5; ++step ) {
+        for ( unsigned int i = 0u; i < tasks.size(); ++i )
+          tasks[i].stamp = -1;
+
+        graph.run();
+
+        int n_unrun = 0;
+        for ( unsigned int i = 0u; i < tasks.size(); ++i )
+          n_unrun += tasks[i].stamp < 0;
+        BOOST_CHECK_EQUAL( n_unrun, 0 );
+
+        int n_wrong = 0;
+        for ( unsigned int e = 0u; e < edges.size(); ++e )
+          n_wrong += tasks[ edges[e].first ].stamp >=
+                     tasks[ edges[e].second ].stamp;
+        BOOST_CHECK_EQUAL( n_wrong, 0 );
+      }
+
+      BOOST_CHECK_EQUAL( clock, 5 * (3*n_blocks + 1) );
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( diamond ) {
+    PThreadCache cache;
+    cache.set_max_threads( 3 );
+
+    int clock = 0;
+    std::vector<Stamp> t( 4, Stamp( &clock ) );
+    PThreadTaskGraph graph( cache );
+    for ( int i = 0; i < 4; ++i )
+      graph.add( &t[i] );
+    graph.precede( 0, 1 );
+    graph.precede( 0, 2 );
+    graph.precede( 1, 3 );
+    graph.precede( 2, 3 );
+
+    graph.launch();
+    graph.wait();
+    BOOST_CHECK_EQUAL( t[0].stamp, 1 );
+    BOOST_CHECK_EQUAL( t[3].stamp, 4 );
+  }
+
+  BOOST_AUTO_TEST_CASE( cycle ) {
+    int clock = 0;
+    std::vector<Stamp> t( 3, Stamp( &clock ) );
+    PThreadTaskGraph graph;
+    for ( int i = 0; i < 3; ++i )
+      graph.add( &t[i] );
+    graph.precede( 0, 1 );
+    graph.precede( 1, 2 );
+    graph.precede( 2, 1 );
+    BOOST_CHECK_THROW( graph.run(), std::runtime_error );
+    BOOST_CHECK_EQUAL( clock, 0 );
+
+    graph.clear();
+    BOOST_CHECK_EQUAL( graph.size(), 0 );
+    graph.run();
+  }
+
+BOOST_AUTO_TEST_SUITE_END();
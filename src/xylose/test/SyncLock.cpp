@@ -27,6 +27,7 @@
  */
 
 #define BOOST_TEST_MODULE SyncLock
+#define USE_SYNCLOCK_STATS
 #include <boost/test/unit_test.hpp>
 
 #include <xylose/SyncLock.h>
@@ -37,6 +38,10 @@ using xylose::Synchronize;
 using xylose::synchronize;
 using xylose::SyncLock;
 using xylose::SyncKey;
+using xylose::SharedSyncLock;
+using xylose::ReadSyncKey;
+using xylose::WriteSyncKey;
+using xylose::StripedSyncLock;
 
 struct AStruct {};
 
@@ -94,5 +99,204 @@ BOOST_AUTO_TEST_CASE( syncronize_Functor_access ) {
   BOOST_CHECK_EQUAL( f.value, 1 );
 }
 
+BOOST_AUTO_TEST_CASE( SyncLock_cache_line ) {
+  SyncLock locks[2];
+  BOOST_CHECK_GE( sizeof(SyncLock), 64u );
+  BOOST_CHECK_GE( reinterpret_cast<char*>(&locks[1]) -
+                  reinterpret_cast<char*>(&locks[0]), 64 );
+}
+
+BOOST_AUTO_TEST_CASE( SyncLock_stats ) {
+  SyncLock lock;
+  for ( int i = 0; i < 3; ++i ) {
+    SyncKey key(lock);
+  }
+  BOOST_CHECK_EQUAL( lock.getStats().acquisitions, 3 );
+  BOOST_CHECK_EQUAL( lock.getStats().contended, 0 );
+
+  lock.resetStats();
+  BOOST_CHECK_EQUAL( lock.getStats().acquisitions, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( SharedSyncLock_class ) {
+  SharedSyncLock lock;
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+
+  lock.lockShared();
+    BOOST_CHECK_EQUAL( lock.isLocked(), IF_THREADS(true,false) );
+  lock.unlockShared();
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+
+  {
+    WriteSyncKey key(lock);
+    BOOST_CHECK_EQUAL( lock.isLocked(), IF_THREADS(true,false) );
+  }
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+
+#ifdef USE_PTHREAD
+  {
+    ReadSyncKey a(lock), b(lock);   /* readers share */
+    BOOST_CHECK_EQUAL( lock.tryLockShared(), true );
+    lock.unlockShared();
+    BOOST_CHECK_EQUAL( lock.tryLock(), false );
+  }
+  BOOST_CHECK_EQUAL( lock.tryLock(), true );
+  BOOST_CHECK_EQUAL( lock.tryLockShared(), false );
+  lock.unlock();
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( StripedSyncLock_class ) {
+  StripedSyncLock<16> locks;
+  BOOST_CHECK_EQUAL( locks.size(), 16u );
+
+  double x[64];
+  BOOST_CHECK_EQUAL( &locks.get( &x[3] ), &locks.get( &x[3] ) );
+  BOOST_CHECK_EQUAL( &locks[5], &locks[21] );
+
+  /* neighboring objects are spread over the stripes. */
+  int used[16] = { 0 };
+  for ( int i = 0; i < 64; i += 2 )
+    ++used[ &locks.get( &x[i] ) - &locks[0] ];
+  int n_used = 0;
+  for ( int i = 0; i < 16; ++i )
+    n_used += used[i] > 0;
+  BOOST_CHECK_GE( n_used, 8 );
+
+  {
+    Synchronize<AStruct> sync( &x[0] );
+    BOOST_CHECK_EQUAL( Synchronize<AStruct>::stripes.get( &x[0] ).isLocked(),
+                       IF_THREADS(true,false) );
+    BOOST_CHECK_EQUAL( Synchronize<AStruct>::lock.isLocked(), false );
+  }
+  BOOST_CHECK_EQUAL( Synchronize<AStruct>::stripes.get( &x[0] ).isLocked(),
+                     false );
+}
+
+struct Reader {
+  int value;
+  Reader() : value(0) { }
+  void operator() () {
+    value = 1;
+    BOOST_CHECK_EQUAL( xylose::SharedSynchronize<Reader>::lock.isLocked(),
+                       IF_THREADS(true,false) );
+  }
+};
+
+struct Striped {
+  const void * object;
+  int value;
+  Striped( const void * object ) : object(object), value(0) { }
+  void operator() () {
+    value = 1;
+    BOOST_CHECK_EQUAL( Synchronize<Striped>::stripes.get( object ).isLocked(),
+                       IF_THREADS(true,false) );
+    BOOST_CHECK_EQUAL( Synchronize<Striped>::lock.isLocked(), false );
+  }
+};
+
+BOOST_AUTO_TEST_CASE( synchronize_read_write ) {
+  BOOST_CHECK_EQUAL( xylose::synchronize_read( Reader() ).value, 1 );
+  BOOST_CHECK_EQUAL( xylose::synchronize_write( Reader() ).value, 1 );
+  BOOST_CHECK_EQUAL( xylose::SharedSynchronize<Reader>::lock.isLocked(),
+                     false );
+
+  /* only the stripe of the object is locked. */
+  int object = 0;
+  BOOST_CHECK_EQUAL( xylose::synchronize( Striped( &object ), &object ).value,
+                     1 );
+  BOOST_CHECK_EQUAL( Synchronize<Striped>::stripes.get( &object ).isLocked(),
+                     false );
+}
+
+#ifdef USE_PTHREAD
+/** Readers check that a pair of values is always consistent while writers
+ * change it. */
+struct ReaderWriter {
+  SharedSyncLock * lock;
+  long * a, * b;
+  bool writer;
+  long n_bad;
+  pthread_t id;
+
+  static void * run( void * arg ) {
+    ReaderWriter * rw = static_cast<ReaderWriter *>( arg );
+    for ( int i = 0; i < 20000; ++i ) {
+      if ( rw->writer ) {
+        WriteSyncKey key( *rw->lock );
+        ++*rw->a;
+        ++*rw->b;
+      } else {
+        ReadSyncKey key( *rw->lock );
+        rw->n_bad += *rw->a != *rw->b;
+      }
+    }
+    return NULL;
+  }
+};
+
+BOOST_AUTO_TEST_CASE( SharedSyncLock_contention ) {
+  SharedSyncLock lock;
+  long a = 0, b = 0;
+  const int n = 6;
+  ReaderWriter rw[n];
+  for ( int i = 0; i < n; ++i ) {
+    rw[i].lock = &lock;
+    rw[i].a = &a;
+    rw[i].b = &b;
+    rw[i].writer = i % 3 == 0;
+    rw[i].n_bad = 0;
+    pthread_create( &rw[i].id, NULL, ReaderWriter::run, &rw[i] );
+  }
+
+  long n_bad = 0;
+  for ( int i = 0; i < n; ++i ) {
+    pthread_join( rw[i].id, NULL );
+    n_bad += rw[i].n_bad;
+  }
+
+  BOOST_CHECK_EQUAL( n_bad, 0 );
+  BOOST_CHECK_EQUAL( a, 2 * 20000L );
+  BOOST_CHECK_EQUAL( b, 2 * 20000L );
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+}
+
+/** Increment a shared counter many times under the lock. */
+struct Contender {
+  SyncLock * lock;
+  long * counter;
+  pthread_t id;
+
+  static void * run( void * arg ) {
+    Contender * c = static_cast<Contender *>( arg );
+    for ( int i = 0; i < 100000; ++i ) {
+      SyncKey key( *c->lock );
+      ++*c->counter;
+    }
+    return NULL;
+  }
+};
+
+BOOST_AUTO_TEST_CASE( SyncLock_contention ) {
+  SyncLock lock;
+  long counter = 0;
+  const int n = 4;
+  Contender c[n];
+  for ( int i = 0; i < n; ++i ) {
+    c[i].lock = &lock;
+    c[i].counter = &counter;
+    pthread_create( &c[i].id, NULL, Contender::run, &c[i] );
+  }
+  for ( int i = 0; i < n; ++i )
+    pthread_join( c[i].id, NULL );
+
+  BOOST_CHECK_EQUAL( counter, n * 100000L );
+  BOOST_CHECK_EQUAL( lock.getStats().acquisitions, n * 100000L );
+  BOOST_CHECK_LE( lock.getStats().contended, n * 100000L );
+  BOOST_CHECK_EQUAL( lock.isLocked(), false );
+}
+#endif
+
 } // namespace anon
 
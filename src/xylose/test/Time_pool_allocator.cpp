@@ -0,0 +1,114 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ * Portions copyright Copyright (C) 2010 Stellar Science                       *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE pool_allocator_Timing
+
+#include <xylose/pool_allocator.hpp>
+#include <xylose/random/Kiss.hpp>
+#include <xylose/Timer.h>
+#include <xylose/Vector.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+typedef xylose::Vector<double,3> Vector;
+
+const unsigned int len = 200000u;
+const unsigned int rounds = 10u;
+
+enum FreeOrder { LIFO, FIFO, RANDOM };
+
+const char * order_name[] = { "LIFO", "FIFO", "random" };
+
+/** Random permutation of [0,n). */
+std::vector<unsigned int> permutation( unsigned int n ) {
+  xylose::random::Kiss r;
+  std::vector<unsigned int> p(n);
+  for ( unsigned int i = 0; i < n; ++i )
+    p[i] = i;
+  for ( unsigned int i = n - 1; i > 0; --i )
+    std::swap( p[i], p[ r.randInt() % (i+1) ] );
+  return p;
+}
+
+/** Time allocating len items and then freeing them all in the given order.
+ * The pool is warm after the first round, so later rounds measure reuse of
+ * previously freed items (in the order they were freed). */
+template < typename Alloc >
+void timeFrees( const FreeOrder & order, xylose::Timer & timer ) {
+  Alloc alloc;
+  std::vector<Vector*> items(len);
+  const std::vector<unsigned int> shuffled = permutation(len);
+
+  timer.function = xylose::Timer::CUMMULATIVE;
+  timer.wall_time_label = "s;  ";
+  timer.cpu_time_label = "s (cpu)";
+
+  for ( unsigned int r = 0; r < rounds; ++r ) {
+    timer.start();
+    for ( unsigned int i = 0; i < len; ++i )
+      items[i] = alloc.allocate(1);
+
+    switch ( order ) {
+      case LIFO:
+        for ( unsigned int i = len; i > 0; --i )
+          alloc.deallocate( items[i-1], 1 );
+        break;
+      case FIFO:
+        for ( unsigned int i = 0; i < len; ++i )
+          alloc.deallocate( items[i], 1 );
+        break;
+      case RANDOM:
+        for ( unsigned int i = 0; i < len; ++i )
+          alloc.deallocate( items[ shuffled[i] ], 1 );
+        break;
+    }
+    timer.stop();
+  }
+}
+
+BOOST_AUTO_TEST_CASE( free_order ) {
+  for ( int o = LIFO; o <= RANDOM; ++o ) {
+    xylose::Timer timer_pool, timer_std;
+    timeFrees< xylose::pool_allocator<Vector> >( FreeOrder(o), timer_pool );
+    timeFrees< std::allocator<Vector> >( FreeOrder(o), timer_std );
+
+    BOOST_TEST_MESSAGE( std::string(order_name[o]) + " frees:" );
+    BOOST_TEST_MESSAGE( "  xylose::pool_allocator: " << timer_pool );
+    BOOST_TEST_MESSAGE( "          std::allocator: " << timer_std );
+  }
+
+  /* the pool should be empty again. */
+  xylose::pool_allocator<Vector>().reset();
+  BOOST_CHECK( true );
+}
+
+} // namespace anon
+
@@ -0,0 +1,150 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+
+#define BOOST_TEST_MODULE arena_allocator
+
+#include <xylose/arena_allocator.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <list>
+#include <vector>
+#include <cstddef>
+
+#ifdef USE_PTHREAD
+#  include <pthread.h>
+#endif
+
+namespace {
+
+  bool aligned( const void * p, const std::size_t & align ) {
+    return reinterpret_cast<std::size_t>(p) % align == 0u;
+  }
+
+  BOOST_AUTO_TEST_CASE( bump_and_reset ) {
+    xylose::Arena arena( 4096u );
+
+    char * c = static_cast<char*>( arena.allocate( 1u, 1u ) );
+    double * d = static_cast<double*>( arena.allocate( sizeof(double),
+                                                       sizeof(double) ) );
+    BOOST_CHECK( aligned( d, sizeof(double) ) );
+    BOOST_CHECK( reinterpret_cast<char*>(d) > c );
+    BOOST_CHECK_EQUAL( arena.size(), 1u + sizeof(double) );
+    BOOST_CHECK_EQUAL( arena.capacity(), 4096u );
+
+    /* a request larger than the block size gets a block of its own. */
+    void * big = arena.allocate( 10000u );
+    BOOST_CHECK( big != NULL );
+    const std::size_t cap = arena.capacity();
+    BOOST_CHECK( cap >= 4096u + 10000u );
+
+    /* blocks are kept and reused in the same order after a reset. */
+    arena.reset();
+    BOOST_CHECK_EQUAL( arena.size(), 0u );
+    BOOST_CHECK_EQUAL( static_cast<char*>( arena.allocate( 1u, 1u ) ), c );
+    for ( int i = 0; i < 100; ++i )
+      arena.allocate( 100u );
+    BOOST_CHECK_EQUAL( arena.capacity(), cap );
+
+    arena.release();
+    BOOST_CHECK_EQUAL( arena.capacity(), 0u );
+  }
+
+  BOOST_AUTO_TEST_CASE( stl_containers ) {
+    xylose::Arena arena( 1024u );
+    std::size_t cap0 = 0u;
+
+    for ( int step = 0; step < 3; ++step ) {
+      {
+        typedef xylose::arena_allocator<double> DAlloc;
+        std::vector<double, DAlloc> v( (DAlloc(arena)) );
+        for ( int i = 0; i < 1000; ++i )
+          v.push_back( i );
+        BOOST_CHECK_EQUAL( v[999], 999 );
+        BOOST_CHECK( aligned( &v[0], sizeof(double) ) );
+
+        /* map and list rebind the allocator to their node types. */
+        typedef std::pair<const int, double> Pair;
+        typedef xylose::arena_allocator<Pair> PAlloc;
+        std::map<int, double, std::less<int>, PAlloc>
+          m( (std::less<int>()), PAlloc(arena) );
+        std::list<int, xylose::arena_allocator<int> >
+          l( (xylose::arena_allocator<int>(arena)) );
+        for ( int i = 0; i < 100; ++i ) {
+          m[i] = i * 0.5;
+          l.push_back( i );
+        }
+        BOOST_CHECK_EQUAL( m[42], 21.0 );
+        BOOST_CHECK_EQUAL( l.back(), 99 );
+        BOOST_CHECK( m.get_allocator() == v.get_allocator() );
+      }
+
+      arena.reset();
+      if ( step == 0 )
+        cap0 = arena.capacity();
+    }
+
+    /* the blocks from the first step suffice for the later ones. */
+    BOOST_CHECK( cap0 > 0u );
+    BOOST_CHECK_EQUAL( arena.capacity(), cap0 );
+  }
+
+  struct Scratch {};
+
+  typedef xylose::ThreadArena<Scratch> ScratchArena;
+
+  /* Fill a vector from the thread arena and report the arena used (or NULL
+   * if the vector came out wrong). */
+  void * useThreadArena( void * ) {
+    std::vector<int, xylose::thread_arena_allocator<int,Scratch> > v;
+    for ( int i = 0; i < 100; ++i )
+      v.push_back( i );
+    if ( v[99] != 99 )
+      return NULL;
+    return &ScratchArena::local();
+  }
+
+  BOOST_AUTO_TEST_CASE( thread_arena ) {
+    void * mine = useThreadArena( NULL );
+    BOOST_CHECK( mine != NULL );
+    BOOST_CHECK( ScratchArena::local().size() > 0u );
+    ScratchArena::reset();
+    BOOST_CHECK_EQUAL( ScratchArena::local().size(), 0u );
+
+    /* different tags are independent arenas. */
+    BOOST_CHECK( &xylose::ThreadArena<>::local() != mine );
+
+#ifdef USE_PTHREAD
+    pthread_t thread;
+    void * theirs = NULL;
+    BOOST_REQUIRE_EQUAL(
+      pthread_create( &thread, NULL, &useThreadArena, NULL ), 0 );
+    pthread_join( thread, &theirs );
+    BOOST_CHECK( theirs != NULL );
+    BOOST_CHECK( theirs != mine );
+    BOOST_CHECK_EQUAL( ScratchArena::local().size(), 0u );
+#endif
+  }
+
+} // namespace anon
+
@@ -0,0 +1,184 @@
+/*==============================================================================
+ * Public Domain Contributions 2010 United States Government                   *
+ * as represented by the U.S. Air Force Research Laboratory.                   *
+ *                                                                             *
+ * This file is part of xylose                                                 *
+ *                                                                             *
+ * This program is free software: you can redistribute it and/or modify it     *
+ * under the terms of the GNU Lesser General Public License as published by    *
+ * the Free Software Foundation, either version 3 of the License, or (at your  *
+ * option) any later version.                                                  *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful, but WITHOUT *
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or       *
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public        *
+ * License for more details.                                                   *
+ *                                                                             *
+ * You should have received a copy of the GNU Lesser General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.       *
+ *                                                                             *
+ -----------------------------------------------------------------------------*/
+
+#define BOOST_TEST_MODULE  parallel_for
+
+#include <xylose/parallel_for.h>
+#include <xylose/detail/atomic.h>
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cmath>
+
+namespace {
+  namespace atomic = xylose::detail::atomic;
+  using xylose::IteratorRange;
+  using xylose::PThreadCache;
+
+  const xylose::ParallelSchedule schedules[] = {
+    xylose::RECURSIVE, xylose::STATIC, xylose::DYNAMIC
+  };
+
+  /** Count the visits of each index and record the largest subrange. */
+  struct Visit {
+    std::vector<int> & visits;
+    int * largest;
+
+    Visit( std::vector<int> & visits, int * largest )
+      : visits(visits), largest(largest) { }
+
+    void operator() ( const IteratorRange<int> & r ) const {
+      for ( int i = r.begin(); i < r.end(); ++i )
+        atomic::add( &visits[i], 1 );
+
+      int l = atomic::load( largest );
+      while ( static_cast<int>(r.size()) > l &&
+              !atomic::cas( largest, l, static_cast<int>(r.size()) ) );
+    }
+  };
+
+  /** Sum of the elements of a range. */
+  struct Sum {
+    double operator() ( const IteratorRange<std::vector<double>::const_iterator>
+                        & r, const double & init ) const {
+      double s = init;
+      for ( std::vector<double>::const_iterator i = r.begin(); i != r.end(); ++i )
+        s += *i;
+      return s;
+    }
+  };
+
+  struct Plus {
+    double operator() ( const double & a, const double & b ) const {
+      return a + b;
+    }
+  };
+
+  /** Runs a nested parallel_for over each of its elements. */
+  struct Nested {
+    PThreadCache & cache;
+    std::vector<int> & visits;
+
+    Nested( PThreadCache & cache, std::vector<int> & visits )
+      : cache(cache), visits(visits) { }
+
+    void operator() ( const IteratorRange<int> & r ) const {
+      for ( int i = r.begin(); i < r.end(); ++i ) {
+        int largest = 0;
+        xylose::parallel_for( IteratorRange<int>( i*100, (i+1)*100 ), 10,
+                              Visit( visits, &largest ), xylose::RECURSIVE,
+                              cache );
+      }
+    }
+  };
+}
+
+BOOST_AUTO_TEST_SUITE( parallel_for );
+
+  BOOST_AUTO_TEST_CASE( every_index_once ) {
+    PThreadCache cache;
+    for ( int nt = 1; nt <= 4; ++nt ) {
+      cache.set_max_threads( nt );
+      for ( int s = 0; s < 3; ++s ) {
+        std::vector<int> visits( 10007, 0 );
+        int largest = 0;
+        xylose::parallel_for( IteratorRange<int>( 0, visits.size() ), 64,
+                              Visit( visits, &largest ), schedules[s], cache );
+
+        int bad = 0;
+        for ( unsigned int i = 0; i < visits.size(); ++i )
+          bad += visits[i] != 1;
+        BOOST_CHECK_EQUAL( bad, 0 );
+
+        if ( nt > 1 && s != xylose::STATIC )
+          BOOST_CHECK_LE( largest, 64 );
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( empty_and_automatic_grain ) {
+    PThreadCache cache;
+    cache.set_max_threads( 3 );
+    std::vector<int> visits( 1000, 0 );
+    int largest = 0;
+
+    xylose::parallel_for( IteratorRange<int>( 0, 0 ), 0,
+                          Visit( visits, &largest ), xylose::RECURSIVE, cache );
+    BOOST_CHECK_EQUAL( largest, 0 );
+
+    xylose::parallel_for( IteratorRange<int>( 0, visits.size() ), 0,
+                          Visit( visits, &largest ), xylose::DYNAMIC, cache );
+    int bad = 0;
+    for ( unsigned int i = 0; i < visits.size(); ++i )
+      bad += visits[i] != 1;
+    BOOST_CHECK_EQUAL( bad, 0 );
+  }
+
+  BOOST_AUTO_TEST_CASE( nested ) {
+    PThreadCache cache;
+    cache.set_max_threads( 4 );
+    std::vector<int> visits( 3200, 0 );
+    xylose::parallel_for( IteratorRange<int>( 0, 32 ), 1,
+                          Nested( cache, visits ), xylose::RECURSIVE, cache );
+
+    int bad = 0;
+    for ( unsigned int i = 0; i < visits.size(); ++i )
+      bad += visits[i] != 1;
+    BOOST_CHECK_EQUAL( bad, 0 );
+  }
+
+  BOOST_AUTO_TEST_CASE( reproducible_reduce ) {
+    /* terms of widely varying magnitude such that the order of summation
+     * shows up in the last bits. */
+    std::vector<double> x( 50000 );
+    for ( unsigned int i = 0; i < x.size(); ++i )
+      x[i] = std::sin( 0.37 * i ) * std::pow( 10.0, static_cast<int>(i % 17) - 8 );
+
+    typedef std::vector<double>::const_iterator CIter;
+    const IteratorRange<CIter> range( x.begin(), x.end() );
+
+    PThreadCache cache;
+    cache.set_max_threads( 1 );
+    const double serial =
+      xylose::parallel_reduce( range, 100, 0.0, Sum(), Plus(),
+                               xylose::RECURSIVE, cache );
+
+    for ( int nt = 1; nt <= 4; ++nt ) {
+      cache.set_max_threads( nt );
+      for ( int s = 0; s < 3; ++s ) {
+        const double r =
+          xylose::parallel_reduce( range, 100, 0.0, Sum(), Plus(),
+                                   schedules[s], cache );
+        BOOST_CHECK( r == serial );
+      }
+    }
+
+    /* the default grain gives the same result as the explicit equivalent. */
+    BOOST_CHECK( xylose::parallel_reduce( range, 0.0, Sum(), Plus() ) ==
+                 xylose::parallel_reduce( range, (x.size() + 255) / 256,
+                                          0.0, Sum(), Plus() ) );
+
+    BOOST_CHECK_EQUAL(
+      xylose::parallel_reduce( IteratorRange<CIter>( x.begin(), x.begin() ),
+                               1.5, Sum(), Plus() ), 1.5 );
+  }
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -28,8 +28,14 @@
 #include <xylose/segmented_vector.hpp>
 #include <xylose/random/Kiss.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <stdexcept>
+
+#ifdef USE_PTHREAD
+#  include <pthread.h>
+#endif
 
 #include <boost/test/unit_test.hpp>
 
@@ -112,5 +118,93 @@ BOOST_AUTO_TEST_CASE( std_map_test ) {
   BOOST_CHECK_EQUAL( foo[a], 1 );
 }
 
+BOOST_AUTO_TEST_CASE( reset_requires_all_freed ) {
+  xylose::pool_allocator<short> alloc;
+  xylose::pool_allocator<short>::setDealloc<true>::type noop;
+
+  short * a = alloc.allocate(1);
+  BOOST_CHECK_THROW( alloc.reset(), std::bad_alloc );
+  alloc.deallocate(a);
+  alloc.reset();
+
+  /* with noOPDealloc, deallocated items are only reclaimed by reset(). */
+  std::vector<short*> pointers;
+  for ( unsigned int i = 0; i < 1000; ++i )
+    pointers.push_back( noop.allocate(1) );
+  for ( unsigned int i = 0; i < 999; ++i )
+    noop.deallocate( pointers[i] );
+  BOOST_CHECK_THROW( noop.reset(), std::bad_alloc );
+  noop.deallocate( pointers.back() );
+  noop.reset();
+}
+
+#ifdef USE_PTHREAD
+
+typedef xylose::pool_allocator<double> ThreadAlloc;
+typedef ThreadAlloc::setDealloc<true>::type ThreadNoopAlloc;
+
+/* Each thread churns through its own items and leaves every other item
+ * allocated to be freed later by the main thread. */
+template < typename Alloc >
+struct Churn {
+  std::vector<double*> left;
+
+  static void * run( void * vc ) {
+    Churn & c = *static_cast<Churn*>( vc );
+    Alloc alloc;
+    xylose::random::Kiss r;
+    std::vector<double*> mine;
+    for ( unsigned int i = 0; i < 20000; ++i ) {
+      if ( mine.empty() || r.rand() < 0.6 ) {
+        mine.push_back( alloc.allocate(1) );
+        *mine.back() = i;
+      } else {
+        alloc.deallocate( mine.back() );
+        mine.pop_back();
+      }
+    }
+
+    for ( unsigned int i = 0; i < mine.size(); ++i ) {
+      if ( i % 2 )
+        c.left.push_back( mine[i] );
+      else
+        alloc.deallocate( mine[i] );
+    }
+    return NULL;
+  }
+};
+
+template < typename Alloc >
+void churnThreads() {
+  const int nthreads = 4;
+  Churn<Alloc> churn[nthreads];
+  pthread_t threads[nthreads];
+  for ( int i = 0; i < nthreads; ++i )
+    BOOST_REQUIRE_EQUAL(
+      pthread_create( threads + i, NULL, &Churn<Alloc>::run, churn + i ), 0 );
+  for ( int i = 0; i < nthreads; ++i )
+    pthread_join( threads[i], NULL );
+
+  /* items of exited threads must still be intact and not double booked. */
+  Alloc alloc;
+  std::vector<double*> all;
+  for ( int i = 0; i < nthreads; ++i )
+    all.insert( all.end(), churn[i].left.begin(), churn[i].left.end() );
+  std::sort( all.begin(), all.end() );
+  BOOST_CHECK( std::adjacent_find( all.begin(), all.end() ) == all.end() );
+
+  BOOST_CHECK_THROW( alloc.reset(), std::bad_alloc );
+  for ( unsigned int i = 0; i < all.size(); ++i )
+    alloc.deallocate( all[i] );
+  alloc.reset();
+}
+
+BOOST_AUTO_TEST_CASE( thread_magazines ) {
+  churnThreads< ThreadAlloc >();
+  churnThreads< ThreadNoopAlloc >();
+}
+
+#endif
+
 }
 